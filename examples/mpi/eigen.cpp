@@ -18,9 +18,12 @@ int main()
   if (rank == 0)
     std::cout << Eigen::MatrixXd(x) << std::endl;
   
-  auto y = spar::reduce::gather<spar::conv::eigen_t<INDEX, SCALAR>, INDEX, SCALAR>(0, x);
+  // reduce straight into an Eigen matrix; no intermediate spmat is built
+  spar::conv::eigen_t<INDEX, SCALAR> y;
+  spar::writers::eigen_writer<INDEX, SCALAR> w(y);
+  spar::reduce::gather<spar::conv::eigen_t<INDEX, SCALAR>, INDEX, SCALAR>(0, x, w);
   if (rank == 0)
-    y.print();
+    std::cout << std::endl << Eigen::MatrixXd(y) << std::endl;
   
   spar::mpi::finalize();
   
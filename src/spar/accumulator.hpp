@@ -0,0 +1,378 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_ACCUMULATOR_H
+#define SPAR_ACCUMULATOR_H
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <stdexcept>
+#include <vector>
+
+#include "spar.hpp"
+#include "reduce.hpp"
+
+
+namespace spar
+{
+  namespace internal
+  {
+    // key of the unused slots of an accumulator; the largest real key is
+    // m*n - 1, which is smaller
+    static const uint64_t EMPTY_KEY = UINT64_MAX;
+  }
+  
+  /**
+    @brief Streaming builder of a distributed sparse matrix. Every rank adds
+    `(i, j, x)` updates at its own pace; duplicates are summed in a local hash
+    table, which is spilled into a sorted CSC block whenever it fills up.
+    `flush()` then reduces all ranks' contributions.
+    
+    @details The spilled blocks are kept in a list, newest last, and merged in
+    tiers like an LSM tree: after a spill, the last two blocks are merged for
+    as long as the older one has at most twice the entries of the newer one.
+    The block sizes then more than double from newest to oldest, so with `D`
+    distinct entries there are about `log2(D/capacity) + 1` blocks, and an
+    entry takes part in about as many merges: `O(D log(D/capacity))` work in
+    total, instead of merging everything spilled so far on every spill.
+    Everything is merged into a single matrix only by `local()` and
+    `flush()`.
+    
+    The memory in use is the hash table, fixed at construction, plus the
+    blocks, which hold each distinct `(i, j)` at most once per block. It does
+    not grow with the length of the stream. An accumulator is not
+    thread-safe; use one per thread, and combine them with `spar::add()` or
+    `spar::reduce::hybrid()`.
+    
+    @tparam INDEX should be some kind of fundamental indexing type, like `int`
+    or `uint16_t`.
+    @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+    @tparam OFFSET is the column pointer type of the spilled and returned
+    matrices, as in `spmat`.
+   */
+  template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+  class accumulator
+  {
+    public:
+      accumulator(const INDEX nrows_, const INDEX ncols_, const uint64_t capacity_=65536);
+      ~accumulator();
+      accumulator(const accumulator &x) = delete;
+      accumulator& operator=(const accumulator &x) = delete;
+      
+      void add(const INDEX i, const INDEX j, const SCALAR x);
+      void spill();
+      void clear();
+      const spmat<INDEX, SCALAR, OFFSET>& local();
+      
+      spmat<INDEX, SCALAR, OFFSET> flush(const int root, MPI_Comm comm=MPI_COMM_WORLD);
+      template <class WRITER>
+      void flush(const int root, WRITER &w, MPI_Comm comm=MPI_COMM_WORLD);
+      
+      /// Number of rows.
+      INDEX nrows() const {return m;};
+      /// Number of columns.
+      INDEX ncols() const {return n;};
+      /// Number of distinct entries waiting in the hash table.
+      uint64_t get_pending() const {return count;};
+      /// Number of entries the hash table holds before it spills.
+      uint64_t get_capacity() const {return capacity;};
+      /// Number of spilled CSC blocks not merged yet.
+      uint64_t get_blocks() const {return blocks.size();};
+    
+    protected:
+      /// Number of rows.
+      INDEX m;
+      /// Number of columns.
+      INDEX n;
+      /// Entries the table holds before spilling.
+      uint64_t capacity;
+      /// Entries in the table.
+      uint64_t count;
+      /// log2 of the number of slots.
+      int bits;
+      /// Slot keys `j*m + i`, or `internal::EMPTY_KEY`.
+      uint64_t *keys;
+      /// Slot values.
+      SCALAR *vals;
+      /// Everything spilled so far, as CSC blocks of decreasing size.
+      std::list<spmat<INDEX, SCALAR, OFFSET>> blocks;
+    
+    private:
+      void merge_last(const size_t k);
+      uint64_t num_slots() const {return (uint64_t) 1 << bits;};
+      uint64_t slot(const uint64_t key) const;
+  };
+}
+
+
+
+// ----------------------------------------------------------------------------
+// constructor/destructor
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Constructor.
+  
+  @param[in] nrows_,ncols_ The dimension of the matrix.
+  @param[in] capacity_ Number of distinct entries buffered before they are
+  spilled. The table has at least twice as many slots.
+  
+  @allocs The hash table: a 64-bit key and a `SCALAR` per slot.
+  
+  @except If `nrows_*ncols_` does not fit in 64 bits, a `runtime_error`
+  exception will be thrown. If a memory allocation fails, a `bad_alloc`
+  exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::accumulator<INDEX, SCALAR, OFFSET>::accumulator(const INDEX nrows_,
+  const INDEX ncols_, const uint64_t capacity_)
+{
+  if (nrows_ > 0 && (uint64_t) ncols_ > (internal::EMPTY_KEY - 1) / (uint64_t) nrows_)
+    throw std::runtime_error("matrix dimensions too large for the accumulator keys");
+  
+  m = nrows_;
+  n = ncols_;
+  capacity = std::max(capacity_, (uint64_t) 1);
+  count = 0;
+  
+  bits = 1;
+  while (num_slots() < 2*capacity)
+    bits++;
+  
+  arraytools::alloc(num_slots(), &keys);
+  arraytools::alloc(num_slots(), &vals);
+  arraytools::check_allocs(keys, vals);
+  
+  std::fill(keys, keys + num_slots(), internal::EMPTY_KEY);
+}
+
+
+
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::accumulator<INDEX, SCALAR, OFFSET>::~accumulator()
+{
+  arraytools::free(keys);
+  keys = NULL;
+  arraytools::free(vals);
+  vals = NULL;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// local accumulation
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Add a value to entry `(i, j)`.
+  
+  @param[in] i,j Row and column.
+  @param[in] x The value.
+  
+  @allocs If the table is full, it is spilled first (see `spill()`).
+  
+  @except If `(i, j)` is out of range, a `runtime_error` exception will be
+  thrown. If a memory allocation fails, a `bad_alloc` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::accumulator<INDEX, SCALAR, OFFSET>::add(const INDEX i, const INDEX j,
+  const SCALAR x)
+{
+  // negative indices wrap around to large unsigned ones
+  if ((uint64_t) i >= (uint64_t) m || (uint64_t) j >= (uint64_t) n)
+    throw std::runtime_error("accumulator index out of range");
+  
+  const uint64_t key = (uint64_t) j * m + (uint64_t) i;
+  const uint64_t mask = num_slots() - 1;
+  
+  // linear probing; the table is at most half full
+  uint64_t s = slot(key);
+  while (keys[s] != internal::EMPTY_KEY && keys[s] != key)
+    s = (s + 1) & mask;
+  
+  if (keys[s] == key)
+  {
+    vals[s] += x;
+    return;
+  }
+  
+  if (count == capacity)
+  {
+    spill();
+    s = slot(key);
+  }
+  
+  keys[s] = key;
+  vals[s] = x;
+  count++;
+}
+
+
+
+/**
+  @brief Move the entries of the hash table into a new spilled block and
+  empty the table, then merge the newest blocks while they are of similar
+  size. `add()` calls this when the table is full.
+  
+  @allocs A triplet copy of the table's entries, the sorted CSC block built
+  from them, and the merged blocks.
+  
+  @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::accumulator<INDEX, SCALAR, OFFSET>::spill()
+{
+  if (count == 0)
+    return;
+  
+  std::vector<INDEX> rows(count);
+  std::vector<INDEX> cols(count);
+  std::vector<SCALAR> x(count);
+  
+  uint64_t k = 0;
+  for (uint64_t s=0; s<num_slots(); s++)
+  {
+    if (keys[s] != internal::EMPTY_KEY)
+    {
+      rows[k] = (INDEX) (keys[s] % m);
+      cols[k] = (INDEX) (keys[s] / m);
+      x[k] = vals[s];
+      k++;
+    }
+  }
+  
+  blocks.push_back(spmat<INDEX, SCALAR, OFFSET>::from_triplets(m, n,
+    (OFFSET) count, rows.data(), cols.data(), x.data()));
+  
+  std::fill(keys, keys + num_slots(), internal::EMPTY_KEY);
+  count = 0;
+  
+  while (blocks.size() > 1)
+  {
+    const uint64_t newer = blocks.back().get_nnz();
+    const uint64_t older = std::prev(blocks.end(), 2)->get_nnz();
+    if (older > 2*newer)
+      break;
+    
+    merge_last(2);
+  }
+}
+
+
+
+/// Drop everything accumulated so far. Performs no allocations.
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::accumulator<INDEX, SCALAR, OFFSET>::clear()
+{
+  std::fill(keys, keys + num_slots(), internal::EMPTY_KEY);
+  count = 0;
+  blocks.clear();
+}
+
+
+
+/**
+  @brief Everything accumulated on this rank so far, as a sparse matrix.
+  The table is spilled first, and all blocks are merged into one.
+  
+  @return A reference to the merged matrix. It stays valid until the next
+  call to `add()`, `spill()`, `clear()` or `flush()`.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+const spar::spmat<INDEX, SCALAR, OFFSET>& spar::accumulator<INDEX, SCALAR, OFFSET>::local()
+{
+  spill();
+  if (blocks.empty())
+    blocks.push_back(spmat<INDEX, SCALAR, OFFSET>(m, n, 0));
+  else if (blocks.size() > 1)
+    merge_last(blocks.size());
+  
+  return blocks.front();
+}
+
+
+
+// ----------------------------------------------------------------------------
+// reduction
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Reduce the contributions of all ranks with `spar::reduce::gather()`
+  and start over. Every rank of `comm` has to call this.
+  
+  @param[in] root The number of the receiving process in the case of a
+  reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+  @param[in] comm MPI communicator.
+  
+  @return The sum over all ranks on the receiving processes, and an empty
+  matrix of the same dimensions on the others.
+  
+  @comm See `spar::reduce::gather()`.
+  
+  @except If a memory allocation fails, a `bad_alloc` exception will be
+  thrown. If something goes wrong with any of the MPI operations, a
+  `runtime_error` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET> spar::accumulator<INDEX, SCALAR, OFFSET>::flush(
+  const int root, MPI_Comm comm)
+{
+  spmat<INDEX, SCALAR, OFFSET> s(m, n, 0);
+  writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+  flush(root, w, comm);
+  
+  return s;
+}
+
+
+
+/**
+  @brief \overload
+  
+  @param[out] w A writer (see `spar::writers`) which receives the reduced
+  columns on the receiving processes.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+template <class WRITER>
+void spar::accumulator<INDEX, SCALAR, OFFSET>::flush(const int root, WRITER &w,
+  MPI_Comm comm)
+{
+  reduce::gather<spmat<INDEX, SCALAR, OFFSET>, INDEX, SCALAR>(root, local(), w, comm);
+  blocks.clear();
+}
+
+
+
+// ----------------------------------------------------------------------------
+// internals
+// ----------------------------------------------------------------------------
+
+// replace the newest k blocks by their sum, in one k-way merge
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::accumulator<INDEX, SCALAR, OFFSET>::merge_last(const size_t k)
+{
+  std::vector<const spmat<INDEX, SCALAR, OFFSET>*> ptrs;
+  for (auto it=std::prev(blocks.end(), k); it!=blocks.end(); ++it)
+    ptrs.push_back(&*it);
+  
+  spmat<INDEX, SCALAR, OFFSET> merged = internal::add::sum(k, ptrs.data());
+  blocks.erase(std::prev(blocks.end(), k), blocks.end());
+  blocks.push_back(merged);
+}
+
+
+
+// Fibonacci hashing: the top bits of the key times 2^64/phi
+template <typename INDEX, typename SCALAR, typename OFFSET>
+uint64_t spar::accumulator<INDEX, SCALAR, OFFSET>::slot(const uint64_t key) const
+{
+  return (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+}
+
+
+#endif
@@ -8,10 +8,12 @@
 
 
 #include <cstdint>
+#include <stdexcept>
 
 #include <Eigen/SparseCore>
 
 #include "../arraytools/src/arraytools.hpp"
+#include "../core/fwd.hpp"
 
 
 namespace spar
@@ -23,7 +25,7 @@ namespace spar
   class spvec;
 
   template <typename INDEX, typename SCALAR>
-  class spmat;
+  class spvec_view;
   
   namespace conv
   {
@@ -37,6 +39,17 @@ namespace spar
     template <typename INDEX, typename SCALAR>
     using eigen_t = Eigen::SparseMatrix<SCALAR, Eigen::StorageOptions::ColMajor, INDEX>;
     
+    /**
+      @brief Shorthand for a read-only `Eigen::Map` over CSC storage owned by
+      someone else.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR>
+    using eigen_map_t = Eigen::Map<const eigen_t<INDEX, SCALAR>>;
+    
     
     
     /**
@@ -112,6 +125,78 @@ namespace spar
     
     
     
+    /**
+      @brief Wrap an `spmat` object as an `Eigen::Map` without copying.
+      
+      @param[in] x The input `spmat` object.
+      
+      @return A read-only Eigen map over the storage of `x`. It is invalidated
+      by any operation that resizes or destroys `x`.
+      
+      @allocs Nothing is allocated.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR>
+    static inline eigen_map_t<INDEX, SCALAR> spmat_to_eigen_map(const spmat<INDEX, SCALAR> &x)
+    {
+      return eigen_map_t<INDEX, SCALAR>(x.nrows(), x.ncols(), x.get_nnz(),
+        x.col_ptr(), x.index_ptr(), x.data_ptr());
+    }
+    
+    /// \overload
+    template <typename INDEX, typename SCALAR>
+    static inline eigen_map_t<INDEX, SCALAR> spmat_to_eigen_map(const spmat_view<INDEX, SCALAR> &x)
+    {
+      return eigen_map_t<INDEX, SCALAR>(x.nrows(), x.ncols(), x.get_nnz(),
+        x.col_ptr(), x.index_ptr(), x.data_ptr());
+    }
+    
+    
+    
+    /**
+      @brief Wrap an `Eigen::SparseMatrix` (or a map of one) as an `spmat_view`
+      without copying. The view can be passed to any of the reducers.
+      
+      @param[in] s The input Eigen object. It must be in compressed mode.
+      
+      @return A view over the storage of `s`. It is invalidated by any
+      operation that resizes, uncompresses, or destroys `s`.
+      
+      @allocs Nothing is allocated.
+      
+      @except If `s` is not compressed, a `logic_error` exception will be
+      thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR>
+    static inline spmat_view<INDEX, SCALAR> eigen_to_spmat_view(const eigen_t<INDEX, SCALAR> &s)
+    {
+      if (!s.isCompressed())
+        throw std::logic_error("Eigen matrix must be compressed to be viewed");
+      
+      return spmat_view<INDEX, SCALAR>(s.rows(), s.cols(), s.innerIndexPtr(),
+        s.outerIndexPtr(), s.valuePtr());
+    }
+    
+    /// \overload
+    template <typename INDEX, typename SCALAR>
+    static inline spmat_view<INDEX, SCALAR> eigen_to_spmat_view(const eigen_map_t<INDEX, SCALAR> &s)
+    {
+      if (!s.isCompressed())
+        throw std::logic_error("Eigen matrix must be compressed to be viewed");
+      
+      return spmat_view<INDEX, SCALAR>(s.rows(), s.cols(), s.innerIndexPtr(),
+        s.outerIndexPtr(), s.valuePtr());
+    }
+    
+    
+    
     /**
       @brief Convert a column of an `Eigen::SparseMatrix` object into a dense
       `dvec` object.
@@ -155,6 +240,59 @@ namespace spar
   
   
   
+  namespace writers
+  {
+    /**
+      @brief Write the reduced matrix directly into an `Eigen::SparseMatrix`,
+      using Eigen's sequential fill interface. No intermediate `spmat` is
+      built.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR>
+    class eigen_writer
+    {
+      public:
+        /**
+          @brief Constructor.
+          
+          @param[out] s_ The output matrix. Its contents are replaced.
+         */
+        eigen_writer(conv::eigen_t<INDEX, SCALAR> &s_) : s(s_) {};
+        
+        void init(const INDEX m, const INDEX n, const INDEX len)
+        {
+          s.resize(m, n);
+          s.reserve(len);
+          next_col = 0;
+        }
+        
+        void insert(const INDEX col, const INDEX nnz, const INDEX *I, const SCALAR *X)
+        {
+          for (; next_col<=col; next_col++)
+            s.startVec(next_col);
+          
+          for (INDEX ind=0; ind<nnz; ind++)
+            s.insertBack(I[ind], col) = X[ind];
+        }
+        
+        void finalize()
+        {
+          s.finalize();
+        }
+      
+      protected:
+        /// The output matrix.
+        conv::eigen_t<INDEX, SCALAR> &s;
+        /// First column which has not been started.
+        INDEX next_col;
+    };
+  }
+  
+  
+  
   namespace internal
   {
     namespace get
@@ -186,6 +324,17 @@ namespace spar
         s.set(col_nnz, I + ind, X + ind);
       }
       
+      template <typename INDEX, typename SCALAR>
+      static inline void col(const INDEX j, const conv::eigen_t<INDEX, SCALAR> &x, spvec_view<INDEX, SCALAR> &s)
+      {
+        const INDEX *I = x.innerIndexPtr();
+        const INDEX *P = x.outerIndexPtr();
+        const SCALAR *X = x.valuePtr();
+        
+        const INDEX ind = P[j];
+        s.set(P[j + 1] - ind, I + ind, X + ind);
+      }
+      
       
       
       template <typename INDEX, typename SCALAR>
@@ -204,6 +353,65 @@ namespace spar
         
         return max_nnz;
       }
+      
+      
+      
+      template <typename INDEX, typename SCALAR>
+      static inline void dim(const conv::eigen_map_t<INDEX, SCALAR> &x, INDEX *m, INDEX *n)
+      {
+        *m = (INDEX) x.rows();
+        *n = (INDEX) x.cols();
+      }
+      
+      
+      
+      template <typename INDEX, typename SCALAR>
+      static inline void col(const INDEX j, const conv::eigen_map_t<INDEX, SCALAR> &x, spvec<INDEX, SCALAR> &s)
+      {
+        const INDEX *I = x.innerIndexPtr();
+        const INDEX *P = x.outerIndexPtr();
+        const SCALAR *X = x.valuePtr();
+        
+        const INDEX ind = P[j];
+        if (P[j + 1] == ind)
+        {
+          s.zero();
+          return;
+        }
+        
+        const INDEX col_nnz = P[j + 1] - ind;
+        s.set(col_nnz, I + ind, X + ind);
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      static inline void col(const INDEX j, const conv::eigen_map_t<INDEX, SCALAR> &x, spvec_view<INDEX, SCALAR> &s)
+      {
+        const INDEX *I = x.innerIndexPtr();
+        const INDEX *P = x.outerIndexPtr();
+        const SCALAR *X = x.valuePtr();
+        
+        const INDEX ind = P[j];
+        s.set(P[j + 1] - ind, I + ind, X + ind);
+      }
+      
+      
+      
+      template <typename INDEX, typename SCALAR>
+      static inline INDEX max_col_nnz(const conv::eigen_map_t<INDEX, SCALAR> &x)
+      {
+        const INDEX n = x.cols();
+        const INDEX *P = x.outerIndexPtr();
+        
+        INDEX max_nnz = 0;
+        for (INDEX col=0; col<n; col++)
+        {
+          INDEX col_nnz = P[col + 1] - P[col];
+          if (col_nnz > max_nnz)
+            max_nnz = col_nnz;
+        }
+        
+        return max_nnz;
+      }
     }
   }
 }
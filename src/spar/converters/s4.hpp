@@ -7,12 +7,21 @@
 #pragma once
 
 
+#include <stdexcept>
+#include <type_traits>
+
 #include <Rdefines.h>
 #include <Rinternals.h>
 
 #undef nrows
 #undef ncols
 
+#include "../arraytools/src/arraytools.hpp"
+#include "../core/defs.hpp"
+#include "../core/fwd.hpp"
+#include "../core/spmat_view.hpp"
+#include "../core/writers.hpp"
+
 
 namespace spar
 {
@@ -20,7 +29,7 @@ namespace spar
   class spvec;
 
   template <typename INDEX, typename SCALAR>
-  class spmat;
+  class spvec_view;
   
   namespace internal
   {
@@ -121,49 +130,60 @@ namespace spar
     
     
     /**
-      @brief Convert an `spmat` object into a `dgCMatrix` sparse matrix.
+      @brief Wrap a `dgCMatrix` object as an `spmat_view` without copying. The
+      view can be passed to any of the reducers.
       
-      @param[in] s The input `spmat` object.
+      @param[in] s4 The input `dgCMatrix` object.
       
-      @return The return sparse matrix.
+      @return A view over the `i`, `p`, and `x` slots of `s4`. It is only valid
+      for as long as `s4` is protected from the garbage collector.
       
-      @allocs The return object is roughly of size:
-      `sizeof(int)*(2 + nnz + (n+1)) + sizeof(double)*nnz`.
+      @allocs Nothing is allocated.
+     */
+    static inline spmat_view<int, double> s4_to_spmat_view(SEXP s4)
+    {
+      int m, n;
+      internal::sexp::get_dim_from_s4(s4, &m, &n);
       
-      @except If a memory allocation fails, a `bad_alloc` exception will be
-      thrown.
+      SEXP s4_X = internal::sexp::get_x_from_s4(s4);
+      SEXP s4_I = internal::sexp::get_i_from_s4(s4);
+      SEXP s4_P = internal::sexp::get_p_from_s4(s4);
       
-      @tparam INDEX should be some kind of fundamental indexing type, like `int`
-      or `uint16_t`.
-      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      return spmat_view<int, double>(m, n, INTEGER(s4_I), INTEGER(s4_P), REAL(s4_X));
+    }
+    
+    
+    
+    /**
+      @brief Allocate a `dgCMatrix` with room for a given number of non-zero
+      elements. The `i`, `p`, and `x` slots are left uninitialized.
+      
+      @param[in] m,n The dimensions of the matrix.
+      @param[in] nnz The number of non-zero elements, for example from
+      `spar::reduce::symbolic()`.
+      
+      @return The new (unprotected) `dgCMatrix`.
+      
+      @allocs The return object is roughly of size:
+      `sizeof(int)*(2 + nnz + (n+1)) + sizeof(double)*nnz`.
      */
-    template <typename INDEX, typename SCALAR>
-    static inline SEXP spmat_to_s4(const spmat<INDEX, SCALAR> &s)
+    static inline SEXP alloc_s4(const int m, const int n, const int nnz)
     {
       SEXP s4_class, s4;
       SEXP s4_i, s4_p, s4_Dim, s4_Dimnames, s4_x, s4_factors;
       
-      const INDEX m = s.nrows();
-      const INDEX n = s.ncols();
-      const INDEX nnz = s.get_nnz();
-      const INDEX p_len = n+1;
-      
       PROTECT(s4_i = allocVector(INTSXP, nnz));
-      arraytools::copy(nnz, s.index_ptr(), INTEGER(s4_i));
-      
-      PROTECT(s4_p = allocVector(INTSXP, p_len));
-      arraytools::copy(p_len, s.col_ptr(), INTEGER(s4_p));
+      PROTECT(s4_p = allocVector(INTSXP, n+1));
       
       PROTECT(s4_Dim = allocVector(INTSXP, 2));
-      INTEGER(s4_Dim)[0] = (int) m;
-      INTEGER(s4_Dim)[1] = (int) n;
+      INTEGER(s4_Dim)[0] = m;
+      INTEGER(s4_Dim)[1] = n;
       
       PROTECT(s4_Dimnames = allocVector(VECSXP, 2));
       SET_VECTOR_ELT(s4_Dimnames, 0, R_NilValue);
       SET_VECTOR_ELT(s4_Dimnames, 1, R_NilValue);
       
       PROTECT(s4_x = allocVector(REALSXP, nnz));
-      arraytools::copy(nnz, s.data_ptr(), REAL(s4_x));
       
       PROTECT(s4_factors = allocVector(VECSXP, 0));
       
@@ -179,6 +199,82 @@ namespace spar
       UNPROTECT(8);
       return s4;
     }
+    
+    
+    
+    /**
+      @brief Convert an `spmat` object into a `dgCMatrix` sparse matrix.
+      
+      @param[in] s The input `spmat` object.
+      
+      @return The return sparse matrix.
+      
+      @allocs The return object is roughly of size:
+      `sizeof(int)*(2 + nnz + (n+1)) + sizeof(double)*nnz`.
+      
+      @except If a memory allocation fails, a `bad_alloc` exception will be
+      thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR>
+    static inline SEXP spmat_to_s4(const spmat<INDEX, SCALAR> &s)
+    {
+      const INDEX n = s.ncols();
+      const INDEX nnz = s.get_nnz();
+      const INDEX p_len = n+1;
+      
+      SEXP s4;
+      PROTECT(s4 = alloc_s4(s.nrows(), n, nnz));
+      
+      arraytools::copy(nnz, s.index_ptr(), INTEGER(internal::sexp::get_i_from_s4(s4)));
+      arraytools::copy(p_len, s.col_ptr(), INTEGER(internal::sexp::get_p_from_s4(s4)));
+      arraytools::copy(nnz, s.data_ptr(), REAL(internal::sexp::get_x_from_s4(s4)));
+      
+      UNPROTECT(1);
+      return s4;
+    }
+  }
+  
+  
+  
+  namespace writers
+  {
+    /**
+      @brief Write the reduced matrix directly into the slots of a `dgCMatrix`.
+      The matrix must already have exactly as many non-zero slots as the
+      result; allocate it with `spar::conv::alloc_s4()` after running
+      `spar::reduce::symbolic()`, then reduce with `spar::reduce::gather()`.
+     */
+    class s4_writer : public csc_writer<int, double>
+    {
+      public:
+        /**
+          @brief Constructor.
+          
+          @param[out] s4_ The output `dgCMatrix`. It must stay protected for
+          the lifetime of the writer.
+         */
+        s4_writer(SEXP s4_) : csc_writer<int, double>(
+          INTEGER(internal::sexp::get_p_from_s4(s4_)),
+          INTEGER(internal::sexp::get_i_from_s4(s4_)),
+          REAL(internal::sexp::get_x_from_s4(s4_)),
+          internal::sexp::get_nnz_from_s4(internal::sexp::get_i_from_s4(s4_))
+        ) {};
+        
+        /**
+          @except If the result does not fill the slots exactly, a
+          `runtime_error` exception will be thrown.
+         */
+        void finalize()
+        {
+          csc_writer<int, double>::finalize();
+          if (nnz != capacity)
+            throw std::runtime_error("reduced matrix does not match the dgCMatrix slot lengths");
+        }
+    };
   }
   
   
@@ -201,6 +297,22 @@ namespace spar
         spar::conv::s4col_to_spvec(j, x, s);
       }
       
+      template <typename INDEX, typename SCALAR>
+      static inline void col(const INDEX j, const SEXP x, spvec_view<INDEX, SCALAR> &s)
+      {
+        static_assert(std::is_same<INDEX, int>::value && std::is_same<SCALAR, double>::value,
+          "dgCMatrix columns can only be viewed with INDEX=int and SCALAR=double");
+        
+        SEXP s4_X = spar::internal::sexp::get_x_from_s4(x);
+        SEXP s4_I = spar::internal::sexp::get_i_from_s4(x);
+        SEXP s4_P = spar::internal::sexp::get_p_from_s4(x);
+        
+        const int start_ind = INTEGER(s4_P)[j];
+        const int col_len = INTEGER(s4_P)[j+1] - start_ind;
+        
+        s.set(col_len, INTEGER(s4_I) + start_ind, REAL(s4_X) + start_ind);
+      }
+      
       
       
       template <typename INDEX, typename SCALAR>
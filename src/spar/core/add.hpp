@@ -0,0 +1,214 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_ADD_H
+#define SPAR_CORE_ADD_H
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../arraytools/src/arraytools.hpp"
+#include "par.hpp"
+#include "spmat.hpp"
+
+
+namespace spar
+{
+  namespace internal
+  {
+    namespace add
+    {
+      // Merge column j of the K inputs, summing equal rows. The heap holds
+      // the current row of every input whose column is not used up yet. With
+      // null outputs, only count the distinct rows; otherwise write them,
+      // dropping the ones that summed to zero.
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline OFFSET merge_col(const INDEX j, const size_t K,
+        const spmat<INDEX, SCALAR, OFFSET> *const *x,
+        std::vector<std::pair<INDEX, size_t>> &heap, std::vector<OFFSET> &pos,
+        INDEX *I_out, SCALAR *X_out)
+      {
+        typedef std::greater<std::pair<INDEX, size_t>> cmp;
+        
+        heap.clear();
+        for (size_t k=0; k<K; k++)
+        {
+          const OFFSET *P = x[k]->col_ptr();
+          pos[k] = P[j];
+          if (P[j] < P[j + 1])
+            heap.push_back(std::make_pair(x[k]->index_ptr()[P[j]], k));
+        }
+        
+        std::make_heap(heap.begin(), heap.end(), cmp());
+        
+        OFFSET out = 0;
+        while (!heap.empty())
+        {
+          const INDEX row = heap.front().first;
+          SCALAR s = 0;
+          while (!heap.empty() && heap.front().first == row)
+          {
+            std::pop_heap(heap.begin(), heap.end(), cmp());
+            const size_t k = heap.back().second;
+            if (X_out)
+              s += x[k]->data_ptr()[pos[k]];
+            
+            pos[k]++;
+            if (pos[k] < x[k]->col_ptr()[j + 1])
+            {
+              heap.back().first = x[k]->index_ptr()[pos[k]];
+              std::push_heap(heap.begin(), heap.end(), cmp());
+            }
+            else
+              heap.pop_back();
+          }
+          
+          if (!X_out)
+            out++;
+          else if (s != (SCALAR) 0)
+          {
+            I_out[out] = row;
+            X_out[out] = s;
+            out++;
+          }
+        }
+        
+        return out;
+      }
+      
+      
+      
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline spmat<INDEX, SCALAR, OFFSET> sum(const size_t K,
+        const spmat<INDEX, SCALAR, OFFSET> *const *x)
+      {
+        if (K == 0)
+          return spmat<INDEX, SCALAR, OFFSET>();
+        
+        const INDEX m = x[0]->nrows();
+        const INDEX n = x[0]->ncols();
+        for (size_t k=1; k<K; k++)
+        {
+          if (x[k]->nrows() != m || x[k]->ncols() != n)
+            throw std::runtime_error("matrices must have the same dimensions");
+        }
+        
+        const uint64_t plen = (uint64_t) n + 1;
+        
+        // symbolic: the number of distinct rows of each column sizes the
+        // output exactly
+        std::vector<OFFSET> colptr(plen, 0);
+        #pragma omp parallel
+        {
+          std::vector<std::pair<INDEX, size_t>> heap;
+          std::vector<OFFSET> pos(K);
+          
+          #pragma omp for schedule(dynamic, 64)
+          for (INDEX j=0; j<n; j++)
+            colptr[j] = merge_col(j, K, x, heap, pos, (INDEX*) NULL, (SCALAR*) NULL);
+        }
+        
+        internal::par::exclusive_scan(plen, colptr.data());
+        
+        // numeric: every column writes its own slot
+        spmat<INDEX, SCALAR, OFFSET> ret(m, n, colptr[n]);
+        INDEX *I = ret.index_ptr();
+        SCALAR *X = ret.data_ptr();
+        std::vector<OFFSET> colnnz(plen, 0);
+        #pragma omp parallel
+        {
+          std::vector<std::pair<INDEX, size_t>> heap;
+          std::vector<OFFSET> pos(K);
+          
+          #pragma omp for schedule(dynamic, 64)
+          for (INDEX j=0; j<n; j++)
+            colnnz[j] = merge_col(j, K, x, heap, pos, I + colptr[j], X + colptr[j]);
+        }
+        
+        internal::par::exclusive_scan(plen, colnnz.data());
+        
+        // squeeze out the entries that cancelled; every column moves down
+        if (colnnz[n] < colptr[n])
+        {
+          for (INDEX j=0; j<n; j++)
+          {
+            for (OFFSET t=0; t<colnnz[j + 1]-colnnz[j]; t++)
+            {
+              I[colnnz[j] + t] = I[colptr[j] + t];
+              X[colnnz[j] + t] = X[colptr[j] + t];
+            }
+          }
+          
+          arraytools::zero(colptr[n] - colnnz[n], I + colnnz[n]);
+          arraytools::zero(colptr[n] - colnnz[n], X + colnnz[n]);
+        }
+        
+        arraytools::copy(plen, colnnz.data(), ret.col_ptr());
+        ret.update_nnz(colnnz[n]);
+        
+        return ret;
+      }
+    }
+  }
+  
+  
+  
+  /**
+    @brief Sum of sparse matrices of the same dimensions, for example the
+    partial results of several threads, before they are reduced across ranks
+    as a single matrix.
+    
+    @details The columns are processed in parallel with OpenMP. A first pass
+    counts the distinct rows of every column, so the result is allocated
+    exactly once; a second pass merges the columns of all inputs into it.
+    Entries which sum to zero are dropped, as are explicit zeros, even when
+    there is only one input.
+    
+    @param[in] x The inputs.
+    
+    @return The sum. If `x` is empty, an empty matrix.
+    
+    @allocs The return matrix and some workspace of the size of its column
+    pointers.
+    
+    @except If the dimensions differ, a `runtime_error` exception will be
+    thrown. If a memory allocation fails, a `bad_alloc` exception will be
+    thrown.
+   */
+  template <typename INDEX, typename SCALAR, typename OFFSET>
+  static inline spmat<INDEX, SCALAR, OFFSET> add(const std::vector<spmat<INDEX, SCALAR, OFFSET>> &x)
+  {
+    std::vector<const spmat<INDEX, SCALAR, OFFSET>*> ptrs(x.size());
+    for (size_t k=0; k<x.size(); k++)
+      ptrs[k] = &x[k];
+    
+    return internal::add::sum(ptrs.size(), ptrs.data());
+  }
+  
+  
+  
+  /**
+    @brief Sum of two sparse matrices. See `spar::add()`.
+    
+    @except If the dimensions differ, a `runtime_error` exception will be
+    thrown. If a memory allocation fails, a `bad_alloc` exception will be
+    thrown.
+   */
+  template <typename INDEX, typename SCALAR, typename OFFSET>
+  static inline spmat<INDEX, SCALAR, OFFSET> operator+(const spmat<INDEX, SCALAR, OFFSET> &a,
+    const spmat<INDEX, SCALAR, OFFSET> &b)
+  {
+    const spmat<INDEX, SCALAR, OFFSET> *ptrs[2] = {&a, &b};
+    return internal::add::sum(2, ptrs);
+  }
+}
+
+
+#endif
@@ -7,6 +7,9 @@
 #pragma once
 
 
+#include <type_traits>
+
+
 namespace spar
 {
   namespace internal
@@ -15,6 +18,29 @@ namespace spar
     {
       const static float MEM_FUDGE_ELT_FAC = 1.675;
     }
+    
+    
+    
+    // absolute value, without comparing unsigned types to 0
+    template <typename SCALAR>
+    static inline SCALAR magnitude(const SCALAR x, std::true_type is_unsigned)
+    {
+      (void) is_unsigned;
+      return x;
+    }
+    
+    template <typename SCALAR>
+    static inline SCALAR magnitude(const SCALAR x, std::false_type is_unsigned)
+    {
+      (void) is_unsigned;
+      return x < 0 ? -x : x;
+    }
+    
+    template <typename SCALAR>
+    static inline SCALAR magnitude(const SCALAR x)
+    {
+      return magnitude(x, std::is_unsigned<SCALAR>());
+    }
   }
 }
 
@@ -10,6 +10,7 @@
 #include <iostream>
 
 #include "../arraytools/src/arraytools.hpp"
+#include "simd.hpp"
 
 
 namespace spar
@@ -180,12 +181,7 @@ void spar::dvec<INDEX, SCALAR>::insert(const INDEX i, const SCALAR s)
 template <typename INDEX, typename SCALAR>
 void spar::dvec<INDEX, SCALAR>::update_nnz()
 {
-  nnz = 0;
-  for (INDEX i=0; i<len; i++)
-  {
-    if (X[i])
-      nnz++;
-  }
+  nnz = (INDEX) internal::simd::count_nonzero(len, X);
 }
 
 
@@ -287,14 +283,14 @@ template <typename INDEX_SRC, typename SCALAR_SRC>
 void spar::dvec<INDEX, SCALAR>::set(const INDEX_SRC nnz_, const INDEX_SRC *I_, const SCALAR_SRC *X_)
 {
   zero();
+  if (nnz_ == 0)
+    return;
   
   INDEX_SRC top = I_[nnz_-1];
-  if (top > len)
+  if (top >= len)
     resize(top + 1);
   
-  for (INDEX_SRC i=0; i<nnz_; i++)
-    X[I_[i]] = X_[i];
-  
+  internal::simd::scatter(nnz_, I_, X_, X);
   nnz = nnz_;
 }
 
@@ -0,0 +1,22 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_FWD_H
+#define SPAR_CORE_FWD_H
+#pragma once
+
+
+// The matrix classes have a defaulted template parameter, which may only be
+// given once, so every file forward-declares them by including this header.
+namespace spar
+{
+  template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+  class spmat;
+  
+  template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+  class spmat_view;
+}
+
+
+#endif
@@ -7,20 +7,65 @@
 #pragma once
 
 
+#include "fwd.hpp"
+
+
 namespace spar
 {
   template <typename INDEX, typename SCALAR>
   class spvec;
 
   template <typename INDEX, typename SCALAR>
-  class spmat;
+  class spvec_view;
   
   namespace internal
   {
     namespace get
     {
-      template <typename INDEX, typename SCALAR>
-      static inline void dim(const spmat<INDEX, SCALAR> &x, INDEX *m, INDEX *n)
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline void dim(const spmat<INDEX, SCALAR, OFFSET> &x, INDEX *m, INDEX *n)
+      {
+        *m = x.nrows();
+        *n = x.ncols();
+      }
+      
+      
+      
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline void col(const INDEX j, const spmat<INDEX, SCALAR, OFFSET> &x, spvec<INDEX, SCALAR> &s)
+      {
+        x.get_col(j, s);
+      }
+      
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline void col(const INDEX j, const spmat<INDEX, SCALAR, OFFSET> &x, spvec_view<INDEX, SCALAR> &s)
+      {
+        x.get_col(j, s);
+      }
+      
+      
+      
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline INDEX max_col_nnz(const spmat<INDEX, SCALAR, OFFSET> &x)
+      {
+        INDEX max_nnz = 0;
+        
+        const OFFSET *P = x.col_ptr();
+        const INDEX n = x.ncols();
+        for (INDEX col=0; col<n; col++)
+        {
+          INDEX col_nnz = (INDEX) (P[col + 1] - P[col]);
+          if (col_nnz > max_nnz)
+            max_nnz = col_nnz;
+        }
+        
+        return max_nnz;
+      }
+      
+      
+      
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline void dim(const spmat_view<INDEX, SCALAR, OFFSET> &x, INDEX *m, INDEX *n)
       {
         *m = x.nrows();
         *n = x.ncols();
@@ -28,24 +73,38 @@ namespace spar
       
       
       
-      template <typename INDEX, typename SCALAR>
-      static inline void col(const INDEX j, const spmat<INDEX, SCALAR> &x, spvec<INDEX, SCALAR> &s)
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline void col(const INDEX j, const spmat_view<INDEX, SCALAR, OFFSET> &x, spvec<INDEX, SCALAR> &s)
+      {
+        const OFFSET *P = x.col_ptr();
+        const OFFSET ind = P[j];
+        if (P[j + 1] == ind)
+        {
+          s.zero();
+          return;
+        }
+        
+        s.set((INDEX) (P[j + 1] - ind), x.index_ptr() + ind, x.data_ptr() + ind);
+      }
+      
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline void col(const INDEX j, const spmat_view<INDEX, SCALAR, OFFSET> &x, spvec_view<INDEX, SCALAR> &s)
       {
         x.get_col(j, s);
       }
       
       
       
-      template <typename INDEX, typename SCALAR>
-      static inline INDEX max_col_nnz(const spmat<INDEX, SCALAR> &x)
+      template <typename INDEX, typename SCALAR, typename OFFSET>
+      static inline INDEX max_col_nnz(const spmat_view<INDEX, SCALAR, OFFSET> &x)
       {
         INDEX max_nnz = 0;
         
-        const INDEX *P = x.col_ptr();
+        const OFFSET *P = x.col_ptr();
         const INDEX n = x.ncols();
         for (INDEX col=0; col<n; col++)
         {
-          INDEX col_nnz = P[col + 1] - P[col];
+          INDEX col_nnz = (INDEX) (P[col + 1] - P[col]);
           if (col_nnz > max_nnz)
             max_nnz = col_nnz;
         }
@@ -0,0 +1,73 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_PAR_H
+#define SPAR_CORE_PAR_H
+#pragma once
+
+
+#include <cstdint>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+namespace spar
+{
+  namespace internal
+  {
+    namespace par
+    {
+      static inline int num_threads()
+      {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+      }
+      
+      
+      
+      // in-place exclusive prefix sum of x[0:len]; the threads scan their own
+      // blocks, then shift them by the sum of all earlier blocks
+      template <typename T>
+      static inline void exclusive_scan(const uint64_t len, T *x)
+      {
+        const int nblocks = num_threads();
+        std::vector<T> block_sum(nblocks + 1, 0);
+        
+        #pragma omp parallel for schedule(static, 1)
+        for (int b=0; b<nblocks; b++)
+        {
+          T s = 0;
+          for (uint64_t i=len*b/nblocks; i<len*(b+1)/nblocks; i++)
+            s += x[i];
+          
+          block_sum[b + 1] = s;
+        }
+        
+        for (int b=0; b<nblocks; b++)
+          block_sum[b + 1] += block_sum[b];
+        
+        #pragma omp parallel for schedule(static, 1)
+        for (int b=0; b<nblocks; b++)
+        {
+          T s = block_sum[b];
+          for (uint64_t i=len*b/nblocks; i<len*(b+1)/nblocks; i++)
+          {
+            const T tmp = x[i];
+            x[i] = s;
+            s += tmp;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+#endif
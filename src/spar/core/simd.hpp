@@ -0,0 +1,403 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_SIMD_H
+#define SPAR_CORE_SIMD_H
+#pragma once
+
+
+#include <cstdint>
+
+// Vectorized kernels are compiled with per-function target attributes, so
+// no -mavx flags are needed, and picked at run time. Define SPAR_NO_SIMD to
+// always use the scalar code.
+#if !defined(SPAR_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPAR_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace spar
+{
+  namespace internal
+  {
+    /**
+      @brief Kernels converting between dense and sparse vectors. Each takes
+      plain arrays, so the dense vector, sparse vector and accumulator classes
+      and the reducers can share them. `float` and `double` data use AVX2 or
+      AVX-512 when the CPU has them; everything else uses the scalar code.
+     */
+    namespace simd
+    {
+      static const int LEVEL_SCALAR = 0;
+      static const int LEVEL_AVX2 = 1;
+      static const int LEVEL_AVX512 = 2;
+      
+      static inline int detect_level()
+      {
+#ifdef SPAR_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+          return LEVEL_AVX512;
+        else if (__builtin_cpu_supports("avx2"))
+          return LEVEL_AVX2;
+#endif
+        return LEVEL_SCALAR;
+      }
+      
+      // the best instruction set of this CPU, detected once
+      static inline int level()
+      {
+        static const int l = detect_level();
+        return l;
+      }
+      
+      
+      
+      // ----------------------------------------------------------------------
+      // scalar
+      // ----------------------------------------------------------------------
+      
+      template <typename SCALAR>
+      static inline uint64_t count_nonzero_scalar(const uint64_t len, const SCALAR *x)
+      {
+        uint64_t nnz = 0;
+        for (uint64_t i=0; i<len; i++)
+          nnz += (x[i] != (SCALAR) 0);
+        
+        return nnz;
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      static inline INDEX find_nonzero_scalar(const INDEX len, const SCALAR *x, INDEX *I)
+      {
+        INDEX k = 0;
+        for (INDEX i=0; i<len; i++)
+        {
+          if (x[i] != (SCALAR) 0)
+            I[k++] = i;
+        }
+        
+        return k;
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      static inline INDEX sparsify_scalar(const INDEX len, const SCALAR *x, INDEX *I, SCALAR *X)
+      {
+        INDEX k = 0;
+        for (INDEX i=0; i<len; i++)
+        {
+          if (x[i] != (SCALAR) 0)
+          {
+            I[k] = i;
+            X[k] = x[i];
+            k++;
+          }
+        }
+        
+        return k;
+      }
+      
+      
+      
+#ifdef SPAR_SIMD_X86
+      // ----------------------------------------------------------------------
+      // AVX2: compare to zero, movemask, and walk the set bits
+      // ----------------------------------------------------------------------
+      
+      __attribute__((target("avx2")))
+      static inline uint32_t nz_mask_avx2(const double *x)
+      {
+        const __m256d v = _mm256_loadu_pd(x);
+        return _mm256_movemask_pd(_mm256_cmp_pd(v, _mm256_setzero_pd(), _CMP_NEQ_UQ));
+      }
+      
+      __attribute__((target("avx2")))
+      static inline uint32_t nz_mask_avx2(const float *x)
+      {
+        const __m256 v = _mm256_loadu_ps(x);
+        return _mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_NEQ_UQ));
+      }
+      
+      template <typename SCALAR>
+      __attribute__((target("avx2,popcnt")))
+      static inline uint64_t count_nonzero_avx2(const uint64_t len, const SCALAR *x)
+      {
+        const uint64_t w = 32 / sizeof(SCALAR);
+        uint64_t nnz = 0;
+        uint64_t i = 0;
+        for (; i+w<=len; i+=w)
+          nnz += __builtin_popcount(nz_mask_avx2(x + i));
+        
+        return nnz + count_nonzero_scalar(len - i, x + i);
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      __attribute__((target("avx2")))
+      static inline INDEX find_nonzero_avx2(const INDEX len, const SCALAR *x, INDEX *I)
+      {
+        const uint64_t w = 32 / sizeof(SCALAR);
+        uint64_t k = 0;
+        uint64_t i = 0;
+        for (; i+w<=(uint64_t) len; i+=w)
+        {
+          for (uint32_t mask=nz_mask_avx2(x + i); mask; mask&=mask-1)
+            I[k++] = (INDEX) (i + __builtin_ctz(mask));
+        }
+        
+        for (; i<(uint64_t) len; i++)
+        {
+          if (x[i] != (SCALAR) 0)
+            I[k++] = (INDEX) i;
+        }
+        
+        return (INDEX) k;
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      __attribute__((target("avx2")))
+      static inline INDEX sparsify_avx2(const INDEX len, const SCALAR *x, INDEX *I, SCALAR *X)
+      {
+        const uint64_t w = 32 / sizeof(SCALAR);
+        uint64_t k = 0;
+        uint64_t i = 0;
+        for (; i+w<=(uint64_t) len; i+=w)
+        {
+          for (uint32_t mask=nz_mask_avx2(x + i); mask; mask&=mask-1)
+          {
+            const uint64_t j = i + __builtin_ctz(mask);
+            I[k] = (INDEX) j;
+            X[k] = x[j];
+            k++;
+          }
+        }
+        
+        for (; i<(uint64_t) len; i++)
+        {
+          if (x[i] != (SCALAR) 0)
+          {
+            I[k] = (INDEX) i;
+            X[k] = x[i];
+            k++;
+          }
+        }
+        
+        return (INDEX) k;
+      }
+      
+      
+      
+      // ----------------------------------------------------------------------
+      // AVX-512: compare into a mask register, compress-store the values
+      // ----------------------------------------------------------------------
+      
+      __attribute__((target("avx512f")))
+      static inline uint32_t nz_mask_avx512(const double *x)
+      {
+        return _mm512_cmp_pd_mask(_mm512_loadu_pd(x), _mm512_setzero_pd(), _CMP_NEQ_UQ);
+      }
+      
+      __attribute__((target("avx512f")))
+      static inline uint32_t nz_mask_avx512(const float *x)
+      {
+        return _mm512_cmp_ps_mask(_mm512_loadu_ps(x), _mm512_setzero_ps(), _CMP_NEQ_UQ);
+      }
+      
+      __attribute__((target("avx512f")))
+      static inline void compress_avx512(double *dst, const uint32_t mask, const double *src)
+      {
+        _mm512_mask_compressstoreu_pd(dst, (__mmask8) mask, _mm512_loadu_pd(src));
+      }
+      
+      __attribute__((target("avx512f")))
+      static inline void compress_avx512(float *dst, const uint32_t mask, const float *src)
+      {
+        _mm512_mask_compressstoreu_ps(dst, (__mmask16) mask, _mm512_loadu_ps(src));
+      }
+      
+      template <typename SCALAR>
+      __attribute__((target("avx512f,popcnt")))
+      static inline uint64_t count_nonzero_avx512(const uint64_t len, const SCALAR *x)
+      {
+        const uint64_t w = 64 / sizeof(SCALAR);
+        uint64_t nnz = 0;
+        uint64_t i = 0;
+        for (; i+w<=len; i+=w)
+          nnz += __builtin_popcount(nz_mask_avx512(x + i));
+        
+        return nnz + count_nonzero_scalar(len - i, x + i);
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      __attribute__((target("avx512f")))
+      static inline INDEX find_nonzero_avx512(const INDEX len, const SCALAR *x, INDEX *I)
+      {
+        const uint64_t w = 64 / sizeof(SCALAR);
+        uint64_t k = 0;
+        uint64_t i = 0;
+        for (; i+w<=(uint64_t) len; i+=w)
+        {
+          for (uint32_t mask=nz_mask_avx512(x + i); mask; mask&=mask-1)
+            I[k++] = (INDEX) (i + __builtin_ctz(mask));
+        }
+        
+        for (; i<(uint64_t) len; i++)
+        {
+          if (x[i] != (SCALAR) 0)
+            I[k++] = (INDEX) i;
+        }
+        
+        return (INDEX) k;
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      __attribute__((target("avx512f,popcnt")))
+      static inline INDEX sparsify_avx512(const INDEX len, const SCALAR *x, INDEX *I, SCALAR *X)
+      {
+        const uint64_t w = 64 / sizeof(SCALAR);
+        uint64_t k = 0;
+        uint64_t i = 0;
+        for (; i+w<=(uint64_t) len; i+=w)
+        {
+          const uint32_t mask = nz_mask_avx512(x + i);
+          if (!mask)
+            continue;
+          
+          compress_avx512(X + k, mask, x + i);
+          for (uint32_t m=mask; m; m&=m-1)
+            I[k++] = (INDEX) (i + __builtin_ctz(m));
+        }
+        
+        for (; i<(uint64_t) len; i++)
+        {
+          if (x[i] != (SCALAR) 0)
+          {
+            I[k] = (INDEX) i;
+            X[k] = x[i];
+            k++;
+          }
+        }
+        
+        return (INDEX) k;
+      }
+      
+      
+      
+      template <typename SCALAR>
+      static inline uint64_t count_nonzero_dispatch(const uint64_t len, const SCALAR *x)
+      {
+        const int l = level();
+        if (l == LEVEL_AVX512)
+          return count_nonzero_avx512(len, x);
+        else if (l == LEVEL_AVX2)
+          return count_nonzero_avx2(len, x);
+        else
+          return count_nonzero_scalar(len, x);
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      static inline INDEX find_nonzero_dispatch(const INDEX len, const SCALAR *x, INDEX *I)
+      {
+        const int l = level();
+        if (l == LEVEL_AVX512)
+          return find_nonzero_avx512(len, x, I);
+        else if (l == LEVEL_AVX2)
+          return find_nonzero_avx2(len, x, I);
+        else
+          return find_nonzero_scalar(len, x, I);
+      }
+      
+      template <typename INDEX, typename SCALAR>
+      static inline INDEX sparsify_dispatch(const INDEX len, const SCALAR *x, INDEX *I, SCALAR *X)
+      {
+        const int l = level();
+        if (l == LEVEL_AVX512)
+          return sparsify_avx512(len, x, I, X);
+        else if (l == LEVEL_AVX2)
+          return sparsify_avx2(len, x, I, X);
+        else
+          return sparsify_scalar(len, x, I, X);
+      }
+#endif
+      
+      
+      
+      // ----------------------------------------------------------------------
+      // public kernels
+      // ----------------------------------------------------------------------
+      
+      /// Number of non-zero elements of `x[0:len]`.
+      template <typename SCALAR>
+      static inline uint64_t count_nonzero(const uint64_t len, const SCALAR *x)
+      {
+        return count_nonzero_scalar(len, x);
+      }
+      
+      /// Write the indices of the non-zero elements of `x[0:len]`, in order, to
+      /// `I`, and return how many there are.
+      template <typename INDEX, typename SCALAR>
+      static inline INDEX find_nonzero(const INDEX len, const SCALAR *x, INDEX *I)
+      {
+        return find_nonzero_scalar(len, x, I);
+      }
+      
+      /// Write the non-zero elements of `x[0:len]`, in order, to `I` (indices)
+      /// and `X` (values), and return how many there are. `X` may be `x`.
+      template <typename INDEX, typename SCALAR>
+      static inline INDEX sparsify(const INDEX len, const SCALAR *x, INDEX *I, SCALAR *X)
+      {
+        return sparsify_scalar(len, x, I, X);
+      }
+      
+#ifdef SPAR_SIMD_X86
+      static inline uint64_t count_nonzero(const uint64_t len, const double *x)
+      {
+        return count_nonzero_dispatch(len, x);
+      }
+      
+      static inline uint64_t count_nonzero(const uint64_t len, const float *x)
+      {
+        return count_nonzero_dispatch(len, x);
+      }
+      
+      template <typename INDEX>
+      static inline INDEX find_nonzero(const INDEX len, const double *x, INDEX *I)
+      {
+        return find_nonzero_dispatch(len, x, I);
+      }
+      
+      template <typename INDEX>
+      static inline INDEX find_nonzero(const INDEX len, const float *x, INDEX *I)
+      {
+        return find_nonzero_dispatch(len, x, I);
+      }
+      
+      template <typename INDEX>
+      static inline INDEX sparsify(const INDEX len, const double *x, INDEX *I, double *X)
+      {
+        return sparsify_dispatch(len, x, I, X);
+      }
+      
+      template <typename INDEX>
+      static inline INDEX sparsify(const INDEX len, const float *x, INDEX *I, float *X)
+      {
+        return sparsify_dispatch(len, x, I, X);
+      }
+#endif
+      
+      /// Store `X[k]` at `d[I[k]]` for every `k`, without any branches. The
+      /// entries of `d` not in `I` are left alone.
+      template <typename INDEX_SRC, typename SCALAR_SRC, typename SCALAR>
+      static inline void scatter(const uint64_t nnz, const INDEX_SRC *I,
+        const SCALAR_SRC *X, SCALAR *d)
+      {
+        for (uint64_t k=0; k<nnz; k++)
+          d[I[k]] = (SCALAR) X[k];
+      }
+    }
+  }
+}
+
+
+#endif
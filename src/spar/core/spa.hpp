@@ -0,0 +1,333 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_SPA_H
+#define SPAR_CORE_SPA_H
+#pragma once
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include "../arraytools/src/arraytools.hpp"
+#include "simd.hpp"
+
+
+namespace spar
+{
+  template <typename INDEX, typename SCALAR>
+  class spvec_view;
+  
+  /**
+    @brief Sparse accumulator: a dense vector which remembers which of its
+    entries were touched. Resetting it and extracting its non-zeros then cost
+    time proportional to the number of touched entries rather than to the
+    length of the vector.
+    
+    @tparam INDEX should be some kind of fundamental indexing type, like `int`
+    or `uint16_t`.
+    @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+   */
+  template <typename INDEX, typename SCALAR>
+  class spa
+  {
+    public:
+      spa();
+      spa(INDEX len_);
+      ~spa();
+      
+      void resize(INDEX len_);
+      void zero();
+      void add(const INDEX i, const SCALAR s);
+      void add(const spvec_view<INDEX, SCALAR> &x);
+      void rescan();
+      INDEX extract(INDEX *I_out, SCALAR *X_out);
+      
+      /// Value at index `i`.
+      SCALAR get(const INDEX i) const {return X[i];};
+      /// Number of touched elements. Some may have summed to zero.
+      INDEX get_nnz() const {return nnz;};
+      /// Length of the vector.
+      INDEX get_len() const {return len;};
+      /// Return a pointer to the dense data array `X`. Call `rescan()` after
+      /// modifying it directly.
+      SCALAR* data_ptr() {return X;};
+      /// \overload
+      const SCALAR* data_ptr() const {return X;};
+    
+    protected:
+      /// Number of touched elements.
+      INDEX nnz;
+      /// Vector length.
+      INDEX len;
+      /// Dense data array.
+      SCALAR *X;
+      /// Touched flag of each element.
+      uint8_t *mark;
+      /// Touched indices, in order of first touch unless `sorted`.
+      INDEX *touched;
+      /// Whether `touched` is in increasing order.
+      bool sorted;
+    
+    private:
+      void sort_touched();
+      void cleanup();
+  };
+}
+
+
+
+// ----------------------------------------------------------------------------
+// constructor/destructor
+// ----------------------------------------------------------------------------
+
+template <typename INDEX, typename SCALAR>
+spar::spa<INDEX, SCALAR>::spa()
+{
+  X = NULL;
+  mark = NULL;
+  touched = NULL;
+  
+  nnz = 0;
+  len = 0;
+  sorted = true;
+}
+
+
+
+/**
+  @brief Constructor.
+  
+  @param[in] len_ Length of the vector (elements, not bytes).
+  
+  @allocs Three internal arrays are allocated: the data, the touched flags,
+  and the touched indices.
+  
+  @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR>
+spar::spa<INDEX, SCALAR>::spa(INDEX len_)
+{
+  arraytools::zero_alloc(len_, &X);
+  arraytools::zero_alloc(len_, &mark);
+  arraytools::alloc(len_, &touched);
+  arraytools::check_allocs(X, mark, touched);
+  
+  nnz = 0;
+  len = len_;
+  sorted = true;
+}
+
+
+
+template <typename INDEX, typename SCALAR>
+spar::spa<INDEX, SCALAR>::~spa()
+{
+  cleanup();
+}
+
+
+
+// ----------------------------------------------------------------------------
+// object management
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Resize the internal storage. The accumulator is zeroed.
+  
+  @param[in] len_ The new length (elements, not bytes).
+  
+  @allocs The internal arrays will resize themselves as needed.
+  
+  @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR>
+void spar::spa<INDEX, SCALAR>::resize(INDEX len_)
+{
+  zero();
+  if (len == len_)
+    return;
+  
+  arraytools::realloc(len_, &X);
+  arraytools::realloc(len_, &mark);
+  arraytools::realloc(len_, &touched);
+  arraytools::check_allocs(X, mark, touched);
+  
+  if (len_ > len)
+  {
+    arraytools::zero(len_-len, X+len);
+    arraytools::zero(len_-len, mark+len);
+  }
+  
+  len = len_;
+}
+
+
+
+/// Zero the touched elements. Performs no allocations or resizing.
+template <typename INDEX, typename SCALAR>
+void spar::spa<INDEX, SCALAR>::zero()
+{
+  for (INDEX t=0; t<nnz; t++)
+  {
+    const INDEX i = touched[t];
+    X[i] = 0;
+    mark[i] = 0;
+  }
+  
+  nnz = 0;
+  sorted = true;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// accumulation
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Add a value to the specified index.
+  
+  @param[in] i The index.
+  @param[in] s The input value.
+ */
+template <typename INDEX, typename SCALAR>
+void spar::spa<INDEX, SCALAR>::add(const INDEX i, const SCALAR s)
+{
+  if (!mark[i])
+  {
+    mark[i] = 1;
+    if (nnz > 0 && touched[nnz-1] > i)
+      sorted = false;
+    
+    touched[nnz++] = i;
+  }
+  
+  X[i] += s;
+}
+
+
+
+/**
+  @brief Add a sparse vector.
+  
+  @param[in] x The input, with increasing indices.
+  
+  @except If the sparse vector has indices past the end of the accumulator, a
+  `logic_error` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR>
+void spar::spa<INDEX, SCALAR>::add(const spvec_view<INDEX, SCALAR> &x)
+{
+  const INDEX x_nnz = x.get_nnz();
+  const INDEX *I = x.index_ptr();
+  const SCALAR *X_in = x.data_ptr();
+  
+  if (x_nnz && I[x_nnz-1] >= len)
+    throw std::logic_error("accumulator not large enough to store sparse vector");
+  
+  for (INDEX k=0; k<x_nnz; k++)
+    add(I[k], X_in[k]);
+}
+
+
+
+/**
+  @brief Rebuild the touched list from the non-zeros of the data array, for
+  example after an MPI reduction wrote into `data_ptr()`. This is the one
+  operation which scans the whole vector; afterwards the touched list is
+  sorted.
+ */
+template <typename INDEX, typename SCALAR>
+void spar::spa<INDEX, SCALAR>::rescan()
+{
+  for (INDEX t=0; t<nnz; t++)
+    mark[touched[t]] = 0;
+  
+  nnz = internal::simd::find_nonzero(len, X, touched);
+  for (INDEX t=0; t<nnz; t++)
+    mark[touched[t]] = 1;
+  
+  sorted = true;
+}
+
+
+
+/**
+  @brief Copy the non-zero elements out, in increasing index order.
+  Touched elements which summed to zero are skipped.
+  
+  @param[out] I_out,X_out Index and data arrays. Each must hold `get_nnz()`
+  elements.
+  
+  @return The number of elements written.
+ */
+template <typename INDEX, typename SCALAR>
+INDEX spar::spa<INDEX, SCALAR>::extract(INDEX *I_out, SCALAR *X_out)
+{
+  sort_touched();
+  
+  INDEX k = 0;
+  for (INDEX t=0; t<nnz; t++)
+  {
+    const INDEX i = touched[t];
+    if (X[i] != (SCALAR) 0)
+    {
+      I_out[k] = i;
+      X_out[k] = X[i];
+      k++;
+    }
+  }
+  
+  return k;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// internals
+// ----------------------------------------------------------------------------
+
+// sort the touched list, or rebuild it from the flags if that's cheaper
+template <typename INDEX, typename SCALAR>
+void spar::spa<INDEX, SCALAR>::sort_touched()
+{
+  if (sorted)
+    return;
+  
+  if ((double) nnz * std::log2((double) nnz) < (double) len)
+    std::sort(touched, touched + nnz);
+  else
+  {
+    INDEX t = 0;
+    for (INDEX i=0; i<len; i++)
+    {
+      if (mark[i])
+        touched[t++] = i;
+    }
+  }
+  
+  sorted = true;
+}
+
+
+
+template <typename INDEX, typename SCALAR>
+void spar::spa<INDEX, SCALAR>::cleanup()
+{
+  arraytools::free(X);
+  X = NULL;
+  arraytools::free(mark);
+  mark = NULL;
+  arraytools::free(touched);
+  touched = NULL;
+  
+  nnz = 0;
+  len = 0;
+}
+
+
+#endif
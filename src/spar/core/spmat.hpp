@@ -7,10 +7,17 @@
 #pragma once
 
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include "../arraytools/src/arraytools.hpp"
 #include "defs.hpp"
+#include "fwd.hpp"
+#include "par.hpp"
 
 
 namespace spar
@@ -18,29 +25,43 @@ namespace spar
   template <typename INDEX, typename SCALAR>
   class spvec;
   
+  template <typename INDEX, typename SCALAR>
+  class spvec_view;
+  
   /**
     @brief Basic sparse matrix class in CSC format.
     
     @tparam INDEX should be some kind of fundamental indexing type, like `int`
     or `uint16_t`.
     @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+    @tparam OFFSET is the type of the column pointers and of the number of
+    non-zeros, `INDEX` by default. A wider type, like `int64_t` with 16 or 32
+    bit `INDEX`, lifts the limit on the total number of non-zeros without
+    widening the row indices.
    */
-  template <typename INDEX, typename SCALAR>
+  template <typename INDEX, typename SCALAR, typename OFFSET>
   class spmat
   {
     public:
       spmat();
-      spmat(INDEX nrows_, INDEX ncols_, INDEX len_);
-      spmat(const spmat<INDEX, SCALAR> &x);
-      spmat& operator=(const spmat<INDEX, SCALAR>& x);
+      spmat(INDEX nrows_, INDEX ncols_, OFFSET len_);
+      spmat(const spmat<INDEX, SCALAR, OFFSET> &x);
+      spmat& operator=(const spmat<INDEX, SCALAR, OFFSET>& x);
       ~spmat();
       
-      void resize(INDEX len_);
+      static spmat<INDEX, SCALAR, OFFSET> from_triplets(const INDEX nrows_,
+        const INDEX ncols_, const OFFSET count, const INDEX *rows,
+        const INDEX *cols, const SCALAR *vals);
+      
+      void resize(OFFSET len_);
       void zero();
-      INDEX insertable(const spvec<INDEX, SCALAR> &x);
+      OFFSET insertable(const spvec<INDEX, SCALAR> &x);
       void insert(const INDEX col, const spvec<INDEX, SCALAR> &x);
+      void insert(const INDEX col, const spvec_view<INDEX, SCALAR> &x);
       void update_nnz();
+      void update_nnz(const OFFSET nnz_);
       void get_col(const INDEX col, spvec<INDEX, SCALAR> &x) const;
+      void get_col(const INDEX col, spvec_view<INDEX, SCALAR> &x) const;
       
       void print(bool actual=false);
       void info() const;
@@ -53,17 +74,17 @@ namespace spar
       /// Number of columns.
       INDEX ncols() const {return n;};
       /// Number of non-zero elements.
-      INDEX get_nnz() const {return nnz;};
+      OFFSET get_nnz() const {return nnz;};
       /// Length of the index and data arrays.
-      INDEX get_len() const {return len;};
+      OFFSET get_len() const {return len;};
       /// Return a pointer to the index array `I`.
       INDEX* index_ptr() {return I;};
       /// \overload
       INDEX* index_ptr() const {return I;};
       /// Return a pointer to the column array `P`.
-      INDEX* col_ptr() {return P;};
+      OFFSET* col_ptr() {return P;};
       /// \overload
-      INDEX* col_ptr() const {return P;};
+      OFFSET* col_ptr() const {return P;};
       /// Return a pointer to the data array `X`.
       SCALAR* data_ptr() {return X;};
       /// \overload
@@ -75,22 +96,23 @@ namespace spar
       /// Number of cols.
       INDEX n;
       /// Number non-zero.
-      INDEX nnz;
+      OFFSET nnz;
       /// Length of internal row/data arrays.
-      INDEX len;
+      OFFSET len;
       /// Length of column array (n+1).
       INDEX plen;
       /// Index array.
       INDEX *I;
       /// Column pointer array.
-      INDEX *P;
+      OFFSET *P;
       /// Data array.
       SCALAR *X;
     
     private:
       void cleanup();
+      void grow(const OFFSET min_len);
       INDEX* csc2coo();
-      void insert_spvec(const INDEX col, const spvec<INDEX, SCALAR> &x);
+      void insert_col(const INDEX col, const INDEX xnnz, const INDEX *xI, const SCALAR *xX);
   };
 }
 
@@ -103,8 +125,8 @@ namespace spar
 /**
   @brief Constructor.
  */
-template <typename INDEX, typename SCALAR>
-spar::spmat<INDEX, SCALAR>::spmat()
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET>::spmat()
 {
   I = NULL;
   P = NULL;
@@ -131,8 +153,8 @@ spar::spmat<INDEX, SCALAR>::spmat()
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
-template <typename INDEX, typename SCALAR>
-spar::spmat<INDEX, SCALAR>::spmat(INDEX nrows_, INDEX ncols_, INDEX len_)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET>::spmat(INDEX nrows_, INDEX ncols_, OFFSET len_)
 {
   arraytools::zero_alloc(len_, &I);
   arraytools::zero_alloc(ncols_+1, &P);
@@ -159,9 +181,16 @@ spar::spmat<INDEX, SCALAR>::spmat(INDEX nrows_, INDEX ncols_, INDEX len_)
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
-template <typename INDEX, typename SCALAR>
-spar::spmat<INDEX, SCALAR>::spmat(const spar::spmat<INDEX, SCALAR> &x)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET>::spmat(const spar::spmat<INDEX, SCALAR, OFFSET> &x)
 {
+  I = NULL;
+  P = NULL;
+  X = NULL;
+  
+  nnz = 0;
+  len = 0;
+  
   *this = x;
 }
 
@@ -176,8 +205,8 @@ spar::spmat<INDEX, SCALAR>::spmat(const spar::spmat<INDEX, SCALAR> &x)
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
-template <typename INDEX, typename SCALAR>
-spar::spmat<INDEX, SCALAR>& spar::spmat<INDEX, SCALAR>::operator=(const spmat<INDEX, SCALAR>& x)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET>& spar::spmat<INDEX, SCALAR, OFFSET>::operator=(const spmat<INDEX, SCALAR, OFFSET>& x)
 {
   this->cleanup();
   
@@ -189,7 +218,14 @@ spar::spmat<INDEX, SCALAR>& spar::spmat<INDEX, SCALAR>::operator=(const spmat<IN
   plen = n + 1;
   
   if (len == 0)
+  {
+    arraytools::zero_alloc(n+1, &P);
+    arraytools::check_allocs(P);
+    if (x.col_ptr())
+      arraytools::copy(n+1, x.col_ptr(), P);
+    
     return *this;
+  }
   
   arraytools::alloc(len, &I);
   arraytools::alloc(n+1, &P);
@@ -205,8 +241,8 @@ spar::spmat<INDEX, SCALAR>& spar::spmat<INDEX, SCALAR>::operator=(const spmat<IN
 
 
 
-template <typename INDEX, typename SCALAR>
-spar::spmat<INDEX, SCALAR>::~spmat()
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET>::~spmat()
 {
   cleanup();
 }
@@ -227,8 +263,8 @@ spar::spmat<INDEX, SCALAR>::~spmat()
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::resize(INDEX len_)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::resize(OFFSET len_)
 {
   if (len == len_)
     return;
@@ -244,8 +280,8 @@ void spar::spmat<INDEX, SCALAR>::resize(INDEX len_)
 
 
 /// Zero all data in the sparse matrix. Performs no allocations or resizing.
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::zero()
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::zero()
 {
   if (nnz > 0)
   {
@@ -268,13 +304,14 @@ void spar::spmat<INDEX, SCALAR>::zero()
   @return The number of elements needed that exceed the current matrix storage
   capacity (0 if the vector fits).
  */
-template <typename INDEX, typename SCALAR>
-INDEX spar::spmat<INDEX, SCALAR>::insertable(const spar::spvec<INDEX, SCALAR> &x)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+OFFSET spar::spmat<INDEX, SCALAR, OFFSET>::insertable(const spar::spvec<INDEX, SCALAR> &x)
 {
-  if (x.get_nnz() > len - nnz)
-    return x.get_nnz() - (len - nnz);
+  const OFFSET xnnz = x.get_nnz();
+  if (xnnz > len - nnz)
+    return xnnz - (len - nnz);
   else
-    return (INDEX) 0;
+    return (OFFSET) 0;
 }
 
 
@@ -289,14 +326,27 @@ INDEX spar::spmat<INDEX, SCALAR>::insertable(const spar::spvec<INDEX, SCALAR> &x
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::insert(const INDEX col, const spar::spvec<INDEX, SCALAR> &x)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::insert(const INDEX col, const spar::spvec<INDEX, SCALAR> &x)
 {
-  INDEX needed_space = len - nnz;
-  if (x.get_nnz() > needed_space)
-    resize((len + needed_space) * spar::internal::defs::MEM_FUDGE_ELT_FAC);
+  const OFFSET xnnz = x.get_nnz();
+  if (xnnz > len - nnz)
+    grow(nnz + xnnz);
   
-  insert_spvec(col, x);
+  insert_col(col, x.get_nnz(), x.index_ptr(), x.data_ptr());
+}
+
+
+
+/// \overload
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::insert(const INDEX col, const spar::spvec_view<INDEX, SCALAR> &x)
+{
+  const OFFSET xnnz = x.get_nnz();
+  if (xnnz > len - nnz)
+    grow(nnz + xnnz);
+  
+  insert_col(col, x.get_nnz(), x.index_ptr(), x.data_ptr());
 }
 
 
@@ -305,11 +355,11 @@ void spar::spmat<INDEX, SCALAR>::insert(const INDEX col, const spar::spvec<INDEX
   @brief Updates the internal "number non-zero" count. Useful if operating
   directly on the internal arrays.
  */
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::update_nnz()
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::update_nnz()
 {
   nnz = 0;
-  for (INDEX i=0; i<len; i++)
+  for (OFFSET i=0; i<len; i++)
   {
     if (X[i])
       nnz++;
@@ -320,6 +370,21 @@ void spar::spmat<INDEX, SCALAR>::update_nnz()
 
 
 
+/**
+  @brief Sets the internal "number non-zero" count, for example from the
+  column pointers after writing the internal arrays directly. Unlike
+  `update_nnz()`, this counts explicit zeros in the data.
+  
+  @param[in] nnz_ The number of stored elements.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::update_nnz(const OFFSET nnz_)
+{
+  nnz = nnz_;
+}
+
+
+
 /**
   @brief Retrieve the specified column as a sparse vector.
   
@@ -330,22 +395,207 @@ void spar::spmat<INDEX, SCALAR>::update_nnz()
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::get_col(const INDEX col, spar::spvec<INDEX, SCALAR> &x) const
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::get_col(const INDEX col, spar::spvec<INDEX, SCALAR> &x) const
 {
-  const INDEX ind = P[col];
+  const OFFSET ind = P[col];
   if (P[col + 1] == ind)
   {
     x.zero();
     return;
   }
   
-  const INDEX col_nnz = P[col + 1] - ind;
+  const INDEX col_nnz = (INDEX) (P[col + 1] - ind);
   x.set(col_nnz, I + ind, X + ind);
 }
 
 
 
+/**
+  @brief Retrieve the specified column as a non-owning sparse vector view.
+  
+  @param[in] col The column index.
+  @param[out] x The view of the column. It points into the matrix storage, so
+  it is invalidated by any operation that resizes the matrix.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::get_col(const INDEX col, spar::spvec_view<INDEX, SCALAR> &x) const
+{
+  const OFFSET ind = P[col];
+  x.set((INDEX) (P[col + 1] - ind), I + ind, X + ind);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// construction from triplets
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Build a matrix from (row, column, value) triplets in any order.
+  
+  The triplets are bucketed by column with a counting sort (per-thread
+  column histograms, a parallel prefix sum, and a parallel scatter that
+  keeps the input order within each column). Each column is then sorted by
+  row, summing duplicates. Zero values, including duplicates that sum to
+  zero, are dropped. The work is spread over OpenMP threads when enabled.
+  
+  @param[in] nrows_,ncols_ The dimension of the matrix.
+  @param[in] count Number of triplets.
+  @param[in] rows,cols,vals The triplets, each of length `count`. Indices
+  are zero-based.
+  
+  @return The matrix, with storage length equal to its number of non-zeros.
+  
+  @allocs The result, and scratch space for the column-bucketed triplets.
+  
+  @except If any index is out of range, a `runtime_error` exception will be
+  thrown. If a memory allocation fails, a `bad_alloc` exception will be
+  thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET> spar::spmat<INDEX, SCALAR, OFFSET>::from_triplets(
+  const INDEX nrows_, const INDEX ncols_, const OFFSET count, const INDEX *rows,
+  const INDEX *cols, const SCALAR *vals)
+{
+  const uint64_t plen_ = (uint64_t) ncols_ + 1;
+  
+  // every chunk of triplets gets its own histogram; use no more chunks than
+  // keeps their storage within the size of the input
+  const uint64_t max_chunks = std::max((uint64_t) 1, (uint64_t) count / plen_);
+  const int nchunks = (int) std::min((uint64_t) internal::par::num_threads(), max_chunks);
+  
+  // chunk c's count, then its starting offset, of column j is at [c*plen_ + j]
+  std::vector<OFFSET> hist(nchunks * plen_, 0);
+  std::vector<OFFSET> colptr(plen_, 0);
+  int bad = 0;
+  
+  #pragma omp parallel for schedule(static, 1) reduction(|:bad)
+  for (int c=0; c<nchunks; c++)
+  {
+    OFFSET *h = hist.data() + c*plen_;
+    const OFFSET first = (OFFSET) ((uint64_t) count*c/nchunks);
+    const OFFSET last = (OFFSET) ((uint64_t) count*(c+1)/nchunks);
+    for (OFFSET k=first; k<last; k++)
+    {
+      // negative indices wrap around to large unsigned ones
+      if ((uint64_t) rows[k] >= (uint64_t) nrows_ || (uint64_t) cols[k] >= (uint64_t) ncols_)
+        bad = 1;
+      else if (vals[k] != (SCALAR) 0)
+        h[cols[k]]++;
+    }
+  }
+  
+  if (bad)
+    throw std::runtime_error("triplet index out of range");
+  
+  #pragma omp parallel for schedule(static)
+  for (INDEX j=0; j<ncols_; j++)
+  {
+    OFFSET s = 0;
+    for (int c=0; c<nchunks; c++)
+    {
+      const OFFSET tmp = hist[c*plen_ + j];
+      hist[c*plen_ + j] = s;
+      s += tmp;
+    }
+    
+    colptr[j] = s;
+  }
+  
+  internal::par::exclusive_scan(plen_, colptr.data());
+  
+  std::vector<INDEX> sI(colptr[ncols_]);
+  std::vector<SCALAR> sX(colptr[ncols_]);
+  
+  #pragma omp parallel for schedule(static, 1)
+  for (int c=0; c<nchunks; c++)
+  {
+    OFFSET *h = hist.data() + c*plen_;
+    const OFFSET first = (OFFSET) ((uint64_t) count*c/nchunks);
+    const OFFSET last = (OFFSET) ((uint64_t) count*(c+1)/nchunks);
+    for (OFFSET k=first; k<last; k++)
+    {
+      if (vals[k] == (SCALAR) 0)
+        continue;
+      
+      const OFFSET slot = colptr[cols[k]] + h[cols[k]]++;
+      sI[slot] = rows[k];
+      sX[slot] = vals[k];
+    }
+  }
+  
+  // sort each column by row and sum duplicates in place; hist is reused for
+  // the final column counts
+  std::vector<OFFSET> &colnnz = hist;
+  colnnz[ncols_] = 0;
+  
+  #pragma omp parallel
+  {
+    std::vector<std::pair<INDEX, SCALAR>> tmp;
+    
+    #pragma omp for schedule(dynamic, 64)
+    for (INDEX j=0; j<ncols_; j++)
+    {
+      const OFFSET start = colptr[j];
+      const OFFSET stop = colptr[j + 1];
+      
+      bool sorted = true;
+      for (OFFSET ind=start+1; ind<stop && sorted; ind++)
+        sorted = (sI[ind - 1] < sI[ind]);
+      
+      if (!sorted)
+      {
+        tmp.resize(stop - start);
+        for (OFFSET ind=start; ind<stop; ind++)
+          tmp[ind - start] = std::make_pair(sI[ind], sX[ind]);
+        
+        std::stable_sort(tmp.begin(), tmp.end(),
+          [](const std::pair<INDEX, SCALAR> &a, const std::pair<INDEX, SCALAR> &b){return a.first < b.first;});
+        
+        OFFSET out = start;
+        for (OFFSET t=0; t<stop-start; )
+        {
+          const INDEX row = tmp[t].first;
+          SCALAR s = 0;
+          for (; t<stop-start && tmp[t].first == row; t++)
+            s += tmp[t].second;
+          
+          if (s != (SCALAR) 0)
+          {
+            sI[out] = row;
+            sX[out] = s;
+            out++;
+          }
+        }
+        
+        colnnz[j] = out - start;
+      }
+      else
+        colnnz[j] = stop - start;
+    }
+  }
+  
+  internal::par::exclusive_scan(plen_, colnnz.data());
+  
+  const OFFSET nnz_ = colnnz[ncols_];
+  spmat<INDEX, SCALAR, OFFSET> x(nrows_, ncols_, nnz_);
+  arraytools::copy(plen_, colnnz.data(), x.P);
+  
+  #pragma omp parallel for schedule(static)
+  for (INDEX j=0; j<ncols_; j++)
+  {
+    const OFFSET col_nnz = x.P[j + 1] - x.P[j];
+    arraytools::copy(col_nnz, sI.data() + colptr[j], x.I + x.P[j]);
+    arraytools::copy(col_nnz, sX.data() + colptr[j], x.X + x.P[j]);
+  }
+  
+  x.nnz = nnz_;
+  return x;
+}
+
+
+
 // ----------------------------------------------------------------------------
 // utils
 // ----------------------------------------------------------------------------
@@ -355,8 +605,8 @@ void spar::spmat<INDEX, SCALAR>::get_col(const INDEX col, spar::spvec<INDEX, SCA
   
   @return The non-zero elements divided by the matrix dimensions.
  */
-template <typename INDEX, typename SCALAR>
-float spar::spmat<INDEX, SCALAR>::sparsity() const
+template <typename INDEX, typename SCALAR, typename OFFSET>
+float spar::spmat<INDEX, SCALAR, OFFSET>::sparsity() const
 {
   return 1.f - (float)nnz/m/n;
 }
@@ -369,8 +619,8 @@ float spar::spmat<INDEX, SCALAR>::sparsity() const
   @return The complement of the number of non-zero elements divided by the
   matrix dimensions from one (i.e., 1 minus the sparsity).
  */
-template <typename INDEX, typename SCALAR>
-float spar::spmat<INDEX, SCALAR>::density() const
+template <typename INDEX, typename SCALAR, typename OFFSET>
+float spar::spmat<INDEX, SCALAR, OFFSET>::density() const
 {
   return 1.f - sparsity();
 }
@@ -393,13 +643,13 @@ float spar::spmat<INDEX, SCALAR>::density() const
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
-template <typename INDEX, typename SCALAR> // NOTE to self: don't set this method const
-void spar::spmat<INDEX, SCALAR>::print(bool actual)
+template <typename INDEX, typename SCALAR, typename OFFSET> // NOTE to self: don't set this method const
+void spar::spmat<INDEX, SCALAR, OFFSET>::print(bool actual)
 {
   if (actual)
   {
     printf("I: ");
-    for (INDEX ind=0; ind<len; ind++)
+    for (OFFSET ind=0; ind<len; ind++)
       std::cout << I[ind] << " ";
     
     printf("\nP: ");
@@ -407,7 +657,7 @@ void spar::spmat<INDEX, SCALAR>::print(bool actual)
       std::cout << P[ind] << " ";
     
     printf("\nX: ");
-    for (INDEX ind=0; ind<len; ind++)
+    for (OFFSET ind=0; ind<len; ind++)
       std::cout << X[ind] << " ";
     
     putchar('\n');
@@ -429,7 +679,7 @@ void spar::spmat<INDEX, SCALAR>::print(bool actual)
       INDEX* CI = csc2coo();
       for (INDEX i=0; i<m; i++)
       {
-        INDEX ind = 0;
+        OFFSET ind = 0;
         for (INDEX j=0; j<n; j++)
         {
           while (I[ind] < i || CI[ind] < j)
@@ -456,13 +706,13 @@ void spar::spmat<INDEX, SCALAR>::print(bool actual)
 
 
 /// Print some quick info about the sparse matrix.
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::info() const
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::info() const
 {
   printf("# spmat");
   printf(" %dx%d", m, n);
-  printf(" with nnz=%d (%.2f%% sparse)", nnz, sparsity()*100.f);
-  printf(" and len=%d", len);
+  printf(" with nnz=%lld (%.2f%% sparse)", (long long) nnz, sparsity()*100.f);
+  printf(" and len=%lld", (long long) len);
   printf(" (index=%s scalar=%s)", typeid(INDEX).name(), typeid(SCALAR).name());
   printf("\n");
 }
@@ -473,12 +723,9 @@ void spar::spmat<INDEX, SCALAR>::info() const
 // internals
 // ----------------------------------------------------------------------------
 
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::cleanup()
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::cleanup()
 {
-  if (len == 0)
-    return;
-  
   arraytools::free(I);
   I = NULL;
   
@@ -497,12 +744,25 @@ void spar::spmat<INDEX, SCALAR>::cleanup()
 
 
 
+// resize geometrically, but always to at least min_len
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::grow(const OFFSET min_len)
+{
+  OFFSET new_len = (OFFSET) (len * spar::internal::defs::MEM_FUDGE_ELT_FAC);
+  if (new_len < min_len)
+    new_len = min_len;
+  
+  resize(new_len);
+}
+
+
+
 // convert "column pointer" P into column index
-template <typename INDEX, typename SCALAR>
-INDEX* spar::spmat<INDEX, SCALAR>::csc2coo()
+template <typename INDEX, typename SCALAR, typename OFFSET>
+INDEX* spar::spmat<INDEX, SCALAR, OFFSET>::csc2coo()
 {
   INDEX j = 0;
-  INDEX ind = 0;
+  OFFSET ind = 0;
   
   INDEX* CI;
   arraytools::alloc(len, &CI);
@@ -514,7 +774,7 @@ INDEX* spar::spmat<INDEX, SCALAR>::csc2coo()
   
   for (INDEX c=0; c<plen; c++)
   {
-    INDEX diff = P[c+1] - P[c];
+    OFFSET diff = P[c+1] - P[c];
     
     while (diff > 0)
     {
@@ -532,14 +792,11 @@ INDEX* spar::spmat<INDEX, SCALAR>::csc2coo()
 
 
 
-template <typename INDEX, typename SCALAR>
-void spar::spmat<INDEX, SCALAR>::insert_spvec(const INDEX col, const spar::spvec<INDEX, SCALAR> &x)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat<INDEX, SCALAR, OFFSET>::insert_col(const INDEX col, const INDEX xnnz,
+  const INDEX *xI, const SCALAR *xX)
 {
-  const INDEX *xI = x.index_ptr();
-  const SCALAR *xX = x.data_ptr();
-  
-  INDEX ind = P[col];
-  const INDEX xnnz = x.get_nnz();
+  OFFSET ind = P[col];
   for (INDEX xind=0; xind<xnnz; xind++)
   {
     I[ind] = xI[xind];
@@ -0,0 +1,175 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_SPMAT_VIEW_H
+#define SPAR_CORE_SPMAT_VIEW_H
+#pragma once
+
+
+#include <cstdio>
+#include <typeinfo>
+
+#include "fwd.hpp"
+
+
+namespace spar
+{
+  template <typename INDEX, typename SCALAR>
+  class spvec_view;
+  
+  /**
+    @brief Non-owning, read-only sparse matrix in CSC format. The view wraps
+    index/column/data arrays owned by someone else (an `spmat`, an Eigen
+    matrix, an R `dgCMatrix`, a memory map, ...) without copying them.
+    
+    @tparam INDEX should be some kind of fundamental indexing type, like `int`
+    or `uint16_t`.
+    @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+    @tparam OFFSET is the type of the column pointers, as in `spmat`.
+   */
+  template <typename INDEX, typename SCALAR, typename OFFSET>
+  class spmat_view
+  {
+    public:
+      spmat_view();
+      spmat_view(const INDEX nrows_, const INDEX ncols_, const INDEX *I_,
+        const OFFSET *P_, const SCALAR *X_);
+      spmat_view(const spmat<INDEX, SCALAR, OFFSET> &x);
+      
+      void set(const INDEX nrows_, const INDEX ncols_, const INDEX *I_,
+        const OFFSET *P_, const SCALAR *X_);
+      void get_col(const INDEX col, spvec_view<INDEX, SCALAR> &x) const;
+      
+      void info() const;
+      
+      /// Number of rows.
+      INDEX nrows() const {return m;};
+      /// Number of columns.
+      INDEX ncols() const {return n;};
+      /// Number of non-zero elements.
+      OFFSET get_nnz() const {return P == NULL ? 0 : P[n] - P[0];};
+      /// Return a pointer to the index array `I`.
+      const INDEX* index_ptr() const {return I;};
+      /// Return a pointer to the column array `P`.
+      const OFFSET* col_ptr() const {return P;};
+      /// Return a pointer to the data array `X`.
+      const SCALAR* data_ptr() const {return X;};
+    
+    protected:
+      /// Number of rows.
+      INDEX m;
+      /// Number of cols.
+      INDEX n;
+      /// Index array (not owned).
+      const INDEX *I;
+      /// Column pointer array (not owned).
+      const OFFSET *P;
+      /// Data array (not owned).
+      const SCALAR *X;
+  };
+}
+
+
+
+// ----------------------------------------------------------------------------
+// constructor
+// ----------------------------------------------------------------------------
+
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat_view<INDEX, SCALAR, OFFSET>::spmat_view()
+{
+  set(0, 0, NULL, NULL, NULL);
+}
+
+
+
+/**
+  @brief Constructor.
+  
+  @param[in] nrows_,ncols_ The dimension of the matrix.
+  @param[in] I_ Row index array, of length `P_[ncols_]`.
+  @param[in] P_ Column pointer array, of length `ncols_ + 1`.
+  @param[in] X_ Data array, of length `P_[ncols_]`.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat_view<INDEX, SCALAR, OFFSET>::spmat_view(const INDEX nrows_,
+  const INDEX ncols_, const INDEX *I_, const OFFSET *P_, const SCALAR *X_)
+{
+  set(nrows_, ncols_, I_, P_, X_);
+}
+
+
+
+/**
+  @brief View an `spmat`.
+  
+  @param[in] x The input. The view is invalidated by any operation that
+  resizes it.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat_view<INDEX, SCALAR, OFFSET>::spmat_view(const spmat<INDEX, SCALAR, OFFSET> &x)
+{
+  set(x.nrows(), x.ncols(), x.index_ptr(), x.col_ptr(), x.data_ptr());
+}
+
+
+
+// ----------------------------------------------------------------------------
+// object management
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Point the view at new CSC arrays. Performs no allocations or copies.
+  
+  @param[in] nrows_,ncols_ The dimension of the matrix.
+  @param[in] I_ Row index array, of length `P_[ncols_]`.
+  @param[in] P_ Column pointer array, of length `ncols_ + 1`.
+  @param[in] X_ Data array, of length `P_[ncols_]`.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat_view<INDEX, SCALAR, OFFSET>::set(const INDEX nrows_,
+  const INDEX ncols_, const INDEX *I_, const OFFSET *P_, const SCALAR *X_)
+{
+  m = nrows_;
+  n = ncols_;
+  
+  I = I_;
+  P = P_;
+  X = X_;
+}
+
+
+
+/**
+  @brief Retrieve the specified column as a non-owning sparse vector view.
+  
+  @param[in] col The column index.
+  @param[out] x The view of the column.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat_view<INDEX, SCALAR, OFFSET>::get_col(const INDEX col, spar::spvec_view<INDEX, SCALAR> &x) const
+{
+  const OFFSET ind = P[col];
+  x.set((INDEX) (P[col + 1] - ind), I + ind, X + ind);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// printer
+// ----------------------------------------------------------------------------
+
+/// Print some quick info about the sparse matrix view.
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::spmat_view<INDEX, SCALAR, OFFSET>::info() const
+{
+  printf("# spmat_view");
+  printf(" %dx%d", (int) m, (int) n);
+  printf(" with nnz=%lld", (long long) get_nnz());
+  printf(" (index=%s scalar=%s)", typeid(INDEX).name(), typeid(SCALAR).name());
+  printf("\n");
+}
+
+
+#endif
@@ -7,9 +7,14 @@
 #pragma once
 
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 
 #include "../arraytools/src/arraytools.hpp"
+#include "simd.hpp"
 
 
 namespace spar
@@ -75,6 +80,7 @@ namespace spar
     
     private:
       void cleanup();
+      void grow(const uint64_t need);
       void insert_from_ind(const INDEX insertion_ind, const INDEX i, const SCALAR s);
   };
 }
@@ -204,7 +210,7 @@ INDEX spar::spvec<INDEX, SCALAR>::insertable() const
   @param[in] i The index.
   @param[in] s The input value.
   
-  @allocs The internal arrays will resize themselves as needed.
+  @allocs If the internal arrays are full, their capacity is doubled.
   
   @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
@@ -212,15 +218,9 @@ template <typename INDEX, typename SCALAR>
 void spar::spvec<INDEX, SCALAR>::insert(const INDEX i, const SCALAR s)
 {
   if (nnz == len)
-    resize(len + 1);
-  
-  INDEX insertion_ind;
-  for (insertion_ind=0; insertion_ind<nnz; insertion_ind++)
-  {
-    if (i < I[insertion_ind])
-      break;
-  }
+    grow((uint64_t) len + 1);
   
+  const INDEX insertion_ind = (INDEX) (std::upper_bound(I, I + nnz, i) - I);
   insert_from_ind(insertion_ind, i, s);
 }
 
@@ -255,18 +255,11 @@ void spar::spvec<INDEX, SCALAR>::update_nnz()
 template <typename INDEX, typename SCALAR>
 SCALAR spar::spvec<INDEX, SCALAR>::get(const INDEX ind) const
 {
-  SCALAR val = 0;
+  const INDEX *pos = std::lower_bound(I, I + nnz, ind);
+  if (pos == I + nnz || *pos != ind)
+    return (SCALAR) 0;
   
-  for (INDEX pos=0; pos<nnz; pos++)
-  {
-    if (I[pos] == ind)
-    {
-      val = X[pos];
-      break;
-    }
-  }
-  
-  return val;
+  return X[pos - I];
 }
 
 
@@ -338,46 +331,72 @@ void spar::spvec<INDEX, SCALAR>::info() const
 /**
   @brief Add the input to the sparse vector.
   
+  @details The two index arrays are merged from the back, so each element is
+  moved at most once and the work is linear in the two numbers of non-zeros.
+  
   @param[in] x Input to adder.
   
-  @return Returns the needed size of realloc.
+  @return 0. Older versions returned the storage needed when the vector was
+  too small, without adding; it now grows as needed.
+  
+  @allocs If the new indices do not fit, the capacity grows to the larger of
+  twice its size and the needed size.
+  
+  @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
  */
 template <typename INDEX, typename SCALAR>
 INDEX spar::spvec<INDEX, SCALAR>::add(const spvec &x)
 {
+  const INDEX x_nnz = x.get_nnz();
   const INDEX *xI = x.index_ptr();
   const SCALAR *xX = x.data_ptr();
-  INDEX ind = 0;
   
-  // pre-scan to see if a re-alloc is necessary
-  INDEX num_inserted = 0;
-  for (INDEX xind=0; xind<x.get_nnz(); xind++)
+  // count the indices not already present
+  uint64_t num_inserted = 0;
+  INDEX ind = 0;
+  for (INDEX xind=0; xind<x_nnz; xind++)
   {
     const INDEX xi = xI[xind];
     while (ind < nnz && I[ind] < xi)
       ind++;
     
-    if (ind >= nnz || I[ind] > xi)
+    if (ind == nnz || I[ind] > xi)
       num_inserted++;
   }
   
-  if (num_inserted > (len - nnz))
-    return num_inserted;
+  if ((uint64_t) nnz + num_inserted > (uint64_t) len)
+    grow((uint64_t) nnz + num_inserted);
   
-  // add the vectors
-  ind = 0;
-  for (INDEX xind=0; xind<x.get_nnz(); xind++)
+  // merge from the back; once x is used up, the rest is already in place
+  INDEX a = nnz;
+  INDEX b = x_nnz;
+  INDEX k = (INDEX) (nnz + num_inserted);
+  while (b > 0)
   {
-    const INDEX xi = xI[xind];
-    while (ind < nnz && I[ind] < xi)
-      ind++;
-    
-    if (I[ind] == xi)
-      X[ind++] += xX[xind];
-    else if (ind == nnz || I[ind] > xi)
-      insert_from_ind(ind, xi, xX[xind]);
+    k--;
+    if (a > 0 && I[a-1] > xI[b-1])
+    {
+      a--;
+      I[k] = I[a];
+      X[k] = X[a];
+    }
+    else if (a > 0 && I[a-1] == xI[b-1])
+    {
+      a--;
+      b--;
+      I[k] = I[a];
+      X[k] = X[a] + xX[b];
+    }
+    else
+    {
+      b--;
+      I[k] = xI[b];
+      X[k] = xX[b];
+    }
   }
   
+  nnz = (INDEX) (nnz + num_inserted);
+  
   return 0;
 }
 
@@ -387,41 +406,65 @@ INDEX spar::spvec<INDEX, SCALAR>::add(const spvec &x)
 template <typename INDEX, typename SCALAR>
 INDEX spar::spvec<INDEX, SCALAR>::add(const SCALAR *x, const INDEX xlen)
 {
+  uint64_t num_inserted = 0;
   INDEX ind = 0;
-  
-  // pre-scan to see if a re-alloc is necessary
-  INDEX num_inserted = 0;
   for (INDEX xi=0; xi<xlen; xi++)
   {
-    if (x[xi] == (SCALAR)0)
+    if (x[xi] == (SCALAR) 0)
       continue;
     
     while (ind < nnz && I[ind] < xi)
       ind++;
     
-    if (ind >= nnz || I[ind] > xi)
+    if (ind == nnz || I[ind] > xi)
       num_inserted++;
   }
   
-  if (num_inserted > (xlen - nnz))
-    return num_inserted;
+  if ((uint64_t) nnz + num_inserted > (uint64_t) len)
+    grow((uint64_t) nnz + num_inserted);
   
-  // add the vectors
-  ind = 0;
-  for (INDEX xi=0; xi<xlen; xi++)
+  INDEX a = nnz;
+  INDEX xi = xlen;
+  INDEX k = (INDEX) (nnz + num_inserted);
+  while (xi > 0 && k > a)
   {
-    if (x[xi] == (SCALAR)0)
+    if (x[xi-1] == (SCALAR) 0)
+    {
+      xi--;
       continue;
+    }
     
-    while (ind < nnz && I[ind] < xi)
-      ind++;
-    
-    if (I[ind] == xi)
-      X[ind++] += x[xi];
-    else if (ind == nnz || I[ind] > xi)
-      insert_from_ind(ind, xi, x[xi]);
+    k--;
+    if (a > 0 && I[a-1] > xi-1)
+    {
+      a--;
+      I[k] = I[a];
+      X[k] = X[a];
+    }
+    else if (a > 0 && I[a-1] == xi-1)
+    {
+      a--;
+      xi--;
+      I[k] = I[a];
+      X[k] = X[a] + x[xi];
+    }
+    else
+    {
+      xi--;
+      I[k] = xi;
+      X[k] = x[xi];
+    }
+  }
+  
+  // what's left of x lands on existing indices
+  for (INDEX pos=0; pos<a && xi>0; pos++)
+  {
+    if (I[pos] < xi)
+      X[pos] += x[I[pos]];
   }
   
+  nnz = (INDEX) (nnz + num_inserted);
+  
   return 0;
 }
 
@@ -443,12 +486,10 @@ INDEX spar::spvec<INDEX, SCALAR>::add(const SCALAR *x, const INDEX xlen)
 template <typename INDEX, typename SCALAR>
 void spar::spvec<INDEX, SCALAR>::densify(dvec<INDEX, SCALAR> &d) const
 {
-  if (nnz && I[nnz-1] > d.get_len())
+  if (nnz && I[nnz-1] >= d.get_len())
     throw std::logic_error("dense array not large enough to store sparse vector");
   
-  d.zero();
-  for (INDEX pos=0; pos<nnz; pos++)
-    d.insert(I[pos], X[pos]);
+  d.set(nnz, I, X);
 }
 
 
@@ -492,20 +533,7 @@ void spar::spvec<INDEX, SCALAR>::set(const dvec<INDEX, SCALAR> &d)
   if (dnnz > len)
     resize(dnnz);
   
-  INDEX pos = 0;
-  SCALAR *d_p = d.data_ptr();
-  for (INDEX i=0; i<d.get_len(); i++)
-  {
-    if (d_p[i])
-    {
-      I[pos] = i;
-      X[pos] = d_p[i];
-      
-      pos++;
-    }
-  }
-  
-  nnz = dnnz;
+  nnz = internal::simd::sparsify(d.get_len(), d.data_ptr(), I, X);
 }
 
 
@@ -529,6 +557,20 @@ void spar::spvec<INDEX, SCALAR>::cleanup()
 
 
 
+// grow the capacity to at least `need`, doubling it if that's more
+template <typename INDEX, typename SCALAR>
+void spar::spvec<INDEX, SCALAR>::grow(const uint64_t need)
+{
+  const uint64_t max_len = (uint64_t) std::numeric_limits<INDEX>::max();
+  if (need > max_len)
+    throw std::runtime_error("sparse vector capacity exceeds the index type");
+  
+  const uint64_t doubled = std::min(2 * (uint64_t) len, max_len);
+  resize((INDEX) std::max(need, doubled));
+}
+
+
+
 template <typename INDEX, typename SCALAR>
 void spar::spvec<INDEX, SCALAR>::insert_from_ind(const INDEX insertion_ind,
   const INDEX i, const SCALAR s)
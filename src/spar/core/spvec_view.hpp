@@ -0,0 +1,162 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_SPVEC_VIEW_H
+#define SPAR_CORE_SPVEC_VIEW_H
+#pragma once
+
+
+#include <stdexcept>
+
+
+namespace spar
+{
+  template <typename INDEX, typename SCALAR>
+  class dvec;
+  
+  /**
+    @brief Non-owning sparse vector. The view points into index/data arrays
+    owned by someone else (typically a column of a CSC matrix), so setting it
+    never copies or allocates.
+    
+    @tparam INDEX should be some kind of fundamental indexing type, like `int`
+    or `uint16_t`.
+    @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+   */
+  template <typename INDEX, typename SCALAR>
+  class spvec_view
+  {
+    public:
+      spvec_view();
+      spvec_view(const INDEX nnz_, const INDEX *I_, const SCALAR *X_);
+      
+      void set(const INDEX nnz_, const INDEX *I_, const SCALAR *X_);
+      void zero();
+      SCALAR get(const INDEX ind) const;
+      
+      void densify(dvec<INDEX, SCALAR> &d) const;
+      
+      /// Number of non-zero elements.
+      INDEX get_nnz() const {return nnz;};
+      /// Return a pointer to the index array `I`.
+      const INDEX* index_ptr() const {return I;};
+      /// Return a pointer to the data array `X`.
+      const SCALAR* data_ptr() const {return X;};
+    
+    protected:
+      /// Number non-zero.
+      INDEX nnz;
+      /// Index array (not owned).
+      const INDEX *I;
+      /// Data array (not owned).
+      const SCALAR *X;
+  };
+}
+
+
+
+// ----------------------------------------------------------------------------
+// constructor
+// ----------------------------------------------------------------------------
+
+template <typename INDEX, typename SCALAR>
+spar::spvec_view<INDEX, SCALAR>::spvec_view()
+{
+  zero();
+}
+
+
+
+/**
+  @brief Constructor.
+  
+  @param[in] nnz_ Length of the input index/scalar arrays.
+  @param[in] I_ Index array.
+  @param[in] X_ Scalar array.
+ */
+template <typename INDEX, typename SCALAR>
+spar::spvec_view<INDEX, SCALAR>::spvec_view(const INDEX nnz_, const INDEX *I_, const SCALAR *X_)
+{
+  set(nnz_, I_, X_);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// object management
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Point the view at new index/data arrays. Performs no allocations or
+  copies.
+  
+  @param[in] nnz_ Length of the input index/scalar arrays.
+  @param[in] I_ Index array.
+  @param[in] X_ Scalar array.
+ */
+template <typename INDEX, typename SCALAR>
+void spar::spvec_view<INDEX, SCALAR>::set(const INDEX nnz_, const INDEX *I_, const SCALAR *X_)
+{
+  nnz = nnz_;
+  I = I_;
+  X = X_;
+}
+
+
+
+/// Make the view empty. The viewed memory is untouched.
+template <typename INDEX, typename SCALAR>
+void spar::spvec_view<INDEX, SCALAR>::zero()
+{
+  nnz = 0;
+  I = NULL;
+  X = NULL;
+}
+
+
+
+/**
+  @brief Retrieve the value at the specified index.
+  
+  @param[in] ind The index.
+  @return The scalar value at position `ind`. Will return 0 if no non-zero value
+  is stored at that index.
+ */
+template <typename INDEX, typename SCALAR>
+SCALAR spar::spvec_view<INDEX, SCALAR>::get(const INDEX ind) const
+{
+  for (INDEX pos=0; pos<nnz; pos++)
+  {
+    if (I[pos] == ind)
+      return X[pos];
+  }
+  
+  return (SCALAR) 0;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// converters
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Convert the viewed sparse vector into a dense vector.
+  
+  @param[in] d The output dense array.
+  
+  @except If the dense vector is too short to hold the largest index, a
+  `logic_error` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR>
+void spar::spvec_view<INDEX, SCALAR>::densify(dvec<INDEX, SCALAR> &d) const
+{
+  if (nnz && I[nnz-1] >= d.get_len())
+    throw std::logic_error("dense array not large enough to store sparse vector");
+  
+  d.set(nnz, I, X);
+}
+
+
+#endif
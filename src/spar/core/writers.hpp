@@ -0,0 +1,301 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_CORE_WRITERS_H
+#define SPAR_CORE_WRITERS_H
+#pragma once
+
+
+#include <stdexcept>
+#include <vector>
+
+#include "../arraytools/src/arraytools.hpp"
+#include "defs.hpp"
+#include "fwd.hpp"
+
+
+namespace spar
+{
+  template <typename INDEX, typename SCALAR>
+  class spvec_view;
+  
+  /**
+    @brief Output adapters for the reducers.
+    
+    A writer receives the reduced matrix one column at a time, so the result
+    can be assembled directly in its final container. Every writer has the
+    same three methods, which the reducers call on the receiving ranks only:
+      1. `init(m, n, len)` once, before any columns, with the dimensions of the
+      result and a hint for the initial storage length.
+      2. `insert(col, nnz, I, X)` for each non-empty column of the result, in
+      strictly increasing column order. Empty columns are skipped.
+      3. `finalize()` once, after the last column.
+    
+    A `transform_writer` wraps any other writer to change or drop entries on
+    the way in.
+   */
+  namespace writers
+  {
+    /**
+      @brief Write the reduced matrix into an `spmat`.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the output, as in `spmat`.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    class spmat_writer
+    {
+      public:
+        /**
+          @brief Constructor.
+          
+          @param[out] s_ The output matrix. If its dimensions do not match the
+          result, it will be replaced by an empty matrix of the right size.
+         */
+        spmat_writer(spmat<INDEX, SCALAR, OFFSET> &s_) : s(s_) {};
+        
+        void init(const INDEX m, const INDEX n, const INDEX len)
+        {
+          if (s.nrows() != m || s.ncols() != n)
+            s = spmat<INDEX, SCALAR, OFFSET>(m, n, len);
+          else
+          {
+            s.zero();
+            if (s.get_len() < (OFFSET) len)
+              s.resize(len);
+          }
+        }
+        
+        void insert(const INDEX col, const INDEX nnz, const INDEX *I, const SCALAR *X)
+        {
+          s.insert(col, spvec_view<INDEX, SCALAR>(nnz, I, X));
+        }
+        
+        void finalize() {};
+      
+      protected:
+        /// The output matrix.
+        spmat<INDEX, SCALAR, OFFSET> &s;
+    };
+    
+    
+    
+    /**
+      @brief Write the reduced matrix into caller-owned CSC buffers.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the type of the column pointers, as in `spmat`.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    class csc_writer
+    {
+      public:
+        /**
+          @brief Constructor.
+          
+          @param[out] P_ Column pointer array. Must hold `n+1` elements.
+          @param[out] I_,X_ Index and data arrays. Each must hold `capacity_`
+          elements.
+          @param[in] capacity_ Length of the index and data arrays.
+         */
+        csc_writer(OFFSET *P_, INDEX *I_, SCALAR *X_, const OFFSET capacity_)
+        {
+          P = P_;
+          I = I_;
+          X = X_;
+          
+          capacity = capacity_;
+          n = 0;
+          nnz = 0;
+          next_col = 0;
+        };
+        
+        void init(const INDEX m, const INDEX n_, const INDEX len)
+        {
+          (void) m;
+          (void) len;
+          
+          n = n_;
+          nnz = 0;
+          next_col = 0;
+          P[0] = 0;
+        }
+        
+        /**
+          @except If the index/data arrays are too small for the result, a
+          `runtime_error` exception will be thrown.
+         */
+        void insert(const INDEX col, const INDEX col_nnz, const INDEX *I_, const SCALAR *X_)
+        {
+          if ((OFFSET) col_nnz > capacity - nnz)
+            throw std::runtime_error("output buffers are too small for the reduced matrix");
+          
+          fill_to(col);
+          
+          arraytools::copy(col_nnz, I_, I + nnz);
+          arraytools::copy(col_nnz, X_, X + nnz);
+          nnz += col_nnz;
+        }
+        
+        void finalize()
+        {
+          fill_to(n);
+        }
+        
+        /// Number of non-zero elements written so far.
+        OFFSET get_nnz() const {return nnz;};
+      
+      protected:
+        /// Column pointer array (not owned).
+        OFFSET *P;
+        /// Index array (not owned).
+        INDEX *I;
+        /// Data array (not owned).
+        SCALAR *X;
+        /// Length of the index and data arrays.
+        OFFSET capacity;
+        /// Number of columns.
+        INDEX n;
+        /// Number non-zero written.
+        OFFSET nnz;
+        /// First column whose end pointer has not been written.
+        INDEX next_col;
+      
+      private:
+        // close all columns before col
+        void fill_to(const INDEX col)
+        {
+          for (; next_col<col; next_col++)
+            P[next_col + 1] = nnz;
+        }
+    };
+    
+    
+    
+    /**
+      @brief Transform and filter the columns on their way into another
+      writer, for example to average a sum or to drop small or cancelled
+      entries. The entries are changed as they are written, so the result is
+      only ever stored at its final size and needs no second pass.
+      
+      @details For every entry of a column the functor is called as
+      `f(i, j, x)`, with its row, column and value. It may change `x`, and
+      returns whether the entry is kept. Columns left empty are not passed
+      on.
+      
+      @tparam INDEX,SCALAR The index and scalar types of the wrapped writer.
+      @tparam WRITER The wrapped writer.
+      @tparam FUNC A functor `bool FUNC::operator()(INDEX, INDEX, SCALAR&)`,
+      like `prune`.
+     */
+    template <typename INDEX, typename SCALAR, class WRITER, class FUNC>
+    class transform_writer
+    {
+      public:
+        /**
+          @brief Constructor.
+          
+          @param[out] w_ The wrapped writer, which receives the transformed
+          columns.
+          @param[in] f_ The functor. It is copied.
+         */
+        transform_writer(WRITER &w_, const FUNC &f_) : w(w_), f(f_) {};
+        
+        void init(const INDEX m, const INDEX n, const INDEX len)
+        {
+          w.init(m, n, len);
+        }
+        
+        void insert(const INDEX col, const INDEX nnz, const INDEX *I_, const SCALAR *X_)
+        {
+          if (I.size() < (size_t) nnz)
+          {
+            I.resize(nnz);
+            X.resize(nnz);
+          }
+          
+          INDEX kept = 0;
+          for (INDEX k=0; k<nnz; k++)
+          {
+            SCALAR x = X_[k];
+            if (f(I_[k], col, x))
+            {
+              I[kept] = I_[k];
+              X[kept] = x;
+              kept++;
+            }
+          }
+          
+          if (kept > 0)
+            w.insert(col, kept, I.data(), X.data());
+        }
+        
+        void finalize()
+        {
+          w.finalize();
+        }
+      
+      protected:
+        /// The wrapped writer.
+        WRITER &w;
+        /// The functor.
+        FUNC f;
+        /// Kept indices of the current column.
+        std::vector<INDEX> I;
+        /// Kept values of the current column.
+        std::vector<SCALAR> X;
+    };
+    
+    /// Wrap `w` in a `transform_writer` applying `f`.
+    template <typename INDEX, typename SCALAR, class WRITER, class FUNC>
+    static inline transform_writer<INDEX, SCALAR, WRITER, FUNC> transform(WRITER &w, const FUNC &f)
+    {
+      return transform_writer<INDEX, SCALAR, WRITER, FUNC>(w, f);
+    }
+    
+    
+    
+    /**
+      @brief Functor for `transform_writer` which multiplies every entry by
+      `scale`, and then drops the entries whose magnitude is at most `tol`.
+      With the defaults it only drops the explicit zeros, such as the sums
+      which cancelled.
+      
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename SCALAR>
+    struct prune
+    {
+      /**
+        @param[in] scale_ Factor applied to every entry, e.g. `1.0/size` to
+        turn a sum into an average.
+        @param[in] tol_ Entries of magnitude at most this after scaling are
+        dropped.
+       */
+      prune(const SCALAR scale_=1, const SCALAR tol_=0) : scale(scale_), tol(tol_) {};
+      
+      template <typename INDEX>
+      bool operator()(const INDEX i, const INDEX j, SCALAR &x) const
+      {
+        (void) i;
+        (void) j;
+        
+        x = x * scale;
+        return internal::magnitude(x) > tol;
+      }
+      
+      /// Factor applied to every entry.
+      SCALAR scale;
+      /// Largest magnitude which is dropped.
+      SCALAR tol;
+    };
+  }
+}
+
+
+#endif
@@ -13,6 +13,7 @@
 #include <stdexcept>
 #include <vector>
 
+#include "../core/fwd.hpp"
 #include "rand.hpp"
 
 
@@ -21,9 +22,6 @@ namespace spar
   template <typename INDEX, typename SCALAR>
   class spvec;
 
-  template <typename INDEX, typename SCALAR>
-  class spmat;
-  
   /// @brief Random generators.
   namespace gen
   {
@@ -0,0 +1,492 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_IO_BINARY_H
+#define SPAR_IO_BINARY_H
+#pragma once
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../core/fwd.hpp"
+#include "../gen/platform.h"
+
+#if OS_NIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace spar
+{
+  /// @brief Readers and writers.
+  namespace io
+  {
+    namespace internal
+    {
+      namespace binary
+      {
+        static const char MAGIC[8] = {'S', 'P', 'A', 'R', 'B', 'I', 'N', '\0'};
+        static const uint32_t VERSION = 1;
+        static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+        static const uint64_t ALIGNMENT = 64;
+        
+        // all sections of the file start on an ALIGNMENT byte boundary, so a
+        // page-aligned map gives properly aligned arrays
+        struct header
+        {
+          char magic[8];
+          uint32_t byte_order;
+          uint32_t version;
+          uint8_t index_tag;
+          uint8_t offset_tag;
+          uint8_t scalar_tag;
+          uint8_t reserved0[5];
+          uint64_t m;
+          uint64_t n;
+          uint64_t nnz;
+          uint64_t P_offset;
+          uint64_t I_offset;
+          uint64_t X_offset;
+          uint64_t file_size;
+          uint8_t reserved1[48];
+        };
+        
+        static_assert(sizeof(header) == 2*ALIGNMENT, "unexpected binary header size");
+        
+        
+        
+        // type tag: kind in the high nibble (1 signed, 2 unsigned, 3 float),
+        // size in bytes in the low nibble
+        template <typename T>
+        static inline uint8_t type_tag()
+        {
+          static_assert(std::is_arithmetic<T>::value && sizeof(T) <= 15,
+            "only fundamental numeric types can be stored");
+          
+          const uint8_t kind = std::is_floating_point<T>::value ? 3 : (std::is_signed<T>::value ? 1 : 2);
+          return (uint8_t) ((kind << 4) | sizeof(T));
+        }
+        
+        static inline uint64_t align_up(const uint64_t x)
+        {
+          return (x + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+        
+        template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+        static inline header make_header(const uint64_t m, const uint64_t n,
+          const uint64_t nnz)
+        {
+          header h;
+          std::memset(&h, 0, sizeof(h));
+          
+          std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+          h.byte_order = BYTE_ORDER_MARK;
+          h.version = VERSION;
+          h.index_tag = type_tag<INDEX>();
+          h.offset_tag = type_tag<OFFSET>();
+          h.scalar_tag = type_tag<SCALAR>();
+          
+          h.m = m;
+          h.n = n;
+          h.nnz = nnz;
+          
+          h.P_offset = sizeof(header);
+          h.I_offset = align_up(h.P_offset + (n+1)*sizeof(OFFSET));
+          h.X_offset = align_up(h.I_offset + nnz*sizeof(INDEX));
+          h.file_size = align_up(h.X_offset + nnz*sizeof(SCALAR));
+          
+          return h;
+        }
+        
+        template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+        static inline void check_header(const header &h, const uint64_t size)
+        {
+          if (size < sizeof(header) || std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0)
+            throw std::runtime_error("not a spar binary matrix file");
+          if (h.byte_order != BYTE_ORDER_MARK)
+            throw std::runtime_error("spar binary file was written with a different byte order");
+          if (h.version != VERSION)
+            throw std::runtime_error("unsupported spar binary file version");
+          if (h.index_tag != type_tag<INDEX>() || h.offset_tag != type_tag<OFFSET>() || h.scalar_tag != type_tag<SCALAR>())
+            throw std::runtime_error("spar binary file INDEX/SCALAR/OFFSET types do not match the requested types");
+          
+          // bound the dimensions by the file size before computing the
+          // section lengths from them, so that nothing can overflow
+          if (h.m > (uint64_t) std::numeric_limits<INDEX>::max() ||
+            h.n > (uint64_t) std::numeric_limits<INDEX>::max() ||
+            h.nnz > (uint64_t) std::numeric_limits<OFFSET>::max() ||
+            h.n >= size / sizeof(OFFSET) || h.nnz > size / sizeof(INDEX))
+            throw std::runtime_error("spar binary file has a corrupt header");
+          
+          const header expected = make_header<INDEX, SCALAR, OFFSET>(h.m, h.n, h.nnz);
+          if (h.P_offset != expected.P_offset || h.I_offset != expected.I_offset ||
+            h.X_offset != expected.X_offset || h.file_size != expected.file_size)
+            throw std::runtime_error("spar binary file has a corrupt header");
+          
+          if (h.file_size > size)
+            throw std::runtime_error("spar binary file is truncated");
+        }
+        
+        // the first and last column pointers of a whole matrix; the others
+        // are not scanned, so that mapping a file stays free
+        template <typename OFFSET>
+        static inline void check_col_ptr(const header &h, const OFFSET *P)
+        {
+          if (P[0] != 0 || (uint64_t) P[h.n] != h.nnz)
+            throw std::runtime_error("spar binary file has corrupt column pointers");
+        }
+        
+        
+        
+        static inline void throw_errno(const std::string &what, const std::string &filename)
+        {
+          throw std::runtime_error(what + " '" + filename + "': " + std::strerror(errno));
+        }
+        
+        // write len bytes in large sequential chunks, padding to an aligned
+        // boundary afterwards
+        static inline void write_all(FILE *fp, const void *buf, const uint64_t len,
+          const std::string &filename)
+        {
+          const uint64_t CHUNK = (uint64_t) 1 << 30;
+          const char *p = (const char*) buf;
+          
+          uint64_t done = 0;
+          while (done < len)
+          {
+            const uint64_t todo = std::min(CHUNK, len - done);
+            const size_t written = fwrite(p + done, 1, todo, fp);
+            if (written != todo)
+              throw_errno("unable to write", filename);
+            
+            done += written;
+          }
+        }
+        
+        static inline void pad_to(FILE *fp, const uint64_t pos, const uint64_t target,
+          const std::string &filename)
+        {
+          static const char zeros[ALIGNMENT] = {0};
+          if (target > pos)
+            write_all(fp, zeros, target - pos, filename);
+        }
+      }
+    }
+    
+    
+    
+    /**
+      @brief Save a sparse matrix to a versioned binary file.
+      
+      The file holds a fixed-size header (dimensions, number of non-zeros, and
+      type tags for `INDEX` and `SCALAR`) followed by the column pointer, row
+      index, and data arrays, each aligned to 64 bytes. It can be memory
+      mapped by `load()` without any parsing.
+      
+      @param[in] filename Output file. It will be overwritten if it exists.
+      @param[in] x The input matrix.
+      
+      @except If the file can not be written, a `runtime_error` exception will
+      be thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET>
+    static inline void save(const std::string &filename, const spmat_view<INDEX, SCALAR, OFFSET> &x)
+    {
+      namespace bin = internal::binary;
+      
+      const uint64_t n = x.ncols();
+      const uint64_t nnz = x.get_nnz();
+      const bin::header h = bin::make_header<INDEX, SCALAR, OFFSET>(x.nrows(), n, nnz);
+      
+      const OFFSET *P = x.col_ptr();
+      const OFFSET P0 = (P == NULL) ? 0 : P[0];
+      
+      // a view of a column block can start past the beginning of its arrays
+      std::vector<OFFSET> P_shifted;
+      if (P0 != 0)
+      {
+        P_shifted.resize(n + 1);
+        for (uint64_t j=0; j<=n; j++)
+          P_shifted[j] = P[j] - P0;
+        
+        P = P_shifted.data();
+      }
+      
+      FILE *fp = fopen(filename.c_str(), "wb");
+      if (fp == NULL)
+        bin::throw_errno("unable to open", filename);
+      
+      try
+      {
+        bin::write_all(fp, &h, sizeof(h), filename);
+        
+        if (P == NULL)
+        {
+          const OFFSET zero = 0;
+          bin::write_all(fp, &zero, sizeof(zero), filename);
+        }
+        else
+          bin::write_all(fp, P, (n+1)*sizeof(OFFSET), filename);
+        bin::pad_to(fp, h.P_offset + (n+1)*sizeof(OFFSET), h.I_offset, filename);
+        
+        bin::write_all(fp, x.index_ptr() + P0, nnz*sizeof(INDEX), filename);
+        bin::pad_to(fp, h.I_offset + nnz*sizeof(INDEX), h.X_offset, filename);
+        
+        bin::write_all(fp, x.data_ptr() + P0, nnz*sizeof(SCALAR), filename);
+        bin::pad_to(fp, h.X_offset + nnz*sizeof(SCALAR), h.file_size, filename);
+      }
+      catch (...)
+      {
+        fclose(fp);
+        throw;
+      }
+      
+      if (fclose(fp) != 0)
+        bin::throw_errno("unable to write", filename);
+    }
+    
+    /// \overload
+    template <typename INDEX, typename SCALAR, typename OFFSET>
+    static inline void save(const std::string &filename, const spmat<INDEX, SCALAR, OFFSET> &x)
+    {
+      save(filename, spmat_view<INDEX, SCALAR, OFFSET>(x));
+    }
+    
+    
+    
+    /**
+      @brief A read-only sparse matrix backed by a memory-mapped binary file
+      written by `save()`. The arrays are used in place, so opening a file
+      costs nothing beyond the map itself.
+      
+      Objects of this class can be moved but not copied. Use `view()` to pass
+      the matrix to a reducer or anything else that accepts an `spmat_view`.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the type of the column pointers, `INDEX` by default.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    class mapped_spmat
+    {
+      public:
+        mapped_spmat(const std::string &filename);
+        mapped_spmat(mapped_spmat &&x);
+        mapped_spmat(const mapped_spmat &x) = delete;
+        mapped_spmat& operator=(const mapped_spmat &x) = delete;
+        ~mapped_spmat();
+        
+        /// A view of the mapped matrix.
+        spmat_view<INDEX, SCALAR, OFFSET> view() const {return v;};
+        /// Number of rows.
+        INDEX nrows() const {return v.nrows();};
+        /// Number of columns.
+        INDEX ncols() const {return v.ncols();};
+        /// Number of non-zero elements.
+        OFFSET get_nnz() const {return v.get_nnz();};
+      
+      protected:
+        /// Start of the mapped file.
+        void *map;
+        /// Size of the map in bytes.
+        uint64_t map_len;
+        /// View over the arrays inside the map.
+        spmat_view<INDEX, SCALAR, OFFSET> v;
+      
+      private:
+        void cleanup();
+    };
+    
+    
+    
+    /**
+      @brief Memory-map a binary sparse matrix file written by `save()`.
+      
+      @param[in] filename Input file.
+      
+      @return The mapped matrix.
+      
+      @allocs Nothing is allocated beyond the map itself (on systems without
+      `mmap` the file is read into memory instead).
+      
+      @except If the file can not be opened or mapped, is not a spar binary
+      file, is truncated or has a corrupt header, or was written with
+      different `INDEX`/`SCALAR`/`OFFSET` types, a `runtime_error` exception
+      will be thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the type of the column pointers, `INDEX` by default.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    static inline mapped_spmat<INDEX, SCALAR, OFFSET> load(const std::string &filename)
+    {
+      return mapped_spmat<INDEX, SCALAR, OFFSET>(filename);
+    }
+  }
+}
+
+
+
+// ----------------------------------------------------------------------------
+// constructor/destructor
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Constructor. Maps the file.
+  
+  @param[in] filename Input file written by `spar::io::save()`.
+  
+  @except If the file can not be opened or mapped, is not a spar binary file,
+  is truncated or has a corrupt header, or was written with different
+  `INDEX`/`SCALAR`/`OFFSET` types, a `runtime_error` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::io::mapped_spmat<INDEX, SCALAR, OFFSET>::mapped_spmat(const std::string &filename)
+{
+  namespace bin = internal::binary;
+  
+  map = NULL;
+  map_len = 0;
+  
+#if OS_NIX
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    bin::throw_errno("unable to open", filename);
+  
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    bin::throw_errno("unable to stat", filename);
+  }
+  
+  map_len = (uint64_t) st.st_size;
+  if (map_len < sizeof(bin::header))
+  {
+    close(fd);
+    throw std::runtime_error("not a spar binary matrix file");
+  }
+  
+  map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    map = NULL;
+    bin::throw_errno("unable to map", filename);
+  }
+  
+  madvise(map, map_len, MADV_SEQUENTIAL);
+#else
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (fp == NULL)
+    bin::throw_errno("unable to open", filename);
+  
+  fseek(fp, 0, SEEK_END);
+  map_len = (uint64_t) ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  
+  map = malloc(map_len);
+  if (map == NULL)
+  {
+    fclose(fp);
+    throw std::bad_alloc();
+  }
+  
+  const size_t nread = fread(map, 1, map_len, fp);
+  fclose(fp);
+  if (nread != map_len)
+  {
+    cleanup();
+    bin::throw_errno("unable to read", filename);
+  }
+#endif
+  
+  const bin::header *h = (const bin::header*) map;
+  try
+  {
+    bin::check_header<INDEX, SCALAR, OFFSET>(*h, map_len);
+    bin::check_col_ptr(*h, (const OFFSET*) ((const char*) map + h->P_offset));
+  }
+  catch (...)
+  {
+    cleanup();
+    throw;
+  }
+  
+  const char *base = (const char*) map;
+  v.set(h->m, h->n, (const INDEX*) (base + h->I_offset),
+    (const OFFSET*) (base + h->P_offset), (const SCALAR*) (base + h->X_offset));
+}
+
+
+
+/**
+  @brief Move constructor. The input no longer owns the map.
+  
+  @param[in] x The input.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::io::mapped_spmat<INDEX, SCALAR, OFFSET>::mapped_spmat(mapped_spmat &&x)
+{
+  map = x.map;
+  map_len = x.map_len;
+  v = x.v;
+  
+  x.map = NULL;
+  x.map_len = 0;
+  x.v = spmat_view<INDEX, SCALAR, OFFSET>();
+}
+
+
+
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::io::mapped_spmat<INDEX, SCALAR, OFFSET>::~mapped_spmat()
+{
+  cleanup();
+}
+
+
+
+// ----------------------------------------------------------------------------
+// internals
+// ----------------------------------------------------------------------------
+
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::io::mapped_spmat<INDEX, SCALAR, OFFSET>::cleanup()
+{
+  if (map == NULL)
+    return;
+  
+#if OS_NIX
+  munmap(map, map_len);
+#else
+  free(map);
+#endif
+  
+  map = NULL;
+  map_len = 0;
+}
+
+
+#endif
@@ -0,0 +1,317 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_IO_MPI_H
+#define SPAR_IO_MPI_H
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../core/fwd.hpp"
+#include "../mpi/mpi.hpp"
+#include "binary.hpp"
+
+
+namespace spar
+{
+  namespace io
+  {
+    namespace internal
+    {
+      namespace mpiio
+      {
+        // largest number of bytes moved by a single MPI-IO call
+        static const uint64_t CHUNK_BYTES = (uint64_t) 1 << 30;
+        
+        static inline MPI_File open(const std::string &filename, const int amode,
+          MPI_Comm comm)
+        {
+          MPI_File fh;
+          int ret = MPI_File_open(comm, filename.c_str(), amode, MPI_INFO_NULL, &fh);
+          spar::mpi::err::check_ret(ret);
+          return fh;
+        }
+        
+        static inline void close(MPI_File *fh)
+        {
+          int ret = MPI_File_close(fh);
+          spar::mpi::err::check_ret(ret);
+        }
+        
+        // collective read/write of an arbitrarily large contiguous region; the
+        // number of rounds is agreed on so that every rank makes the same
+        // number of collective calls
+        template <typename T>
+        static inline void rw_at_all(const bool write, MPI_File fh,
+          const uint64_t offset, T *buf, const uint64_t count, MPI_Comm comm)
+        {
+          const uint64_t bytes = count * sizeof(T);
+          uint64_t rounds = (bytes + CHUNK_BYTES - 1) / CHUNK_BYTES;
+          spar::mpi::reduce(spar::mpi::REDUCE_TO_ALL, MPI_IN_PLACE, &rounds, 1, MPI_MAX, comm);
+          
+          char *p = (char*) buf;
+          uint64_t done = 0;
+          for (uint64_t r=0; r<rounds; r++)
+          {
+            const int len = (int) std::min(CHUNK_BYTES, bytes - done);
+            const MPI_Offset off = (MPI_Offset) (offset + done);
+            
+            int ret;
+            if (write)
+              ret = MPI_File_write_at_all(fh, off, p + done, len, MPI_BYTE, MPI_STATUS_IGNORE);
+            else
+              ret = MPI_File_read_at_all(fh, off, p + done, len, MPI_BYTE, MPI_STATUS_IGNORE);
+            
+            spar::mpi::err::check_ret(ret);
+            done += len;
+          }
+        }
+        
+        // every rank learns whether any rank failed a check, so that they
+        // all close the file and throw instead of some of them going on to
+        // the next collective
+        static inline void agree(const bool bad, MPI_File *fh, const char *msg,
+          MPI_Comm comm)
+        {
+          int any_bad = (int) bad;
+          spar::mpi::reduce(spar::mpi::REDUCE_TO_ALL, MPI_IN_PLACE, &any_bad, 1, MPI_LOR, comm);
+          if (any_bad)
+          {
+            MPI_File_close(fh);
+            throw std::runtime_error(msg);
+          }
+        }
+        
+        template <typename INDEX, typename SCALAR, typename OFFSET>
+        static inline binary::header read_header(MPI_File fh, MPI_Comm comm)
+        {
+          MPI_Offset size;
+          int ret = MPI_File_get_size(fh, &size);
+          spar::mpi::err::check_ret(ret);
+          
+          binary::header h;
+          const uint64_t count = (size < (MPI_Offset) sizeof(h)) ? 0 : sizeof(h);
+          rw_at_all(false, fh, 0, (char*) &h, count, comm);
+          
+          binary::check_header<INDEX, SCALAR, OFFSET>(h, (uint64_t) size);
+          return h;
+        }
+      }
+    }
+    
+    
+    
+    /**
+      @brief Collectively read a block of columns of a binary sparse matrix
+      file written by `save()` or `write_cols()`. Each rank reads only its own
+      piece of the file.
+      
+      @param[in] filename Input file.
+      @param[in] col_start First column (zero-based) this rank reads.
+      @param[in] ncols Number of columns this rank reads.
+      @param[in] comm MPI communicator. Every rank must call the function.
+      
+      @return The requested columns, as an `nrows x ncols` sparse matrix.
+      
+      @comm A handful of small collectives, plus collective reads of the
+      header, the column pointers, and the row/data arrays of the block.
+      
+      @except If the file can not be opened, is not a spar binary file or is
+      corrupt, was written with different `INDEX`/`SCALAR`/`OFFSET` types, or
+      the requested columns are out of range on any rank, a `runtime_error`
+      exception will be thrown on every rank. If a memory allocation fails, a
+      `bad_alloc` exception will be thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the type of the column pointers, `INDEX` by default.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    static inline spmat<INDEX, SCALAR, OFFSET> read_cols(const std::string &filename,
+      const INDEX col_start, const INDEX ncols, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      namespace bin = internal::binary;
+      namespace mpiio = internal::mpiio;
+      
+      MPI_File fh = mpiio::open(filename, MPI_MODE_RDONLY, comm);
+      
+      // every rank reads the same header, so they all throw or none does
+      bin::header h;
+      try
+      {
+        h = mpiio::read_header<INDEX, SCALAR, OFFSET>(fh, comm);
+      }
+      catch (...)
+      {
+        MPI_File_close(&fh);
+        throw;
+      }
+      
+      // negative values wrap around to huge ones
+      const bool bad_range = ((uint64_t) col_start > h.n || (uint64_t) ncols > h.n - (uint64_t) col_start);
+      mpiio::agree(bad_range, &fh, "requested columns are out of range", comm);
+      
+      std::vector<OFFSET> P(ncols + 1);
+      mpiio::rw_at_all(false, fh, h.P_offset + col_start*sizeof(OFFSET), P.data(), ncols + 1, comm);
+      
+      bool bad_P = ((uint64_t) P[0] > h.nnz || (uint64_t) P[ncols] > h.nnz);
+      for (INDEX j=0; j<ncols && !bad_P; j++)
+        bad_P = (P[j + 1] < P[j]);
+      mpiio::agree(bad_P, &fh, "spar binary file has corrupt column pointers", comm);
+      
+      const OFFSET P0 = P[0];
+      const OFFSET nnz = P[ncols] - P0;
+      
+      spmat<INDEX, SCALAR, OFFSET> x(h.m, ncols, nnz);
+      mpiio::rw_at_all(false, fh, h.I_offset + P0*sizeof(INDEX), x.index_ptr(), nnz, comm);
+      mpiio::rw_at_all(false, fh, h.X_offset + P0*sizeof(SCALAR), x.data_ptr(), nnz, comm);
+      mpiio::close(&fh);
+      
+      OFFSET *xP = x.col_ptr();
+      for (INDEX j=0; j<=ncols; j++)
+        xP[j] = P[j] - P0;
+      
+      // not update_nnz(), which stops at the first explicit zero
+      x.update_nnz(nnz);
+      return x;
+    }
+    
+    /**
+      @brief \overload
+      
+      The columns are split into contiguous blocks as evenly as possible,
+      with rank `r` of `p` getting block `r`.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    static inline spmat<INDEX, SCALAR, OFFSET> read_cols(const std::string &filename,
+      MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      namespace mpiio = internal::mpiio;
+      
+      MPI_File fh = mpiio::open(filename, MPI_MODE_RDONLY, comm);
+      
+      internal::binary::header h;
+      try
+      {
+        h = mpiio::read_header<INDEX, SCALAR, OFFSET>(fh, comm);
+      }
+      catch (...)
+      {
+        MPI_File_close(&fh);
+        throw;
+      }
+      mpiio::close(&fh);
+      
+      const uint64_t rank = spar::mpi::get_rank(comm);
+      const uint64_t size = spar::mpi::get_size(comm);
+      const uint64_t start = h.n * rank / size;
+      const uint64_t end = h.n * (rank + 1) / size;
+      
+      return read_cols<INDEX, SCALAR, OFFSET>(filename, start, end - start, comm);
+    }
+    
+    
+    
+    /**
+      @brief Collectively write one sparse matrix into a binary file, where
+      each rank holds a contiguous block of its columns. Blocks are laid out
+      in rank order, so rank 0 holds the first columns. The file can be read
+      back with `load()` or `read_cols()`.
+      
+      The blocks must be disjoint pieces of one matrix. There is no layout
+      for every rank's full, unreduced contribution in a single file; reduce
+      first, then write blocks of the result.
+      
+      @param[in] filename Output file. It will be overwritten if it exists.
+      @param[in] x This rank's column block. Every rank must have the same
+      number of rows. A view of a block of a larger matrix (for example of
+      an allreduced result) is fine.
+      @param[in] comm MPI communicator. Every rank must call the function.
+      
+      @comm A few small collectives, including exclusive scans over the
+      number of columns and non-zeros to find each rank's file offsets, plus
+      collective writes of the column pointers, row indices, and data.
+      
+      @except If the file can not be written, or the number of rows differs
+      across ranks, a `runtime_error` exception will be thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET>
+    static inline void write_cols(const std::string &filename,
+      const spmat_view<INDEX, SCALAR, OFFSET> &x, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      namespace bin = internal::binary;
+      namespace mpiio = internal::mpiio;
+      
+      const int rank = spar::mpi::get_rank(comm);
+      const bool last = (rank == spar::mpi::get_size(comm) - 1);
+      const OFFSET *xP = x.col_ptr();
+      const uint64_t n_local = x.ncols();
+      const OFFSET P0 = (xP == NULL) ? 0 : xP[0];
+      
+      uint64_t m_minmax[2] = {(uint64_t) x.nrows(), ~(uint64_t) x.nrows()};
+      spar::mpi::reduce(spar::mpi::REDUCE_TO_ALL, MPI_IN_PLACE, m_minmax, 2, MPI_MAX, comm);
+      if (m_minmax[0] != (uint64_t) x.nrows() || ~m_minmax[1] != (uint64_t) x.nrows())
+        throw std::runtime_error("all column blocks must have the same number of rows");
+      
+      uint64_t local[2] = {n_local, (uint64_t) x.get_nnz()};
+      uint64_t global[2];
+      uint64_t offsets[2];
+      spar::mpi::reduce(spar::mpi::REDUCE_TO_ALL, local, global, 2, MPI_SUM, comm);
+      spar::mpi::exscan(local, offsets, 2, MPI_SUM, comm);
+      
+      const uint64_t col_offset = offsets[0];
+      const uint64_t nnz_offset = offsets[1];
+      
+      const bin::header h = bin::make_header<INDEX, SCALAR, OFFSET>(x.nrows(), global[0], global[1]);
+      
+      // global column pointers; the last rank also writes the closing one
+      std::vector<OFFSET> P(n_local + last);
+      for (uint64_t j=0; j<n_local; j++)
+        P[j] = (OFFSET) (nnz_offset + (xP[j] - P0));
+      if (last)
+        P[n_local] = (OFFSET) global[1];
+      
+      if (rank == 0)
+        MPI_File_delete(filename.c_str(), MPI_INFO_NULL);
+      spar::mpi::barrier(comm);
+      
+      MPI_File fh = mpiio::open(filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, comm);
+      
+      int ret = MPI_File_set_size(fh, (MPI_Offset) h.file_size);
+      spar::mpi::err::check_ret(ret);
+      
+      const uint64_t header_count = (rank == 0) ? sizeof(h) : 0;
+      mpiio::rw_at_all(true, fh, 0, (char*) &h, header_count, comm);
+      
+      mpiio::rw_at_all(true, fh, h.P_offset + col_offset*sizeof(OFFSET), P.data(), P.size(), comm);
+      mpiio::rw_at_all(true, fh, h.I_offset + nnz_offset*sizeof(INDEX),
+        (INDEX*) x.index_ptr() + P0, local[1], comm);
+      mpiio::rw_at_all(true, fh, h.X_offset + nnz_offset*sizeof(SCALAR),
+        (SCALAR*) x.data_ptr() + P0, local[1], comm);
+      
+      mpiio::close(&fh);
+    }
+    
+    /// \overload
+    template <typename INDEX, typename SCALAR, typename OFFSET>
+    static inline void write_cols(const std::string &filename,
+      const spmat<INDEX, SCALAR, OFFSET> &x, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      write_cols(filename, spmat_view<INDEX, SCALAR, OFFSET>(x), comm);
+    }
+  }
+}
+
+
+#endif
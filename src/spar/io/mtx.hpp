@@ -0,0 +1,570 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_IO_MTX_H
+#define SPAR_IO_MTX_H
+#pragma once
+
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../core/fwd.hpp"
+#include "../core/par.hpp"
+#include "../gen/platform.h"
+#include "binary.hpp"
+
+#if OS_NIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace spar
+{
+  namespace io
+  {
+    namespace internal
+    {
+      namespace mtx
+      {
+        enum symmetry_t {GENERAL, SYMMETRIC, SKEW_SYMMETRIC};
+        
+        struct banner
+        {
+          bool pattern;
+          symmetry_t symmetry;
+        };
+        
+        
+        
+        // read-only view of a whole file; mapped where possible
+        class file_map
+        {
+          public:
+            file_map(const std::string &filename)
+            {
+              buf = NULL;
+              len = 0;
+              
+#if OS_NIX
+              int fd = open(filename.c_str(), O_RDONLY);
+              if (fd < 0)
+                binary::throw_errno("unable to open", filename);
+              
+              struct stat st;
+              if (fstat(fd, &st) != 0)
+              {
+                close(fd);
+                binary::throw_errno("unable to stat", filename);
+              }
+              
+              len = (uint64_t) st.st_size;
+              if (len == 0)
+              {
+                close(fd);
+                throw std::runtime_error("not a Matrix Market file");
+              }
+              
+              void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+              close(fd);
+              if (map == MAP_FAILED)
+                binary::throw_errno("unable to map", filename);
+              
+              madvise(map, len, MADV_SEQUENTIAL);
+              buf = (const char*) map;
+#else
+              FILE *fp = fopen(filename.c_str(), "rb");
+              if (fp == NULL)
+                binary::throw_errno("unable to open", filename);
+              
+              fseek(fp, 0, SEEK_END);
+              len = (uint64_t) ftell(fp);
+              fseek(fp, 0, SEEK_SET);
+              
+              char *b = (char*) malloc(len + 1);
+              if (b == NULL)
+              {
+                fclose(fp);
+                throw std::bad_alloc();
+              }
+              
+              const size_t nread = fread(b, 1, len, fp);
+              fclose(fp);
+              b[len] = '\0';
+              buf = b;
+              if (nread != len)
+              {
+                cleanup();
+                binary::throw_errno("unable to read", filename);
+              }
+#endif
+            }
+            
+            file_map(const file_map &x) = delete;
+            file_map& operator=(const file_map &x) = delete;
+            ~file_map() {cleanup();};
+            
+            const char* begin() const {return buf;};
+            const char* end() const {return buf + len;};
+          
+          private:
+            const char *buf;
+            uint64_t len;
+            
+            void cleanup()
+            {
+              if (buf == NULL)
+                return;
+                
+#if OS_NIX
+              munmap((void*) buf, len);
+#else
+              free((void*) buf);
+#endif
+              buf = NULL;
+            }
+        };
+        
+        
+        
+        static inline const char* line_end(const char *p, const char *end)
+        {
+          const char *eol = (const char*) memchr(p, '\n', end - p);
+          return (eol == NULL) ? end : eol;
+        }
+        
+        static inline const char* skip_blanks(const char *p, const char *eol)
+        {
+          while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+          return p;
+        }
+        
+        // blank lines and comments carry no entry
+        static inline bool is_data_line(const char *p, const char *eol)
+        {
+          p = skip_blanks(p, eol);
+          return (p < eol && *p != '%');
+        }
+        
+        static inline bool parse_uint(const char *&p, const char *eol, uint64_t &x)
+        {
+          p = skip_blanks(p, eol);
+          if (p == eol || !isdigit((unsigned char) *p))
+            return false;
+          
+          x = 0;
+          while (p < eol && isdigit((unsigned char) *p))
+          {
+            x = 10*x + (*p - '0');
+            p++;
+          }
+          
+          return true;
+        }
+        
+        // parse "i j [x]" (1-based indices); eol must point at a character
+        // that ends a number, like the newline
+        template <typename SCALAR>
+        static inline bool parse_entry(const char *p, const char *eol,
+          const bool pattern, uint64_t &i, uint64_t &j, SCALAR &x)
+        {
+          if (!parse_uint(p, eol, i) || !parse_uint(p, eol, j))
+            return false;
+          
+          if (pattern)
+          {
+            x = (SCALAR) 1;
+            return true;
+          }
+          
+          p = skip_blanks(p, eol);
+          if (p == eol)
+            return false;
+          
+          char *num_end;
+          const double d = strtod(p, &num_end);
+          if (num_end == p)
+            return false;
+          
+          x = (SCALAR) d;
+          return true;
+        }
+        
+        static inline std::vector<std::string> split_words(const char *p, const char *eol)
+        {
+          std::vector<std::string> words;
+          while (true)
+          {
+            p = skip_blanks(p, eol);
+            if (p == eol)
+              break;
+            
+            const char *start = p;
+            while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+              p++;
+            
+            std::string w(start, p);
+            for (char &c : w)
+              c = (char) tolower((unsigned char) c);
+            
+            words.push_back(w);
+          }
+          
+          return words;
+        }
+        
+        static inline banner read_banner(const char *p, const char *eol)
+        {
+          std::vector<std::string> w = split_words(p, eol);
+          if (w.size() != 5 || w[0] != "%%matrixmarket" || w[1] != "matrix")
+            throw std::runtime_error("not a Matrix Market file");
+          
+          if (w[2] != "coordinate")
+            throw std::runtime_error("only coordinate Matrix Market files are supported");
+          
+          banner b;
+          if (w[3] == "pattern")
+            b.pattern = true;
+          else if (w[3] == "real" || w[3] == "double" || w[3] == "integer")
+            b.pattern = false;
+          else
+            throw std::runtime_error("unsupported Matrix Market field '" + w[3] + "'");
+          
+          if (w[4] == "general")
+            b.symmetry = GENERAL;
+          else if (w[4] == "symmetric" || w[4] == "hermitian")
+            b.symmetry = SYMMETRIC;
+          else if (w[4] == "skew-symmetric")
+            b.symmetry = SKEW_SYMMETRIC;
+          else
+            throw std::runtime_error("unsupported Matrix Market symmetry '" + w[4] + "'");
+          
+          return b;
+        }
+        
+        
+        
+        template <typename SCALAR>
+        static inline int format_entry(char *buf, const size_t len,
+          const uint64_t i, const uint64_t j, const SCALAR x)
+        {
+          if (std::is_floating_point<SCALAR>::value)
+          {
+            return snprintf(buf, len, "%llu %llu %.*g\n", (unsigned long long) i,
+              (unsigned long long) j, std::numeric_limits<SCALAR>::max_digits10,
+              (double) x);
+          }
+          else if (std::is_signed<SCALAR>::value)
+          {
+            return snprintf(buf, len, "%llu %llu %lld\n", (unsigned long long) i,
+              (unsigned long long) j, (long long) x);
+          }
+          else
+          {
+            return snprintf(buf, len, "%llu %llu %llu\n", (unsigned long long) i,
+              (unsigned long long) j, (unsigned long long) x);
+          }
+        }
+      }
+    }
+    
+    
+    
+    /**
+      @brief Read a Matrix Market file into a sparse matrix.
+      
+      The file is memory-mapped and its entries are parsed in parallel over
+      OpenMP threads, then assembled with `spmat::from_triplets()`.
+      
+      Only the `coordinate` format is supported, with `real`, `integer`, or
+      `pattern` fields (pattern entries are read as 1), and `general`,
+      `symmetric`, or `skew-symmetric` symmetry. Symmetric files are expanded
+      to both triangles. Duplicate entries are summed, and explicit zeros are
+      dropped.
+      
+      @param[in] filename Input file.
+      
+      @return The matrix.
+      
+      @except If the file can not be read, is not a supported Matrix Market
+      file, or is malformed, or if its dimensions do not fit in `INDEX` (or
+      its number of entries in `OFFSET`), a
+      `runtime_error` exception will be thrown. If a memory allocation fails,
+      a `bad_alloc` exception will be thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the result, `INDEX` by
+      default.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    static inline spmat<INDEX, SCALAR, OFFSET> read_mtx(const std::string &filename)
+    {
+      namespace mm = internal::mtx;
+      
+      mm::file_map f(filename);
+      const char *p = f.begin();
+      const char *end = f.end();
+      
+      const char *eol = mm::line_end(p, end);
+      const mm::banner b = mm::read_banner(p, eol);
+      if (b.symmetry == mm::SKEW_SYMMETRIC && !std::is_signed<SCALAR>::value)
+        throw std::runtime_error("skew-symmetric Matrix Market files need a signed SCALAR type");
+      
+      // size line
+      do
+      {
+        if (eol == end)
+          throw std::runtime_error("Matrix Market file has no size line");
+        
+        p = eol + 1;
+        eol = mm::line_end(p, end);
+      } while (!mm::is_data_line(p, eol));
+      
+      uint64_t m, n, nnz;
+      const char *q = p;
+      if (!mm::parse_uint(q, eol, m) || !mm::parse_uint(q, eol, n) || !mm::parse_uint(q, eol, nnz))
+        throw std::runtime_error("malformed Matrix Market size line");
+      
+      const uint64_t index_max = (uint64_t) std::numeric_limits<INDEX>::max();
+      const uint64_t offset_max = (uint64_t) std::numeric_limits<OFFSET>::max();
+      const uint64_t max_entries = (b.symmetry == mm::GENERAL) ? nnz : 2*nnz;
+      if (m > index_max || n >= index_max)
+        throw std::runtime_error("Matrix Market matrix is too large for INDEX type");
+      if (max_entries > offset_max)
+        throw std::runtime_error("Matrix Market matrix has too many entries for OFFSET type");
+      
+      // split the body into chunks starting on line boundaries
+      const char *body = (eol == end) ? end : eol + 1;
+      const int nchunks = spar::internal::par::num_threads();
+      std::vector<const char*> chunk(nchunks + 1);
+      chunk[0] = body;
+      chunk[nchunks] = end;
+      for (int c=1; c<nchunks; c++)
+      {
+        const char *s = body + (uint64_t) (end - body) * c / nchunks;
+        s = std::max(s, chunk[c - 1]);
+        if (s > body && s < end && *(s - 1) != '\n')
+        {
+          s = mm::line_end(s, end);
+          if (s < end)
+            s++;
+        }
+        
+        chunk[c] = s;
+      }
+      
+      std::vector<uint64_t> offset(nchunks + 1, 0);
+      std::vector<uint64_t> offdiag(nchunks + 1, 0);
+      std::vector<int> bad(nchunks, 0);
+      
+      #pragma omp parallel for schedule(static, 1)
+      for (int c=0; c<nchunks; c++)
+      {
+        uint64_t lines = 0;
+        for (const char *s=chunk[c]; s<chunk[c + 1]; )
+        {
+          const char *e = mm::line_end(s, end);
+          if (mm::is_data_line(s, e))
+            lines++;
+          s = (e == end) ? end : e + 1;
+        }
+        
+        offset[c + 1] = lines;
+      }
+      
+      for (int c=0; c<nchunks; c++)
+        offset[c + 1] += offset[c];
+      
+      if (offset[nchunks] != nnz)
+        throw std::runtime_error("number of Matrix Market entries does not match the size line");
+      
+      std::vector<INDEX> rows(nnz);
+      std::vector<INDEX> cols(nnz);
+      std::vector<SCALAR> vals(nnz);
+      
+      #pragma omp parallel for schedule(static, 1)
+      for (int c=0; c<nchunks; c++)
+      {
+        uint64_t k = offset[c];
+        uint64_t c_offdiag = 0;
+        for (const char *s=chunk[c]; s<chunk[c + 1]; )
+        {
+          const char *e = mm::line_end(s, end);
+          if (mm::is_data_line(s, e))
+          {
+            uint64_t i, j;
+            SCALAR x;
+            bool ok;
+            if (e == end)
+            {
+              // the last line has no newline to stop the number parser
+              const std::string last(s, e);
+              ok = mm::parse_entry(last.c_str(), last.c_str() + last.size(), b.pattern, i, j, x);
+            }
+            else
+              ok = mm::parse_entry(s, e, b.pattern, i, j, x);
+            
+            if (!ok || i < 1 || i > m || j < 1 || j > n)
+            {
+              bad[c] = 1;
+              break;
+            }
+            
+            rows[k] = (INDEX) (i - 1);
+            cols[k] = (INDEX) (j - 1);
+            vals[k] = x;
+            if (i != j)
+              c_offdiag++;
+            
+            k++;
+          }
+          
+          s = (e == end) ? end : e + 1;
+        }
+        
+        offdiag[c + 1] = c_offdiag;
+      }
+      
+      if (std::find(bad.begin(), bad.end(), 1) != bad.end())
+        throw std::runtime_error("malformed Matrix Market entry");
+      
+      uint64_t count = nnz;
+      if (b.symmetry != mm::GENERAL)
+      {
+        for (int c=0; c<nchunks; c++)
+          offdiag[c + 1] += offdiag[c];
+        
+        count += offdiag[nchunks];
+        rows.resize(count);
+        cols.resize(count);
+        vals.resize(count);
+        
+        const bool skew = (b.symmetry == mm::SKEW_SYMMETRIC);
+        
+        #pragma omp parallel for schedule(static, 1)
+        for (int c=0; c<nchunks; c++)
+        {
+          uint64_t mirror = nnz + offdiag[c];
+          for (uint64_t k=offset[c]; k<offset[c + 1]; k++)
+          {
+            if (rows[k] == cols[k])
+              continue;
+            
+            rows[mirror] = cols[k];
+            cols[mirror] = rows[k];
+            vals[mirror] = skew ? -vals[k] : vals[k];
+            mirror++;
+          }
+        }
+      }
+      
+      return spmat<INDEX, SCALAR, OFFSET>::from_triplets(m, n, count, rows.data(),
+        cols.data(), vals.data());
+    }
+    
+    
+    
+    /**
+      @brief Write a sparse matrix to a Matrix Market file, in the general
+      coordinate format. The field is `integer` for integral `SCALAR` types
+      and `real` otherwise.
+      
+      The entries are formatted in parallel over OpenMP threads, each taking
+      a contiguous block of columns, and then written in order.
+      
+      @param[in] filename Output file. It will be overwritten if it exists.
+      @param[in] x The input matrix.
+      
+      @except If the file can not be written, a `runtime_error` exception will
+      be thrown. If a memory allocation fails, a `bad_alloc` exception will be
+      thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET>
+    static inline void write_mtx(const std::string &filename, const spmat_view<INDEX, SCALAR, OFFSET> &x)
+    {
+      namespace mm = internal::mtx;
+      
+      const uint64_t n = x.ncols();
+      const INDEX *I = x.index_ptr();
+      const OFFSET *P = x.col_ptr();
+      const SCALAR *X = x.data_ptr();
+      
+      const int nchunks = spar::internal::par::num_threads();
+      std::vector<std::string> text(nchunks);
+      
+      #pragma omp parallel for schedule(static, 1)
+      for (int c=0; c<nchunks; c++)
+      {
+        const uint64_t first = n * c / nchunks;
+        const uint64_t last = n * (c + 1) / nchunks;
+        
+        char buf[96];
+        std::string &s = text[c];
+        for (uint64_t j=first; j<last; j++)
+        {
+          for (OFFSET ind=P[j]; ind<P[j + 1]; ind++)
+          {
+            const int len = mm::format_entry(buf, sizeof(buf), (uint64_t) I[ind] + 1, j + 1, X[ind]);
+            s.append(buf, len);
+          }
+        }
+      }
+      
+      FILE *fp = fopen(filename.c_str(), "wb");
+      if (fp == NULL)
+        internal::binary::throw_errno("unable to open", filename);
+      
+      try
+      {
+        const char *field = std::is_integral<SCALAR>::value ? "integer" : "real";
+        char header[160];
+        const int len = snprintf(header, sizeof(header),
+          "%%%%MatrixMarket matrix coordinate %s general\n%llu %llu %llu\n", field,
+          (unsigned long long) x.nrows(), (unsigned long long) n,
+          (unsigned long long) x.get_nnz());
+        
+        internal::binary::write_all(fp, header, len, filename);
+        for (int c=0; c<nchunks; c++)
+          internal::binary::write_all(fp, text[c].data(), text[c].size(), filename);
+      }
+      catch (...)
+      {
+        fclose(fp);
+        throw;
+      }
+      
+      if (fclose(fp) != 0)
+        internal::binary::throw_errno("unable to write", filename);
+    }
+    
+    /// \overload
+    template <typename INDEX, typename SCALAR, typename OFFSET>
+    static inline void write_mtx(const std::string &filename, const spmat<INDEX, SCALAR, OFFSET> &x)
+    {
+      write_mtx(filename, spmat_view<INDEX, SCALAR, OFFSET>(x));
+    }
+  }
+}
+
+
+#endif
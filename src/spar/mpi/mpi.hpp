@@ -7,6 +7,11 @@
 #pragma once
 
 
+#include <algorithm>
+#include <climits>
+#include <type_traits>
+#include <vector>
+
 #include "defs.hpp"
 #include "err.hpp"
 #include "utils.hpp"
@@ -54,71 +59,475 @@ namespace spar
     
     
     
+    static inline MPI_Comm comm_dup(MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      MPI_Comm dup;
+      int ret = MPI_Comm_dup(comm, &dup);
+      err::check_ret(ret);
+      return dup;
+    }
+    
+    static inline void comm_free(MPI_Comm *comm)
+    {
+      int ret = MPI_Comm_free(comm);
+      err::check_ret(ret);
+    }
+    
+    // the thread support level MPI was initialized with
+    static inline int query_thread()
+    {
+      int provided;
+      int ret = MPI_Query_thread(&provided);
+      err::check_ret(ret);
+      return provided;
+    }
+    
+    
+    
+    /**
+      @brief Make a user scalar type usable with the wrappers and reducers,
+      e.g. a fixed-size struct or a 16-bit float storage type. The type is
+      sent as `sizeof(T)` contiguous bytes (a committed derived datatype),
+      and summed elementwise with its `operator+`.
+      
+      Types with a fixed C mapping (including `std::complex`) need no
+      registration. Registering a type twice does nothing. Call this after
+      `MPI_Init()`, and `unregister_type()` before `MPI_Finalize()`.
+      
+      @except If something goes wrong with any of the MPI operations, a
+      `runtime_error` exception will be thrown.
+      
+      @tparam T A trivially copyable type with `operator+`.
+     */
+    template <typename T>
+    void register_type()
+    {
+      static_assert(!utils::type_traits<T>::builtin, "the type already has an MPI datatype");
+      static_assert(std::is_trivially_copyable<T>::value, "registered types must be trivially copyable");
+      
+      if (utils::custom_type<T>::datatype() != MPI_DATATYPE_NULL)
+        return;
+      
+      MPI_Datatype datatype;
+      int ret = MPI_Type_contiguous((int) sizeof(T), MPI_BYTE, &datatype);
+      err::check_ret(ret);
+      ret = MPI_Type_commit(&datatype);
+      err::check_ret(ret);
+      
+      MPI_Op op;
+      ret = MPI_Op_create(utils::sum_fn<T>, 1, &op);
+      if (ret != MPI_SUCCESS)
+        MPI_Type_free(&datatype);
+      err::check_ret(ret);
+      
+      utils::custom_type<T>::datatype() = datatype;
+      utils::custom_type<T>::sum() = op;
+      utils::custom_type<T>::owned() = true;
+    }
+    
+    /**
+      @brief \overload
+      
+      @param[in] datatype A committed datatype describing one `T`, for example
+      an `MPI_Type_create_struct` that is portable across heterogeneous
+      systems. It stays owned by the caller.
+      @param[in] sum A commutative operation summing two arrays of `T`, or
+      `MPI_OP_NULL` if the type will never be reduced. It stays owned by the
+      caller.
+     */
+    template <typename T>
+    void register_type(MPI_Datatype datatype, MPI_Op sum)
+    {
+      static_assert(!utils::type_traits<T>::builtin, "the type already has an MPI datatype");
+      
+      utils::custom_type<T>::datatype() = datatype;
+      utils::custom_type<T>::sum() = sum;
+      utils::custom_type<T>::owned() = false;
+    }
+    
+    /// Forget a registered type, freeing its handles if spar created them.
+    template <typename T>
+    void unregister_type()
+    {
+      MPI_Datatype &datatype = utils::custom_type<T>::datatype();
+      MPI_Op &op = utils::custom_type<T>::sum();
+      
+      if (utils::custom_type<T>::owned())
+      {
+        if (datatype != MPI_DATATYPE_NULL)
+          MPI_Type_free(&datatype);
+        if (op != MPI_OP_NULL)
+          MPI_Op_free(&op);
+      }
+      
+      datatype = MPI_DATATYPE_NULL;
+      op = MPI_OP_NULL;
+      utils::custom_type<T>::owned() = false;
+    }
+    
+    
+    
+    // Large-count fallbacks. MPI before version 4 only takes int counts and
+    // displacements, so anything bigger is split into pieces of at most
+    // `chunk` elements. The chunk size is a parameter so the splitting can be
+    // exercised without allocating 2^31 elements.
+    namespace utils
+    {
+      static const MPI_Count MAX_COUNT = INT_MAX;
+      
+      // tag of the point-to-point messages of gatherv_chunked() to a root
+      static const int CHUNK_TAG = 7411;
+      
+      // tag of the messages of sendrecv()
+      static const int SENDRECV_TAG = 7412;
+      
+      // true if every block, and the end of the receive buffer, is
+      // addressable with int counts and displacements
+      static inline bool fits_int(const int size, const MPI_Count *counts,
+        const MPI_Aint *displs)
+      {
+        for (int i=0; i<size; i++)
+        {
+          if (counts[i] > MAX_COUNT || (MPI_Count) displs[i] + counts[i] > MAX_COUNT)
+            return false;
+        }
+        
+        return true;
+      }
+      
+      template <typename T>
+      static inline void reduce_chunked(int root, void *sendbuf, T *recvbuf,
+        MPI_Count count, MPI_Op op, MPI_Comm comm, const MPI_Count chunk)
+      {
+        const MPI_Datatype mpi_type = mpi_type_lookup<T>();
+        const bool in_place = (sendbuf == MPI_IN_PLACE);
+        
+        for (MPI_Count i=0; i<count; i+=chunk)
+        {
+          const int len = (int) std::min(chunk, count - i);
+          void *s = in_place ? MPI_IN_PLACE : (void*) ((T*) sendbuf + i);
+          T *r = (recvbuf == NULL) ? NULL : recvbuf + i;
+          
+          int ret;
+          if (root == REDUCE_TO_ALL)
+            ret = MPI_Allreduce(s, r, len, mpi_type, op, comm);
+          else
+            ret = MPI_Reduce(s, r, len, mpi_type, op, root, comm);
+          
+          err::check_ret(ret);
+        }
+      }
+      
+      template <typename T>
+      static inline void bcast_chunked(int root, T *buf, MPI_Count count,
+        MPI_Comm comm, const MPI_Count chunk)
+      {
+        const MPI_Datatype mpi_type = mpi_type_lookup<T>();
+        
+        for (MPI_Count i=0; i<count; i+=chunk)
+        {
+          const int len = (int) std::min(chunk, count - i);
+          int ret = MPI_Bcast(buf + i, len, mpi_type, root, comm);
+          err::check_ret(ret);
+        }
+      }
+      
+      // An allgatherv is one (chunked) broadcast per rank. A gatherv to a root
+      // is chunked point-to-point, received in rank order.
+      template <typename S, typename T>
+      static inline void gatherv_chunked(int root, const S *sendbuf,
+        MPI_Count sendcount, T *recvbuf, const MPI_Count *recvcounts,
+        const MPI_Aint *displs, MPI_Comm comm, const MPI_Count chunk)
+      {
+        const int rank = get_rank(comm);
+        const int size = get_size(comm);
+        const bool receiving = (root == REDUCE_TO_ALL || root == rank);
+        
+        if (receiving)
+        {
+          T *own = recvbuf + displs[rank];
+          for (MPI_Count k=0; k<sendcount; k++)
+            own[k] = (T) sendbuf[k];
+        }
+        
+        if (root == REDUCE_TO_ALL)
+        {
+          for (int i=0; i<size; i++)
+            bcast_chunked(i, recvbuf + displs[i], recvcounts[i], comm, chunk);
+          
+          return;
+        }
+        
+        if (rank == root)
+        {
+          const MPI_Datatype mpi_type_recv = mpi_type_lookup<T>();
+          
+          for (int i=0; i<size; i++)
+          {
+            if (i == root)
+              continue;
+            
+            for (MPI_Count k=0; k<recvcounts[i]; k+=chunk)
+            {
+              const int len = (int) std::min(chunk, recvcounts[i] - k);
+              int ret = MPI_Recv(recvbuf + displs[i] + k, len, mpi_type_recv, i,
+                CHUNK_TAG, comm, MPI_STATUS_IGNORE);
+              err::check_ret(ret);
+            }
+          }
+        }
+        else
+        {
+          const MPI_Datatype mpi_type_send = mpi_type_lookup<S>();
+          
+          for (MPI_Count k=0; k<sendcount; k+=chunk)
+          {
+            const int len = (int) std::min(chunk, sendcount - k);
+            int ret = MPI_Send(sendbuf + k, len, mpi_type_send, root, CHUNK_TAG, comm);
+            err::check_ret(ret);
+          }
+        }
+      }
+    }
+    
+    
+    
+    /**
+      @brief (All)reduce of `count` elements. Counts above `INT_MAX` use
+      `MPI_Allreduce_c`/`MPI_Reduce_c` with MPI 4, and are otherwise split
+      into several reductions.
+     */
     template <typename T>
-    void reduce(int root, void *sendbuf, T *recvbuf, int count, MPI_Op op,
+    void reduce(int root, void *sendbuf, T *recvbuf, MPI_Count count, MPI_Op op,
       MPI_Comm comm=MPI_COMM_WORLD)
     {
       int ret;
       
-      const MPI_Datatype mpi_type = utils::mpi_type_lookup(*recvbuf);
+      const MPI_Datatype mpi_type = utils::mpi_type_lookup<T>();
+      
+      if (count > utils::MAX_COUNT)
+      {
+#if MPI_VERSION >= 4
+        if (root == REDUCE_TO_ALL)
+          ret = MPI_Allreduce_c(sendbuf, recvbuf, count, mpi_type, op, comm);
+        else
+          ret = MPI_Reduce_c(sendbuf, recvbuf, count, mpi_type, op, root, comm);
+        
+        err::check_ret(ret);
+#else
+        utils::reduce_chunked(root, sendbuf, recvbuf, count, op, comm, utils::MAX_COUNT);
+#endif
+        return;
+      }
       
       if (root == REDUCE_TO_ALL)
-        ret = MPI_Allreduce(sendbuf, recvbuf, count, mpi_type, op, comm);
+        ret = MPI_Allreduce(sendbuf, recvbuf, (int) count, mpi_type, op, comm);
       else
-        ret = MPI_Reduce(sendbuf, recvbuf, count, mpi_type, op, root, comm);
+        ret = MPI_Reduce(sendbuf, recvbuf, (int) count, mpi_type, op, root, comm);
       
       err::check_ret(ret);
     }
     
     
     
+    /**
+      @brief Broadcast of `count` elements. Counts above `INT_MAX` use
+      `MPI_Bcast_c` with MPI 4, and are otherwise split into several
+      broadcasts.
+     */
+    template <typename T>
+    void bcast(int root, T *buf, MPI_Count count, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+#if MPI_VERSION >= 4
+      const MPI_Datatype mpi_type = utils::mpi_type_lookup<T>();
+      int ret = MPI_Bcast_c(buf, count, mpi_type, root, comm);
+      err::check_ret(ret);
+#else
+      utils::bcast_chunked(root, buf, count, comm, utils::MAX_COUNT);
+#endif
+    }
+    
+    
+    
+    /**
+      @brief (All)gatherv with 64-bit counts and displacements. Uses
+      `MPI_Allgatherv_c`/`MPI_Gatherv_c` with MPI 4. Otherwise, if every
+      count and the end of every block fit in an `int`, this is a plain
+      `MPI_Allgatherv`/`MPI_Gatherv`, and if not, the blocks are moved in
+      pieces of at most `INT_MAX` elements (broadcasts for an allgatherv,
+      point-to-point messages to the root for a gatherv).
+      
+      Unlike the MPI function, `recvcounts` and `displs` must be valid on
+      every rank, not just on the receiving ones, since all ranks have to
+      agree on which of the above is used.
+     */
     template <typename S, typename T>
-    void gatherv(int root, const S *sendbuf, int sendcount, T *recvbuf,
-      const int *recvcounts, const int *displs, MPI_Comm comm=MPI_COMM_WORLD)
+    void gatherv(int root, const S *sendbuf, MPI_Count sendcount, T *recvbuf,
+      const MPI_Count *recvcounts, const MPI_Aint *displs,
+      MPI_Comm comm=MPI_COMM_WORLD)
     {
       int ret;
       
-      const MPI_Datatype mpi_type_send = utils::mpi_type_lookup(*sendbuf);
-      const MPI_Datatype mpi_type_recv = utils::mpi_type_lookup(*recvbuf);
+      const MPI_Datatype mpi_type_send = utils::mpi_type_lookup<S>();
+      const MPI_Datatype mpi_type_recv = utils::mpi_type_lookup<T>();
       
+#if MPI_VERSION >= 4
       if (root == REDUCE_TO_ALL)
       {
-        ret = MPI_Allgatherv(sendbuf, sendcount, mpi_type_send, recvbuf,
+        ret = MPI_Allgatherv_c(sendbuf, sendcount, mpi_type_send, recvbuf,
           recvcounts, displs, mpi_type_recv, comm);
       }
       else
       {
-        ret = MPI_Gatherv(sendbuf, sendcount, mpi_type_send, recvbuf,
+        ret = MPI_Gatherv_c(sendbuf, sendcount, mpi_type_send, recvbuf,
           recvcounts, displs, mpi_type_recv, root, comm);
       }
+#else
+      const int size = get_size(comm);
+      if (!utils::fits_int(size, recvcounts, displs))
+      {
+        utils::gatherv_chunked(root, sendbuf, sendcount, recvbuf, recvcounts,
+          displs, comm, utils::MAX_COUNT);
+        return;
+      }
+      
+      std::vector<int> counts_displs(2*size);
+      int *counts_int = counts_displs.data();
+      int *displs_int = counts_displs.data() + size;
+      for (int i=0; i<size; i++)
+      {
+        counts_int[i] = (int) recvcounts[i];
+        displs_int[i] = (int) displs[i];
+      }
+      
+      if (root == REDUCE_TO_ALL)
+      {
+        ret = MPI_Allgatherv(sendbuf, (int) sendcount, mpi_type_send, recvbuf,
+          counts_int, displs_int, mpi_type_recv, comm);
+      }
+      else
+      {
+        ret = MPI_Gatherv(sendbuf, (int) sendcount, mpi_type_send, recvbuf,
+          counts_int, displs_int, mpi_type_recv, root, comm);
+      }
+#endif
       
       err::check_ret(ret);
     }
     
     
     
+    /**
+      @brief (All)gather of `count` elements per rank. If the receive buffer
+      holds more than `INT_MAX` elements, this uses `MPI_Allgather_c`/
+      `MPI_Gather_c` with MPI 4, and the chunked path of `gatherv()`
+      otherwise.
+     */
     template <typename S, typename T>
-    void gather(int root, const S *sendbuf, int sendcount, T *recvbuf,
-      int recvcount, MPI_Comm comm=MPI_COMM_WORLD)
+    void gather(int root, const S *sendbuf, MPI_Count sendcount, T *recvbuf,
+      MPI_Count recvcount, MPI_Comm comm=MPI_COMM_WORLD)
     {
       int ret;
       
-      const MPI_Datatype mpi_type_send = utils::mpi_type_lookup(*sendbuf);
-      const MPI_Datatype mpi_type_recv = utils::mpi_type_lookup(*recvbuf);
+      const MPI_Datatype mpi_type_send = utils::mpi_type_lookup<S>();
+      const MPI_Datatype mpi_type_recv = utils::mpi_type_lookup<T>();
+      
+      const int size = get_size(comm);
+      if (recvcount * size > utils::MAX_COUNT)
+      {
+#if MPI_VERSION >= 4
+        if (root == REDUCE_TO_ALL)
+        {
+          ret = MPI_Allgather_c(sendbuf, sendcount, mpi_type_send, recvbuf,
+            recvcount, mpi_type_recv, comm);
+        }
+        else
+        {
+          ret = MPI_Gather_c(sendbuf, sendcount, mpi_type_send, recvbuf,
+            recvcount, mpi_type_recv, root, comm);
+        }
+        
+        err::check_ret(ret);
+#else
+        std::vector<MPI_Count> counts(size, recvcount);
+        std::vector<MPI_Aint> displs(size);
+        for (int i=0; i<size; i++)
+          displs[i] = (MPI_Aint) (i * recvcount);
+        
+        utils::gatherv_chunked(root, sendbuf, sendcount, recvbuf, counts.data(),
+          displs.data(), comm, utils::MAX_COUNT);
+#endif
+        return;
+      }
       
       if (root == REDUCE_TO_ALL)
       {
-        ret = MPI_Allgather(sendbuf, sendcount, mpi_type_send, recvbuf,
-          recvcount, mpi_type_recv, comm);
+        ret = MPI_Allgather(sendbuf, (int) sendcount, mpi_type_send, recvbuf,
+          (int) recvcount, mpi_type_recv, comm);
       }
       else
       {
-        ret = MPI_Gather(sendbuf, sendcount, mpi_type_send, recvbuf,
-          recvcount, mpi_type_recv, root, comm);
+        ret = MPI_Gather(sendbuf, (int) sendcount, mpi_type_send, recvbuf,
+          (int) recvcount, mpi_type_recv, root, comm);
       }
       
       err::check_ret(ret);
     }
+    
+    
+    
+    /**
+      @brief Simultaneous send to `dest` and receive from `source`, as
+      `MPI_Sendrecv`. Either side can be `MPI_PROC_NULL`. Counts above
+      `INT_MAX` are split into several exchanges of at most `INT_MAX`
+      elements each way; both partners have to agree on the counts.
+     */
+    template <typename S, typename T>
+    void sendrecv(const S *sendbuf, MPI_Count sendcount, int dest, T *recvbuf,
+      MPI_Count recvcount, int source, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      const MPI_Datatype mpi_type_send = utils::mpi_type_lookup<S>();
+      const MPI_Datatype mpi_type_recv = utils::mpi_type_lookup<T>();
+      
+      const MPI_Count count = std::max(sendcount, recvcount);
+      MPI_Count i = 0;
+      do
+      {
+        const int slen = (int) std::max((MPI_Count) 0, std::min(utils::MAX_COUNT, sendcount - i));
+        const int rlen = (int) std::max((MPI_Count) 0, std::min(utils::MAX_COUNT, recvcount - i));
+        
+        int ret = MPI_Sendrecv(sendbuf + std::min(i, sendcount), slen, mpi_type_send,
+          dest, utils::SENDRECV_TAG, recvbuf + std::min(i, recvcount), rlen,
+          mpi_type_recv, source, utils::SENDRECV_TAG, comm, MPI_STATUS_IGNORE);
+        err::check_ret(ret);
+        
+        i += utils::MAX_COUNT;
+      } while (i < count);
+    }
+    
+    
+    
+    template <typename T>
+    void exscan(const T *sendbuf, T *recvbuf, MPI_Count count, MPI_Op op,
+      MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      const MPI_Datatype mpi_type = utils::mpi_type_lookup<T>();
+      
+      for (MPI_Count i=0; i<count; i+=utils::MAX_COUNT)
+      {
+        const int len = (int) std::min(utils::MAX_COUNT, count - i);
+        int ret = MPI_Exscan(sendbuf + i, recvbuf + i, len, mpi_type, op, comm);
+        err::check_ret(ret);
+      }
+      
+      // the receive buffer is undefined on rank 0; zero it so that with
+      // MPI_SUM every rank gets its exclusive prefix sum
+      if (get_rank(comm) == 0)
+      {
+        for (MPI_Count i=0; i<count; i++)
+          recvbuf[i] = (T) 0;
+      }
+    }
   }
 }
 
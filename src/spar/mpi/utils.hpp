@@ -10,8 +10,9 @@
 #define OMPI_SKIP_MPICXX 1
 #include <mpi.h>
 
-#include <cstdint>
-#include <typeinfo>
+#include <complex>
+#include <stdexcept>
+#include <type_traits>
 
 
 namespace spar
@@ -20,61 +21,118 @@ namespace spar
   {
     namespace utils
     {
+      // Run-time registry of user types (see `spar::mpi::register_type()`).
+      // One instance per type, so a lookup is a single load.
       template <typename T>
-      static inline MPI_Datatype mpi_type_lookup(T x)
+      struct custom_type
       {
-        (void) x;
+        static MPI_Datatype& datatype()
+        {
+          static MPI_Datatype t = MPI_DATATYPE_NULL;
+          return t;
+        }
         
-        // C types
-        if (typeid(T) == typeid(char))
-          return MPI_CHAR;
-        else if (typeid(T) == typeid(double))
-          return MPI_DOUBLE;
-        else if (typeid(T) == typeid(float))
-          return MPI_FLOAT;
-        else if (typeid(T) == typeid(int))
-          return MPI_INT;
-        else if (typeid(T) == typeid(long))
-          return MPI_LONG;
-        else if (typeid(T) == typeid(long double))
-          return MPI_LONG_DOUBLE;
-        else if (typeid(T) == typeid(long long))
-          return MPI_LONG_LONG_INT;
-        else if (typeid(T) == typeid(short))
-          return MPI_SHORT;
-        else if (typeid(T) == typeid(unsigned int))
-          return MPI_UNSIGNED;
-        else if (typeid(T) == typeid(unsigned char))
-          return MPI_UNSIGNED_CHAR;
-        else if (typeid(T) == typeid(unsigned long))
-          return MPI_UNSIGNED_LONG;
-        else if (typeid(T) == typeid(unsigned short))
-          return MPI_UNSIGNED_SHORT;
-        else if (typeid(T) == typeid(uint32_t))
-          return MPI_UINT32_T;
+        static MPI_Op& sum()
+        {
+          static MPI_Op op = MPI_OP_NULL;
+          return op;
+        }
         
-        // stdint types
-        else if (typeid(T) == typeid(int8_t))
-          return MPI_INT8_T;
-        else if (typeid(T) == typeid(int16_t))
-          return MPI_INT16_T;
-        else if (typeid(T) == typeid(int32_t))
-          return MPI_INT32_T;
-        else if (typeid(T) == typeid(int64_t))
-          return MPI_INT64_T;
-        else if (typeid(T) == typeid(uint8_t))
-          return MPI_UINT8_T;
-        else if (typeid(T) == typeid(uint16_t))
-          return MPI_UINT16_T;
-        else if (typeid(T) == typeid(uint32_t))
-          return MPI_UINT32_T;
-        else if (typeid(T) == typeid(uint64_t))
-          return MPI_UINT64_T;
-        else
+        // whether the handles were created by spar and have to be freed by it
+        static bool& owned()
         {
-          // return MPI_DATATYPE_NULL;
-          throw std::runtime_error("unknown reducer type");
+          static bool o = false;
+          return o;
         }
+      };
+      
+      
+      
+      // Compile-time mapping of C++ types to MPI datatypes. Only the
+      // fundamental C types are listed; the fixed-width `<cstdint>` types are
+      // typedefs of these and resolve to the same handles. Anything else has
+      // to be registered at run time first.
+      template <typename T>
+      struct type_traits
+      {
+        static constexpr bool builtin = false;
+        
+        static MPI_Datatype datatype()
+        {
+          const MPI_Datatype t = custom_type<T>::datatype();
+          if (t == MPI_DATATYPE_NULL)
+            throw std::runtime_error("unknown MPI type; register it with spar::mpi::register_type()");
+          
+          return t;
+        }
+        
+        static MPI_Op sum()
+        {
+          const MPI_Op op = custom_type<T>::sum();
+          if (op == MPI_OP_NULL)
+            throw std::runtime_error("no sum operation registered for this MPI type");
+          
+          return op;
+        }
+      };
+      
+      #define SPAR_MPI_BUILTIN_TYPE(T, MPI_T) \
+        template <> \
+        struct type_traits<T> \
+        { \
+          static constexpr bool builtin = true; \
+          static MPI_Datatype datatype() {return MPI_T;} \
+          static MPI_Op sum() {return MPI_SUM;} \
+        };
+      
+      SPAR_MPI_BUILTIN_TYPE(char, MPI_CHAR)
+      SPAR_MPI_BUILTIN_TYPE(signed char, MPI_SIGNED_CHAR)
+      SPAR_MPI_BUILTIN_TYPE(unsigned char, MPI_UNSIGNED_CHAR)
+      SPAR_MPI_BUILTIN_TYPE(short, MPI_SHORT)
+      SPAR_MPI_BUILTIN_TYPE(unsigned short, MPI_UNSIGNED_SHORT)
+      SPAR_MPI_BUILTIN_TYPE(int, MPI_INT)
+      SPAR_MPI_BUILTIN_TYPE(unsigned int, MPI_UNSIGNED)
+      SPAR_MPI_BUILTIN_TYPE(long, MPI_LONG)
+      SPAR_MPI_BUILTIN_TYPE(unsigned long, MPI_UNSIGNED_LONG)
+      SPAR_MPI_BUILTIN_TYPE(long long, MPI_LONG_LONG_INT)
+      SPAR_MPI_BUILTIN_TYPE(unsigned long long, MPI_UNSIGNED_LONG_LONG)
+      SPAR_MPI_BUILTIN_TYPE(float, MPI_FLOAT)
+      SPAR_MPI_BUILTIN_TYPE(double, MPI_DOUBLE)
+      SPAR_MPI_BUILTIN_TYPE(long double, MPI_LONG_DOUBLE)
+      SPAR_MPI_BUILTIN_TYPE(bool, MPI_CXX_BOOL)
+      SPAR_MPI_BUILTIN_TYPE(std::complex<float>, MPI_CXX_FLOAT_COMPLEX)
+      SPAR_MPI_BUILTIN_TYPE(std::complex<double>, MPI_CXX_DOUBLE_COMPLEX)
+      SPAR_MPI_BUILTIN_TYPE(std::complex<long double>, MPI_CXX_LONG_DOUBLE_COMPLEX)
+      
+      #undef SPAR_MPI_BUILTIN_TYPE
+      
+      
+      
+      template <typename T>
+      static inline MPI_Datatype mpi_type_lookup()
+      {
+        return type_traits<typename std::remove_cv<T>::type>::datatype();
+      }
+      
+      template <typename T>
+      static inline MPI_Op mpi_sum_op()
+      {
+        return type_traits<typename std::remove_cv<T>::type>::sum();
+      }
+      
+      
+      
+      // elementwise `+` for types registered without their own operation
+      template <typename T>
+      static inline void sum_fn(void *invec, void *inoutvec, int *len,
+        MPI_Datatype *datatype)
+      {
+        (void) datatype;
+        
+        const T *in = (const T*) invec;
+        T *inout = (T*) inoutvec;
+        for (int i=0; i<*len; i++)
+          inout[i] = inout[i] + in[i];
       }
     }
   }
@@ -0,0 +1,163 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_OP_H
+#define SPAR_OP_H
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+
+#include "mpi/mpi.hpp"
+
+
+namespace spar
+{
+  /**
+    @brief Reduction operators, passed to the reducers as a template
+    parameter (`spar::op::sum` by default).
+    
+    @details An entry absent from a rank's matrix is an implicit zero, and an
+    operator combines it as such: the maximum of -1 on one rank and nothing
+    on another is 0, and a product is only non-zero where every rank has the
+    entry. Each operator provides
+      * `map(x)`, applied to every stored value before it is combined;
+      * `apply(a, b)`, the associative and commutative combination;
+      * `absent(a, k)`, the combination of `a` with `k` implicit zeros;
+      * `mpi_op<T>()`, the `MPI_Op` the dense reducers use on vectors with
+      the zeros filled in;
+      * `keeps_zeros`, whether an entry stays in the result of the gather
+      reducers when it combines to zero. Only `sum` keeps them, so that the
+      result has the pattern computed by `spar::reduce::symbolic()`.
+    
+    Apart from `sum` and `user`, the operators use the predefined MPI
+    operations, which are only defined for the builtin types.
+   */
+  namespace op
+  {
+    /// Sum. This is what the reducers do by default.
+    struct sum
+    {
+      static constexpr bool keeps_zeros = true;
+      template <typename T> static T map(const T x) {return x;}
+      template <typename T> static T apply(const T a, const T b) {return a + b;}
+      template <typename T> static T absent(const T a, const uint64_t k) {(void) k; return a;}
+      template <typename T> static MPI_Op mpi_op() {return mpi::utils::mpi_sum_op<T>();}
+    };
+    
+    /// Product. Non-zero only where every rank has a non-zero entry.
+    struct prod
+    {
+      static constexpr bool keeps_zeros = false;
+      template <typename T> static T map(const T x) {return x;}
+      template <typename T> static T apply(const T a, const T b) {return a * b;}
+      template <typename T> static T absent(const T a, const uint64_t k) {return (k > 0) ? (T) 0 : a;}
+      template <typename T> static MPI_Op mpi_op() {return MPI_PROD;}
+    };
+    
+    /// Maximum, with absent entries counting as zero.
+    struct max
+    {
+      static constexpr bool keeps_zeros = false;
+      template <typename T> static T map(const T x) {return x;}
+      template <typename T> static T apply(const T a, const T b) {return std::max(a, b);}
+      template <typename T> static T absent(const T a, const uint64_t k) {return (k > 0) ? std::max(a, (T) 0) : a;}
+      template <typename T> static MPI_Op mpi_op() {return MPI_MAX;}
+    };
+    
+    /// Minimum, with absent entries counting as zero.
+    struct min
+    {
+      static constexpr bool keeps_zeros = false;
+      template <typename T> static T map(const T x) {return x;}
+      template <typename T> static T apply(const T a, const T b) {return std::min(a, b);}
+      template <typename T> static T absent(const T a, const uint64_t k) {return (k > 0) ? std::min(a, (T) 0) : a;}
+      template <typename T> static MPI_Op mpi_op() {return MPI_MIN;}
+    };
+    
+    /// Logical or: 1 where any rank has a non-zero entry.
+    struct lor
+    {
+      static constexpr bool keeps_zeros = false;
+      template <typename T> static T map(const T x) {return (x != (T) 0) ? (T) 1 : (T) 0;}
+      template <typename T> static T apply(const T a, const T b) {return std::max(a, b);}
+      template <typename T> static T absent(const T a, const uint64_t k) {(void) k; return a;}
+      // on 0/1 values; MPI_LOR is not defined for floating point types
+      template <typename T> static MPI_Op mpi_op() {return MPI_MAX;}
+    };
+    
+    /// Logical and: 1 where every rank has a non-zero entry.
+    struct land
+    {
+      static constexpr bool keeps_zeros = false;
+      template <typename T> static T map(const T x) {return (x != (T) 0) ? (T) 1 : (T) 0;}
+      template <typename T> static T apply(const T a, const T b) {return std::min(a, b);}
+      template <typename T> static T absent(const T a, const uint64_t k) {return (k > 0) ? (T) 0 : a;}
+      template <typename T> static MPI_Op mpi_op() {return MPI_MIN;}
+    };
+    
+    /// Number of ranks with a non-zero entry.
+    struct count
+    {
+      static constexpr bool keeps_zeros = false;
+      template <typename T> static T map(const T x) {return (x != (T) 0) ? (T) 1 : (T) 0;}
+      template <typename T> static T apply(const T a, const T b) {return a + b;}
+      template <typename T> static T absent(const T a, const uint64_t k) {(void) k; return a;}
+      template <typename T> static MPI_Op mpi_op() {return mpi::utils::mpi_sum_op<T>();}
+    };
+    
+    
+    
+    /**
+      @brief A user-supplied operator.
+      
+      @details The dense reducers wrap `F` in an `MPI_Op`, created on first
+      use and never freed, so the reducers can be called any number of times
+      without leaking handles. Since `F(0, 0)` is 0, any number of implicit
+      zeros combine to a single one, so the gather reducers apply `F` once
+      to an entry missing on some ranks.
+      
+      @tparam F A default-constructible functor `T F::operator()(T, T)`,
+      which must be associative and commutative, and map `(0, 0)` to 0,
+      since entries absent on every rank are never visited.
+     */
+    template <class F>
+    struct user
+    {
+      static constexpr bool keeps_zeros = false;
+      template <typename T> static T map(const T x) {return x;}
+      template <typename T> static T apply(const T a, const T b) {return F()(a, b);}
+      template <typename T> static T absent(const T a, const uint64_t k) {return (k > 0) ? apply(a, (T) 0) : a;}
+      
+      template <typename T>
+      static MPI_Op mpi_op()
+      {
+        static MPI_Op op = MPI_OP_NULL;
+        if (op == MPI_OP_NULL)
+        {
+          int ret = MPI_Op_create(fn<T>, 1, &op);
+          mpi::err::check_ret(ret);
+        }
+        
+        return op;
+      }
+      
+      private:
+        template <typename T>
+        static void fn(void *invec, void *inoutvec, int *len, MPI_Datatype *datatype)
+        {
+          (void) datatype;
+          
+          const T *in = (const T*) invec;
+          T *inout = (T*) inoutvec;
+          for (int i=0; i<*len; i++)
+            inout[i] = apply(in[i], inout[i]);
+        }
+    };
+  }
+}
+
+
+#endif
@@ -7,9 +7,15 @@
 #pragma once
 
 
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <type_traits>
 #include <vector>
 
 #include "spar.hpp"
+#include "op.hpp"
 #include "mpi/mpi.hpp"
 
 
@@ -27,152 +33,321 @@ namespace spar
       
       return len;
     }
-  }
-  
-  /// @brief Reducers
-  namespace reduce
-  {
-    /**
-      @brief Computes a sparse matrix (all)reduce column-by-column, where each
-      column is summed via a dense vector (all)reduce.
+    
+    
+    
+    // sort the gathered (index, value) pairs by index and combine the
+    // duplicates with OP; each index appears at most once per rank, so an
+    // index found on k ranks is also combined with size-k implicit zeros.
+    // The merged column is written back to the front of I and X.
+    template <class OP, typename INDEX, typename SCALAR>
+    static inline INDEX merge_sorted(const int size, const uint64_t count,
+      INDEX *I, SCALAR *X, std::pair<INDEX, SCALAR> *v)
+    {
+      for (uint64_t i=0; i<count; i++)
+        v[i] = std::make_pair(I[i], OP::map(X[i]));
       
-      @param[in] root The number of the receiving process in the case of a
-      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
-      @param[in] x A supported sparse matrix in CSC format.
-      @param[in] comm MPI communicator.
+      std::sort(v, v+count,
+        [](const std::pair<INDEX, SCALAR> &a, const std::pair<INDEX, SCALAR> &b)
+        {return a.first < b.first;});
       
-      @return An spmat object. You can convert it to an Eigen or R sparse matrix
-      using the library's included converters.
+      INDEX nnz = 0;
+      uint64_t i = 0;
+      while (i < count)
+      {
+        const INDEX ind = v[i].first;
+        SCALAR s = v[i].second;
+        uint64_t k = 1;
+        for (i++; i<count && v[i].first == ind; i++, k++)
+          s = OP::apply(s, v[i].second);
+        
+        s = OP::absent(s, (uint64_t) size - k);
+        if (OP::keeps_zeros || s != (SCALAR) 0)
+        {
+          I[nnz] = ind;
+          X[nnz] = s;
+          nnz++;
+        }
+      }
       
-      @comm If the input matrix has `m` rows and `n` columns, there are `n`
-      (all)reduces each of length `m`.
+      return nnz;
+    }
+    
+    
+    
+    // Largest communicator for which gather() and symbolic() exchange whole
+    // matrices, a handful of collectives in total, instead of making two or
+    // three collectives per column. The receiving ranks then buffer every
+    // rank's non-zeros at once.
+    static const int TINY_COMM_SIZE = 4;
+    
+    
+    
+    // One bit per column, set if the column has a non-zero on any rank. This
+    // costs a single allreduce of n/64 words, and lets the column-by-column
+    // reducers skip the columns that are empty everywhere.
+    template <class SPMAT, typename INDEX, typename SCALAR>
+    static inline std::vector<uint64_t> occupied_cols(const SPMAT &x, MPI_Comm comm)
+    {
+      INDEX m, n;
+      get::dim<INDEX, SCALAR>(x, &m, &n);
       
-      @allocs Several temporary objects are constructed. Throughout, let `m`
-      denote the number of rows and `n` the number of columns of the input
-      sparse matrix.
-        1. (all processes) `dvec<INDEX, SCALAR>` of length `m`.
-        2. (all processes) `spvec<INDEX, SCALAR>`, with initial length equal to
-        the largest number of non-zero elements across all the columns (called
-        `len`).
-        3. (root process) The return `spmat<INDEX, SCALAR>`, with initial length
-        `n*len`.
-      The internal sparse vector and the return sparse matrix will resize
-      themselves as needed during the reduce process.
+      std::vector<uint64_t> bits(((uint64_t) n + 63) / 64, 0);
+      spvec_view<INDEX, SCALAR> a;
+      for (INDEX j=0; j<n; j++)
+      {
+        get::col<INDEX, SCALAR>(j, x, a);
+        if (a.get_nnz() > 0)
+          bits[j / 64] |= (uint64_t) 1 << (j % 64);
+      }
       
-      @except If there is only one MPI rank, the function will throw a
-      `runtime_error` exception. If a memory allocation fails, a `bad_alloc`
-      exception will be thrown. If something goes wrong with any of the MPI
-      operations, a `runtime_error` exception will be thrown.
+      mpi::reduce(mpi::REDUCE_TO_ALL, MPI_IN_PLACE, bits.data(), bits.size(), MPI_BOR, comm);
       
-      @tparam SPMAT should be of type `spmat<INDEX, SCALAR>`,
-      `Eigen::SparseMatrix`, or R's `dgCMatrix`.
-      @tparam INDEX should be some kind of fundamental indexing type, like `int`
-      or `uint16_t`.
-      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
-     */
+      return bits;
+    }
+    
+    static inline bool is_occupied(const std::vector<uint64_t> &bits, const uint64_t j)
+    {
+      return (bits[j / 64] >> (j % 64)) & 1;
+    }
+    
+    // the same for rows: bit i is set if row i has a non-zero in any column
+    // on any rank
     template <class SPMAT, typename INDEX, typename SCALAR>
-    static inline spmat<INDEX, SCALAR> dense(const int root, const SPMAT &x, MPI_Comm comm=MPI_COMM_WORLD)
+    static inline std::vector<uint64_t> occupied_rows(const SPMAT &x, MPI_Comm comm)
     {
-      mpi::err::check_size(comm);
-      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
-      
       INDEX m, n;
-      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      get::dim<INDEX, SCALAR>(x, &m, &n);
       
-      // setup
-      const INDEX len = spar::internal::get_initial_len<SPMAT, INDEX, SCALAR>(x);
-      spvec<INDEX, SCALAR> a(len);
-      dvec<INDEX, SCALAR> d(m);
+      std::vector<uint64_t> bits(((uint64_t) m + 63) / 64, 0);
+      spvec_view<INDEX, SCALAR> a;
+      for (INDEX j=0; j<n; j++)
+      {
+        get::col<INDEX, SCALAR>(j, x, a);
+        const INDEX *I = a.index_ptr();
+        for (INDEX k=0; k<a.get_nnz(); k++)
+          bits[I[k] / 64] |= (uint64_t) 1 << (I[k] % 64);
+      }
       
-      spmat<INDEX, SCALAR> s(m, n, 0);
-      if (receiving)
-        s.resize(len);
+      mpi::reduce(mpi::REDUCE_TO_ALL, MPI_IN_PLACE, bits.data(), bits.size(), MPI_BOR, comm);
+      
+      return bits;
+    }
+    
+    
+    
+    // one rank: the reduced matrix is the input, so for a sum its columns
+    // are handed straight to the writer; other operators still map the
+    // values and drop the zeros
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class WRITER>
+    static inline void copy_to_writer(const int root, const SPMAT &x, WRITER &w)
+    {
+      if (root != mpi::REDUCE_TO_ALL && root != 0)
+        return;
       
+      INDEX m, n;
+      get::dim<INDEX, SCALAR>(x, &m, &n);
       
-      // allreduce column-by-column
+      w.init(m, n, get_initial_len<SPMAT, INDEX, SCALAR>(x));
+      
+      spvec_view<INDEX, SCALAR> a;
+      std::vector<INDEX> I_out;
+      std::vector<SCALAR> X_out;
       for (INDEX j=0; j<n; j++)
       {
-        internal::get::col<INDEX, SCALAR>(j, x, a);
-        a.densify(d);
+        get::col<INDEX, SCALAR>(j, x, a);
+        if (a.get_nnz() == 0)
+          continue;
         
-        if (receiving)
-          mpi::reduce(root, MPI_IN_PLACE, d.data_ptr(), m, MPI_SUM, comm);
-        else
-          mpi::reduce(root, d.data_ptr(), d.data_ptr(), m, MPI_SUM, comm);
+        if (std::is_same<OP, op::sum>::value)
+        {
+          w.insert(j, a.get_nnz(), a.index_ptr(), a.data_ptr());
+          continue;
+        }
         
-        if (receiving)
+        I_out.clear();
+        X_out.clear();
+        for (INDEX k=0; k<a.get_nnz(); k++)
         {
-          d.update_nnz();
-          a.set(d);
-          s.insert(j, a);
+          const SCALAR s = OP::map(a.data_ptr()[k]);
+          if (s != (SCALAR) 0)
+          {
+            I_out.push_back(a.index_ptr()[k]);
+            X_out.push_back(s);
+          }
         }
+        
+        if (I_out.size() > 0)
+          w.insert(j, (INDEX) I_out.size(), I_out.data(), X_out.data());
       }
       
-      return s;
+      w.finalize();
     }
     
     
     
-    /**
-      @brief Computes a sparse matrix (all)reduce column-by-column, where each
-      sum is computed locally after an index (all)gather and a scalar
-      (all)gather.
+    // Every rank's columns, (all)gathered in one go: the per-column counts,
+    // the indices, and optionally the values. Rank r's part of column j
+    // directly follows its part of column j-1.
+    template <typename INDEX, typename SCALAR>
+    class whole_matrix
+    {
+      public:
+        template <class SPMAT>
+        void exchange(const int root, const SPMAT &x, const bool with_values, MPI_Comm comm)
+        {
+          size = mpi::get_size(comm);
+          const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+          
+          INDEX m;
+          get::dim<INDEX, SCALAR>(x, &m, &n);
+          
+          // pack the local columns
+          spvec_view<INDEX, SCALAR> a;
+          std::vector<INDEX> col_nnz_local(n);
+          MPI_Count count_local = 0;
+          for (INDEX j=0; j<n; j++)
+          {
+            get::col<INDEX, SCALAR>(j, x, a);
+            col_nnz_local[j] = a.get_nnz();
+            count_local += a.get_nnz();
+          }
+          
+          std::vector<INDEX> I_local(count_local);
+          std::vector<SCALAR> X_local(with_values ? count_local : 0);
+          MPI_Count pos = 0;
+          for (INDEX j=0; j<n; j++)
+          {
+            get::col<INDEX, SCALAR>(j, x, a);
+            arraytools::copy(a.get_nnz(), a.index_ptr(), I_local.data() + pos);
+            if (with_values)
+              arraytools::copy(a.get_nnz(), a.data_ptr(), X_local.data() + pos);
+            
+            pos += a.get_nnz();
+          }
+          
+          // exchange
+          std::vector<MPI_Count> counts(size);
+          std::vector<MPI_Aint> displs(size);
+          mpi::gather(mpi::REDUCE_TO_ALL, &count_local, 1, counts.data(), 1, comm);
+          
+          displs[0] = 0;
+          for (int r=1; r<size; r++)
+            displs[r] = displs[r-1] + (MPI_Aint) counts[r-1];
+          
+          if (receiving)
+          {
+            const MPI_Count total = displs[size-1] + counts[size-1];
+            col_nnz.resize((size_t) size * n);
+            I.resize(total);
+            if (with_values)
+              X.resize(total);
+            
+            next = displs;
+          }
+          
+          mpi::gather(root, col_nnz_local.data(), n, col_nnz.data(), n, comm);
+          mpi::gatherv(root, I_local.data(), count_local, I.data(), counts.data(), displs.data(), comm);
+          if (with_values)
+            mpi::gatherv(root, X_local.data(), count_local, X.data(), counts.data(), displs.data(), comm);
+        }
+        
+        // copy column j of every rank, in rank order, to the front of I_out
+        // (and X_out, if the values were exchanged); columns must be
+        // requested in increasing order
+        uint64_t col(const INDEX j, std::vector<INDEX> &I_out, std::vector<SCALAR> &X_out)
+        {
+          const bool with_values = (X.size() > 0);
+          
+          uint64_t count = 0;
+          for (int r=0; r<size; r++)
+            count += col_nnz[(size_t) r*n + j];
+          
+          if (I_out.size() < count)
+            I_out.resize(count);
+          if (with_values && X_out.size() < count)
+            X_out.resize(count);
+          
+          uint64_t pos = 0;
+          for (int r=0; r<size; r++)
+          {
+            const INDEX c = col_nnz[(size_t) r*n + j];
+            arraytools::copy(c, I.data() + next[r], I_out.data() + pos);
+            if (with_values)
+              arraytools::copy(c, X.data() + next[r], X_out.data() + pos);
+            
+            next[r] += c;
+            pos += c;
+          }
+          
+          return count;
+        }
       
-      @param[in] root The number of the receiving process in the case of a
-      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
-      @param[in] x A supported sparse matrix in CSC format.
-      @param[in] comm MPI communicator.
+      private:
+        int size;
+        INDEX n;
+        std::vector<INDEX> col_nnz;
+        std::vector<INDEX> I;
+        std::vector<SCALAR> X;
+        std::vector<MPI_Aint> next;
+    };
+    
+    
+    
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class WRITER>
+    static inline void gather_whole(const int root, const SPMAT &x, WRITER &w, MPI_Comm comm)
+    {
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      const int size = mpi::get_size(comm);
       
-      @return An spmat object. You can convert it to an Eigen or R sparse matrix
-      using the library's included converters.
+      whole_matrix<INDEX, SCALAR> g;
+      g.exchange(root, x, true, comm);
+      if (!receiving)
+        return;
       
-      @comm If the input matrix has `n` columns, there are `n` iterations of
-        1. allgather the number of non-zero elements
-        2. if not all of the above numbers are zero, (all)gatherv the indices
-        and values
+      INDEX m, n;
+      get::dim<INDEX, SCALAR>(x, &m, &n);
       
-      @allocs Several temporary objects are constructed:
-        1. (all processes) `spvec<INDEX, SCALAR>`, with initial length equal to
-        the largest number of non-zero elements across all the columns (called
-        `len`).
-        2. (all processes) Two `dvec<int, int>` vectors, each with as many
-        elements as the number of MPI ranks (denot this value as `size`). 
-        3. (root process) A `std::vector<INDEX>` and a `std::vector<SCALAR>`,
-        and a `std::vector<std::pair<INDEX, SCALAR>>`. All three have initial
-        length `len`.
-        4. (root process) The return `spmat<INDEX, SCALAR>`, with initial length
-        `n*len`.
-      The internal sparse vector, the three `std::vector`'s, and the return
-      sparse matrix will resize themselves as needed during the reduce process.
+      const INDEX len = get_initial_len<SPMAT, INDEX, SCALAR>(x);
+      std::vector<INDEX> indices(len);
+      std::vector<SCALAR> values(len);
+      std::vector<std::pair<INDEX, SCALAR>> v(len);
       
-      @except If there is only one MPI rank, the function will throw a
-      `runtime_error` exception. If a memory allocation fails, a `bad_alloc`
-      exception will be thrown. If something goes wrong with any of the MPI
-      operations, a `runtime_error` exception will be thrown.
+      w.init(m, n, len);
       
-      @tparam SPMAT should be of type `spmat<INDEX, SCALAR>`,
-      `Eigen::SparseMatrix`, or R's `dgCMatrix`.
-      @tparam INDEX should be some kind of fundamental indexing type, like `int`
-      or `uint16_t`.
-      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
-     */
-    template <class SPMAT, typename INDEX, typename SCALAR>
-    static inline spmat<INDEX, SCALAR> gather(const int root, const SPMAT &x, MPI_Comm comm=MPI_COMM_WORLD)
+      for (INDEX j=0; j<n; j++)
+      {
+        const uint64_t count = g.col(j, indices, values);
+        if (count == 0)
+          continue;
+        else if (v.size() < count)
+          v.resize(count);
+        
+        const INDEX nnz = merge_sorted<OP>(size, count, indices.data(), values.data(), v.data());
+        if (nnz > 0)
+          w.insert(j, nnz, indices.data(), values.data());
+      }
+      
+      w.finalize();
+    }
+    
+    
+    
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class WRITER>
+    static inline void gather_cols(const int root, const SPMAT &x, WRITER &w, MPI_Comm comm)
     {
-      mpi::err::check_size(comm);
       const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
       
       INDEX m, n;
-      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      get::dim<INDEX, SCALAR>(x, &m, &n);
       
       // setup
-      const INDEX len = spar::internal::get_initial_len<SPMAT, INDEX, SCALAR>(x);
-      spvec<INDEX, SCALAR> a(len);
-      spmat<INDEX, SCALAR> s(m, n, 0);
+      const INDEX len = get_initial_len<SPMAT, INDEX, SCALAR>(x);
+      spvec_view<INDEX, SCALAR> a;
       
-      int size = mpi::get_size(comm);
-      dvec<int, int> counts(size);
-      dvec<int, int> displs(size);
+      const int size = mpi::get_size(comm);
+      dvec<int, MPI_Count> counts(size);
+      dvec<int, MPI_Aint> displs(size);
       displs[0] = 0;
       
       // we need vectors of indices and values for the Allgatherv, and a vector
@@ -183,7 +358,7 @@ namespace spar
       
       if (receiving)
       {
-        s.resize(len);
+        w.init(m, n, len);
         
         indices.resize(len);
         values.resize(len);
@@ -191,20 +366,25 @@ namespace spar
       }
       
       
+      const std::vector<uint64_t> occupied = occupied_cols<SPMAT, INDEX, SCALAR>(x, comm);
+      
       // allreduce column-by-column
       for (INDEX j=0; j<n; j++)
       {
-        internal::get::col<INDEX, SCALAR>(j, x, a);
+        if (!is_occupied(occupied, j))
+          continue;
+        
+        get::col<INDEX, SCALAR>(j, x, a);
         
         // get the displacements
-        INDEX count_local = a.get_nnz();
+        MPI_Count count_local = a.get_nnz();
         mpi::gather(mpi::REDUCE_TO_ALL, &count_local, 1, counts.data_ptr(), 1, comm);
         
-        unsigned int count = counts.sum();
+        const uint64_t count = counts.sum();
         
         if (count == 0)
           continue;
-        else if (receiving && indices.capacity() < count)
+        else if (receiving && indices.size() < count)
         {
           indices.resize(count);
           values.resize(count);
@@ -212,7 +392,7 @@ namespace spar
         }
         
         for (int i=1; i<displs.get_len(); i++)
-          displs[i] = displs[i-1] + counts[i-1];
+          displs[i] = displs[i-1] + (MPI_Aint) counts[i-1];
         
         // get all the indices/values
         mpi::gatherv(root, a.index_ptr(), a.get_nnz(), indices.data(), counts.data_ptr(), displs.data_ptr(), comm);
@@ -221,33 +401,1368 @@ namespace spar
         // add all the vectors
         if (receiving)
         {
-          for (unsigned int i=0; i<count; i++)
-            v[i] = std::make_pair(indices[i], values[i]);
+          const INDEX nnz = merge_sorted<OP>(size, count, indices.data(), values.data(), v.data());
+          if (nnz > 0)
+            w.insert(j, nnz, indices.data(), values.data());
+        }
+      }
+      
+      if (receiving)
+        w.finalize();
+    }
+    
+    
+    
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET>
+    static inline std::vector<OFFSET> symbolic_local(const int root, const SPMAT &x)
+    {
+      std::vector<OFFSET> P;
+      if (root != mpi::REDUCE_TO_ALL && root != 0)
+        return P;
+      
+      INDEX m, n;
+      get::dim<INDEX, SCALAR>(x, &m, &n);
+      P.resize(n + 1, 0);
+      
+      spvec_view<INDEX, SCALAR> a;
+      for (INDEX j=0; j<n; j++)
+      {
+        get::col<INDEX, SCALAR>(j, x, a);
+        P[j+1] = P[j] + a.get_nnz();
+      }
+      
+      return P;
+    }
+    
+    
+    
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET>
+    static inline std::vector<OFFSET> symbolic_whole(const int root, const SPMAT &x, MPI_Comm comm)
+    {
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      
+      whole_matrix<INDEX, SCALAR> g;
+      g.exchange(root, x, false, comm);
+      
+      std::vector<OFFSET> P;
+      if (!receiving)
+        return P;
+      
+      INDEX m, n;
+      get::dim<INDEX, SCALAR>(x, &m, &n);
+      P.resize(n + 1, 0);
+      
+      std::vector<INDEX> indices;
+      std::vector<SCALAR> unused;
+      for (INDEX j=0; j<n; j++)
+      {
+        const uint64_t count = g.col(j, indices, unused);
+        
+        std::sort(indices.begin(), indices.begin()+count);
+        const INDEX nnz = std::unique(indices.begin(), indices.begin()+count) - indices.begin();
+        P[j+1] = P[j] + nnz;
+      }
+      
+      return P;
+    }
+    
+    
+    
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET>
+    static inline std::vector<OFFSET> symbolic_cols(const int root, const SPMAT &x, MPI_Comm comm)
+    {
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      
+      INDEX m, n;
+      get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      spvec_view<INDEX, SCALAR> a;
+      
+      const int size = mpi::get_size(comm);
+      dvec<int, MPI_Count> counts(size);
+      dvec<int, MPI_Aint> displs(size);
+      displs[0] = 0;
+      
+      std::vector<INDEX> indices;
+      std::vector<OFFSET> P;
+      if (receiving)
+        P.resize(n + 1, 0);
+      
+      const std::vector<uint64_t> occupied = occupied_cols<SPMAT, INDEX, SCALAR>(x, comm);
+      
+      for (INDEX j=0; j<n; j++)
+      {
+        if (!is_occupied(occupied, j))
+        {
+          if (receiving)
+            P[j+1] = P[j];
+          
+          continue;
+        }
+        
+        get::col<INDEX, SCALAR>(j, x, a);
+        
+        MPI_Count count_local = a.get_nnz();
+        mpi::gather(mpi::REDUCE_TO_ALL, &count_local, 1, counts.data_ptr(), 1, comm);
+        
+        const uint64_t count = counts.sum();
+        INDEX nnz = 0;
+        
+        if (count > 0)
+        {
+          if (receiving && indices.size() < count)
+            indices.resize(count);
           
-          std::sort(v.begin(), v.begin()+count);
+          for (int i=1; i<displs.get_len(); i++)
+            displs[i] = displs[i-1] + (MPI_Aint) counts[i-1];
           
-          INDEX nnz = 0;
-          indices[0] = v[0].first;
-          values[0] = v[0].second;
-          for (unsigned int i=1; i<count; i++)
+          mpi::gatherv(root, a.index_ptr(), a.get_nnz(), indices.data(), counts.data_ptr(), displs.data_ptr(), comm);
+          
+          if (receiving)
           {
-            if (v[i].first == indices[nnz])
-              values[nnz] += v[i].second;
-            else
-            {
-              nnz++;
-              
-              indices[nnz] = v[i].first;
-              values[nnz] = v[i].second;
-            }
+            std::sort(indices.begin(), indices.begin()+count);
+            nnz = std::unique(indices.begin(), indices.begin()+count) - indices.begin();
           }
-          
-          // put summed column into the return
-          a.set(nnz+1, indices.data(), values.data());
-          s.insert(j, a);
+        }
+        
+        if (receiving)
+          P[j+1] = P[j] + nnz;
+      }
+      
+      return P;
+    }
+    
+    
+    
+    // Gather-reduce the columns of x in nranges disjoint blocks, each over its
+    // own duplicate of comm so the blocks can be in flight at once. Every
+    // rank has to use the same nranges and the same dimensions; check the
+    // input beforehand, since a rank that fails partway through a block
+    // leaves its peers waiting in that block's collectives. With threaded,
+    // each block is driven by its own OpenMP thread, which needs
+    // MPI_THREAD_MULTIPLE. A thread runs its blocks in increasing order, so
+    // ranks with fewer threads than blocks cannot deadlock.
+    template <typename INDEX, typename SCALAR, typename OFFSET, class WRITER>
+    static inline void gather_ranges(const int root, const spmat<INDEX, SCALAR, OFFSET> &x,
+      WRITER &w, const int nranges, const bool threaded, MPI_Comm comm)
+    {
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      const int size = mpi::get_size(comm);
+      const INDEX m = x.nrows();
+      const INDEX n = x.ncols();
+      
+      std::vector<MPI_Comm> comms(nranges);
+      for (int t=0; t<nranges; t++)
+        comms[t] = mpi::comm_dup(comm);
+      
+      std::vector<spmat<INDEX, SCALAR, OFFSET>> parts(nranges);
+      std::vector<std::exception_ptr> errors(nranges);
+      
+      #pragma omp parallel for schedule(static, 1) num_threads(nranges) if(threaded)
+      for (int t=0; t<nranges; t++)
+      {
+        const INDEX first = (INDEX) ((uint64_t) n*t/nranges);
+        const INDEX last = (INDEX) ((uint64_t) n*(t+1)/nranges);
+        const spmat_view<INDEX, SCALAR, OFFSET> v(m, last - first,
+          x.index_ptr(), x.col_ptr() + first, x.data_ptr());
+        
+        try
+        {
+          writers::spmat_writer<INDEX, SCALAR, OFFSET> wt(parts[t]);
+          if (size <= TINY_COMM_SIZE)
+            gather_whole<spmat_view<INDEX, SCALAR, OFFSET>, INDEX, SCALAR>(root, v, wt, comms[t]);
+          else
+            gather_cols<spmat_view<INDEX, SCALAR, OFFSET>, INDEX, SCALAR>(root, v, wt, comms[t]);
+        }
+        catch (...)
+        {
+          errors[t] = std::current_exception();
+        }
+      }
+      
+      for (int t=0; t<nranges; t++)
+        mpi::comm_free(&comms[t]);
+      
+      // a block can fail after its communication (e.g. growing the part on a
+      // receiving rank); make sure every rank throws, not just that one
+      int failed = 0;
+      for (int t=0; t<nranges; t++)
+        failed |= (bool) errors[t];
+      
+      mpi::reduce(mpi::REDUCE_TO_ALL, MPI_IN_PLACE, &failed, 1, MPI_LOR, comm);
+      for (int t=0; t<nranges; t++)
+      {
+        if (errors[t])
+          std::rethrow_exception(errors[t]);
+      }
+      
+      if (failed)
+        throw std::runtime_error("hybrid reduce failed on another rank");
+      
+      if (!receiving)
+        return;
+      
+      uint64_t total = 0;
+      for (int t=0; t<nranges; t++)
+        total += (uint64_t) parts[t].get_nnz();
+      
+      w.init(m, n, (INDEX) std::min(total, (uint64_t) std::numeric_limits<INDEX>::max()));
+      
+      for (int t=0; t<nranges; t++)
+      {
+        const INDEX first = (INDEX) ((uint64_t) n*t/nranges);
+        const OFFSET *P = parts[t].col_ptr();
+        for (INDEX j=0; j<parts[t].ncols(); j++)
+        {
+          const INDEX col_nnz = (INDEX) (P[j+1] - P[j]);
+          if (col_nnz > 0)
+            w.insert(first + j, col_nnz, parts[t].index_ptr() + P[j], parts[t].data_ptr() + P[j]);
         }
       }
       
+      w.finalize();
+    }
+    
+    
+    
+    // One rank's share of a vector() reduce. A sparse part holds the sorted
+    // indices I and the values X; a dense part holds all n values in X and
+    // no indices.
+    template <typename INDEX, typename SCALAR>
+    struct vector_part
+    {
+      bool dense = false;
+      std::vector<INDEX> I;
+      std::vector<SCALAR> X;
+    };
+    
+    // header sent in place of the number of non-zeros by a dense part
+    static const uint64_t DENSE_PART = UINT64_MAX;
+    
+    // a sparse part of this many non-zeros takes at least as many bytes as
+    // the dense one
+    template <typename INDEX, typename SCALAR>
+    static inline bool past_break_even(const uint64_t nnz, const INDEX n)
+    {
+      return nnz * (sizeof(INDEX) + sizeof(SCALAR)) >= (uint64_t) n * sizeof(SCALAR);
+    }
+    
+    template <typename INDEX, typename SCALAR>
+    static inline void densify_part(vector_part<INDEX, SCALAR> &p, const INDEX n)
+    {
+      std::vector<SCALAR> d(n, (SCALAR) 0);
+      simd::scatter(p.X.size(), p.I.data(), p.X.data(), d.data());
+      
+      p.X.swap(d);
+      p.I.clear();
+      p.dense = true;
+    }
+    
+    // Send s to dest and receive r from source, either of which can be
+    // MPI_PROC_NULL: a header with the number of non-zeros (or DENSE_PART),
+    // then the indices and the values.
+    template <typename INDEX, typename SCALAR>
+    static inline void sendrecv_part(const vector_part<INDEX, SCALAR> &s,
+      const int dest, vector_part<INDEX, SCALAR> &r, const int source,
+      const INDEX n, MPI_Comm comm)
+    {
+      const uint64_t head = s.dense ? DENSE_PART : (uint64_t) s.X.size();
+      uint64_t head_in = 0;
+      mpi::sendrecv(&head, 1, dest, &head_in, 1, source, comm);
+      
+      r.dense = (head_in == DENSE_PART);
+      r.I.resize(r.dense ? 0 : head_in);
+      r.X.resize(r.dense ? (uint64_t) n : head_in);
+      
+      mpi::sendrecv(s.I.data(), s.I.size(), dest, r.I.data(), r.I.size(), source, comm);
+      mpi::sendrecv(s.X.data(), s.X.size(), dest, r.X.data(), r.X.size(), source, comm);
+    }
+    
+    // s += r. Two sparse parts are merged, dropping the entries that cancel,
+    // into tmp, which is then swapped with s; anything else is summed dense.
+    template <typename INDEX, typename SCALAR>
+    static inline void add_part(vector_part<INDEX, SCALAR> &s,
+      const vector_part<INDEX, SCALAR> &r, vector_part<INDEX, SCALAR> &tmp,
+      const INDEX n)
+    {
+      if (!s.dense && !r.dense)
+      {
+        const uint64_t ns = s.X.size();
+        const uint64_t nr = r.X.size();
+        tmp.I.resize(ns + nr);
+        tmp.X.resize(ns + nr);
+        
+        uint64_t a = 0, b = 0, out = 0;
+        while (a < ns || b < nr)
+        {
+          INDEX i;
+          SCALAR v;
+          if (b == nr || (a < ns && s.I[a] < r.I[b]))
+          {
+            i = s.I[a];
+            v = s.X[a++];
+          }
+          else if (a == ns || r.I[b] < s.I[a])
+          {
+            i = r.I[b];
+            v = r.X[b++];
+          }
+          else
+          {
+            i = s.I[a];
+            v = s.X[a++] + r.X[b++];
+          }
+          
+          if (v != (SCALAR) 0)
+          {
+            tmp.I[out] = i;
+            tmp.X[out] = v;
+            out++;
+          }
+        }
+        
+        tmp.I.resize(out);
+        tmp.X.resize(out);
+        tmp.dense = false;
+        std::swap(s, tmp);
+        
+        if (past_break_even<INDEX, SCALAR>(out, n))
+          densify_part(s, n);
+        
+        return;
+      }
+      
+      if (!s.dense)
+        densify_part(s, n);
+      
+      SCALAR *d = s.X.data();
+      if (r.dense)
+      {
+        for (INDEX i=0; i<n; i++)
+          d[i] += r.X[i];
+      }
+      else
+      {
+        for (uint64_t k=0; k<r.X.size(); k++)
+          d[r.I[k]] += r.X[k];
+      }
+    }
+  }
+  
+  /// @brief Reducers
+  namespace reduce
+  {
+    /**
+      @brief Dense-vector (all)reduce whose result is handed to a writer
+      instead of being returned as an `spmat`. See the other overload for
+      details.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[out] w A writer (see `spar::writers`) which receives the reduced
+      columns on the receiving processes. Use this to build the result
+      directly in its final container, e.g. an `Eigen::SparseMatrix`, a
+      `dgCMatrix`, or caller-owned CSC buffers.
+      @param[in] comm MPI communicator.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class WRITER>
+    static inline void dense(const int root, const SPMAT &x, WRITER &w, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      if (mpi::get_size(comm) == 1)
+      {
+        internal::copy_to_writer<SPMAT, INDEX, SCALAR, OP>(root, x, w);
+        return;
+      }
+      
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      // setup
+      const INDEX len = spar::internal::get_initial_len<SPMAT, INDEX, SCALAR>(x);
+      spvec_view<INDEX, SCALAR> v;
+      spa<INDEX, SCALAR> d(m);
+      std::vector<INDEX> I_out;
+      std::vector<SCALAR> X_out;
+      const MPI_Op mpi_op = OP::template mpi_op<SCALAR>();
+      
+      if (receiving)
+      {
+        I_out.resize(len);
+        X_out.resize(len);
+        w.init(m, n, len);
+      }
+      
+      
+      const std::vector<uint64_t> occupied = internal::occupied_cols<SPMAT, INDEX, SCALAR>(x, comm);
+      
+      // allreduce column-by-column
+      for (INDEX j=0; j<n; j++)
+      {
+        if (!internal::is_occupied(occupied, j))
+          continue;
+        
+        internal::get::col<INDEX, SCALAR>(j, x, v);
+        d.zero();
+        for (INDEX t=0; t<v.get_nnz(); t++)
+          d.add(v.index_ptr()[t], OP::map(v.data_ptr()[t]));
+        
+        if (receiving)
+          mpi::reduce(root, MPI_IN_PLACE, d.data_ptr(), m, mpi_op, comm);
+        else
+          mpi::reduce(root, d.data_ptr(), d.data_ptr(), m, mpi_op, comm);
+        
+        // the reduction may have filled in any row, so the receivers rescan;
+        // the senders' accumulators are unchanged and reset in O(nnz)
+        if (receiving)
+        {
+          d.rescan();
+          if (I_out.size() < (size_t) d.get_nnz())
+          {
+            I_out.resize(d.get_nnz());
+            X_out.resize(d.get_nnz());
+          }
+          
+          const INDEX nnz = d.extract(I_out.data(), X_out.data());
+          if (nnz > 0)
+            w.insert(j, nnz, I_out.data(), X_out.data());
+        }
+      }
+      
+      if (receiving)
+        w.finalize();
+    }
+    
+    
+    
+    /**
+      @brief Computes a sparse matrix (all)reduce column-by-column, where each
+      column is summed via a dense vector (all)reduce.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[in] comm MPI communicator.
+      
+      @return An spmat object. You can convert it to an Eigen or R sparse matrix
+      using the library's included converters, or avoid the conversion by
+      passing a writer instead.
+      
+      @comm If the input matrix has `m` rows and `n` columns, there is one
+      allreduce of an `n`-bit column occupancy bitmap, and then one
+      (all)reduce of length `m` for each column which is non-empty on some
+      rank.
+      With a single rank there is no communication, and the result is a copy
+      of the input.
+      
+      @allocs Several temporary objects are constructed. Throughout, let `m`
+      denote the number of rows and `n` the number of columns of the input
+      sparse matrix.
+        1. (all processes) `spa<INDEX, SCALAR>` of length `m`, and the
+        column occupancy bitmap of `n/64` words. The accumulator is reset in
+        time proportional to the number of entries touched, so the local work
+        of the sending processes scales with the non-zeros of the input rather
+        than with `m`.
+        2. (root process) Index and value vectors, with initial length equal to
+        the largest number of non-zero elements across all the columns (called
+        `len`). Columns of the input are read through a non-owning view and are
+        never copied.
+        3. (root process) The return `spmat<INDEX, SCALAR>` (or the writer's
+        container), with initial length `len`.
+      The index/value vectors and the return sparse matrix will resize
+      themselves as needed during the reduce process.
+      
+      @except If a memory allocation fails, a `bad_alloc` exception will be
+      thrown. If something goes wrong with any of the MPI
+      operations, a `runtime_error` exception will be thrown.
+      
+      @tparam SPMAT should be of type `spmat<INDEX, SCALAR, ...>`,
+      `spmat_view<INDEX, SCALAR, ...>`, `Eigen::SparseMatrix` (or an `Eigen::Map`
+      of one), or R's `dgCMatrix`.
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the returned `spmat`,
+      `INDEX` by default. It is independent of the input type.
+      @tparam OP is the reduction operator (see `spar::op`), `spar::op::sum`
+      by default.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET=INDEX, class OP=op::sum>
+    static inline spmat<INDEX, SCALAR, OFFSET> dense(const int root, const SPMAT &x, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      spmat<INDEX, SCALAR, OFFSET> s(m, n, 0);
+      writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+      dense<SPMAT, INDEX, SCALAR, OP>(root, x, w, comm);
+      
+      return s;
+    }
+    
+    
+    
+    /**
+      @brief Row-compacted dense (all)reduce whose result is handed to a
+      writer instead of being returned as an `spmat`. See the other overload
+      for details.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[out] w A writer (see `spar::writers`) which receives the reduced
+      columns on the receiving processes.
+      @param[in] comm MPI communicator.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class WRITER>
+    static inline void dense_compact(const int root, const SPMAT &x, WRITER &w, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      if (mpi::get_size(comm) == 1)
+      {
+        internal::copy_to_writer<SPMAT, INDEX, SCALAR, OP>(root, x, w);
+        return;
+      }
+      
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      // map the rows active on some rank to 0, 1, ..., k-1, in order
+      const std::vector<uint64_t> active = internal::occupied_rows<SPMAT, INDEX, SCALAR>(x, comm);
+      std::vector<INDEX> rows;
+      std::vector<INDEX> row_map(m);
+      for (INDEX i=0; i<m; i++)
+      {
+        if (internal::is_occupied(active, i))
+        {
+          row_map[i] = (INDEX) rows.size();
+          rows.push_back(i);
+        }
+      }
+      
+      const INDEX k = (INDEX) rows.size();
+      const MPI_Op mpi_op = OP::template mpi_op<SCALAR>();
+      std::vector<SCALAR> d(k);
+      std::vector<INDEX> I_out;
+      std::vector<SCALAR> X_out;
+      
+      if (receiving)
+      {
+        const INDEX len = spar::internal::get_initial_len<SPMAT, INDEX, SCALAR>(x);
+        w.init(m, n, len);
+        I_out.reserve(len);
+        X_out.reserve(len);
+      }
+      
+      const std::vector<uint64_t> occupied = internal::occupied_cols<SPMAT, INDEX, SCALAR>(x, comm);
+      spvec_view<INDEX, SCALAR> v;
+      
+      // allreduce column-by-column over the active rows only
+      for (INDEX j=0; j<n; j++)
+      {
+        if (!internal::is_occupied(occupied, j))
+          continue;
+        
+        internal::get::col<INDEX, SCALAR>(j, x, v);
+        
+        std::fill(d.begin(), d.end(), (SCALAR) 0);
+        const INDEX *I = v.index_ptr();
+        const SCALAR *X = v.data_ptr();
+        for (INDEX t=0; t<v.get_nnz(); t++)
+          d[row_map[I[t]]] += OP::map(X[t]);
+        
+        if (receiving)
+          mpi::reduce(root, MPI_IN_PLACE, d.data(), k, mpi_op, comm);
+        else
+          mpi::reduce(root, d.data(), d.data(), k, mpi_op, comm);
+        
+        if (receiving)
+        {
+          I_out.clear();
+          X_out.clear();
+          for (INDEX t=0; t<k; t++)
+          {
+            if (d[t] != (SCALAR) 0)
+            {
+              I_out.push_back(rows[t]);
+              X_out.push_back(d[t]);
+            }
+          }
+          
+          if (I_out.size() > 0)
+            w.insert(j, (INDEX) I_out.size(), I_out.data(), X_out.data());
+        }
+      }
+      
+      if (receiving)
+        w.finalize();
+    }
+    
+    
+    
+    /**
+      @brief Computes a sparse matrix (all)reduce column-by-column like
+      `dense()`, but the dense vectors only cover the rows which are non-zero
+      in some column on some rank. This is much cheaper than `dense()` when
+      the matrix is tall but only a few of its rows are ever touched.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[in] comm MPI communicator.
+      
+      @return An spmat object.
+      
+      @comm If the input matrix has `m` rows and `n` columns, there is one
+      allreduce each of an `m`-bit row occupancy bitmap and of an `n`-bit
+      column occupancy bitmap. Then, if `k` rows are active anywhere, there is
+      one (all)reduce of length `k` for each column which is non-empty on some
+      rank.
+      
+      @allocs Several temporary objects are constructed. Throughout, let `m`
+      denote the number of rows, `n` the number of columns, and `k` the
+      number of active rows.
+        1. (all processes) The row and column occupancy bitmaps, a row map of
+        length `m`, the list of the `k` active rows, and a dense vector of
+        length `k`.
+        2. (root process) Index and value vectors for the current output
+        column, and the return `spmat<INDEX, SCALAR>` (or the writer's
+        container).
+      
+      @except If a memory allocation fails, a `bad_alloc` exception will be
+      thrown. If something goes wrong with any of the MPI operations, a
+      `runtime_error` exception will be thrown.
+      
+      @tparam SPMAT should be of type `spmat<INDEX, SCALAR, ...>`,
+      `spmat_view<INDEX, SCALAR, ...>`, `Eigen::SparseMatrix` (or an `Eigen::Map`
+      of one), or R's `dgCMatrix`.
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the returned `spmat`,
+      `INDEX` by default. It is independent of the input type.
+      @tparam OP is the reduction operator (see `spar::op`), `spar::op::sum`
+      by default.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET=INDEX, class OP=op::sum>
+    static inline spmat<INDEX, SCALAR, OFFSET> dense_compact(const int root, const SPMAT &x, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      spmat<INDEX, SCALAR, OFFSET> s(m, n, 0);
+      writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+      dense_compact<SPMAT, INDEX, SCALAR, OP>(root, x, w, comm);
+      
+      return s;
+    }
+    
+    
+    
+    /**
+      @brief Column-batched dense (all)reduce whose result is handed to a
+      writer instead of being returned as an `spmat`. See the other overload
+      for details.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[out] w A writer (see `spar::writers`) which receives the reduced
+      columns on the receiving processes.
+      @param[in] budget Memory budget of the batch buffers, in bytes. It must
+      be the same on every rank.
+      @param[in] comm MPI communicator.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class WRITER>
+    static inline void dense_batched(const int root, const SPMAT &x, WRITER &w,
+      const uint64_t budget, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      if (mpi::get_size(comm) == 1)
+      {
+        internal::copy_to_writer<SPMAT, INDEX, SCALAR, OP>(root, x, w);
+        return;
+      }
+      
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      const std::vector<uint64_t> occupied = internal::occupied_cols<SPMAT, INDEX, SCALAR>(x, comm);
+      std::vector<INDEX> cols;
+      for (INDEX j=0; j<n; j++)
+      {
+        if (internal::is_occupied(occupied, j))
+          cols.push_back(j);
+      }
+      
+      // every rank derives the same batch size from the budget
+      const uint64_t col_bytes = std::max((uint64_t) m * (sizeof(SCALAR) + sizeof(INDEX)), (uint64_t) 1);
+      const uint64_t batch = std::max((uint64_t) 1,
+        std::min(budget / col_bytes, (uint64_t) cols.size()));
+      
+      const MPI_Op mpi_op = OP::template mpi_op<SCALAR>();
+      std::vector<SCALAR> d(batch * m);
+      std::vector<INDEX> I_out;
+      std::vector<INDEX> nnz;
+      
+      if (receiving)
+      {
+        w.init(m, n, spar::internal::get_initial_len<SPMAT, INDEX, SCALAR>(x));
+        I_out.resize(batch * m);
+        nnz.resize(batch);
+      }
+      
+      for (uint64_t b=0; b<cols.size(); b+=batch)
+      {
+        const uint64_t nb = std::min(batch, (uint64_t) cols.size() - b);
+        
+        // densify the columns of the batch side by side
+        #pragma omp parallel for schedule(static)
+        for (uint64_t c=0; c<nb; c++)
+        {
+          SCALAR *dc = d.data() + c*m;
+          std::fill(dc, dc + m, (SCALAR) 0);
+          
+          spvec_view<INDEX, SCALAR> v;
+          internal::get::col<INDEX, SCALAR>(cols[b + c], x, v);
+          const INDEX *I = v.index_ptr();
+          const SCALAR *X = v.data_ptr();
+          for (INDEX t=0; t<v.get_nnz(); t++)
+            dc[I[t]] += OP::map(X[t]);
+        }
+        
+        if (receiving)
+          mpi::reduce(root, MPI_IN_PLACE, d.data(), nb*m, mpi_op, comm);
+        else
+          mpi::reduce(root, d.data(), d.data(), nb*m, mpi_op, comm);
+        
+        if (!receiving)
+          continue;
+        
+        // sparsify each column in place: its non-zeros move to the front of
+        // its slot, and their rows to the same slot of I_out
+        #pragma omp parallel for schedule(static)
+        for (uint64_t c=0; c<nb; c++)
+        {
+          SCALAR *dc = d.data() + c*m;
+          INDEX *ic = I_out.data() + c*m;
+          
+          nnz[c] = internal::simd::sparsify(m, dc, ic, dc);
+        }
+        
+        for (uint64_t c=0; c<nb; c++)
+        {
+          if (nnz[c] > 0)
+            w.insert(cols[b + c], nnz[c], I_out.data() + c*m, d.data() + c*m);
+        }
+      }
+      
+      if (receiving)
+        w.finalize();
+    }
+    
+    
+    
+    /**
+      @brief Computes a sparse matrix (all)reduce like `dense()`, but packs as
+      many densified columns as fit in a memory budget into one buffer and
+      reduces them with a single call. Small `m` then needs few collectives,
+      while large `m` stays within the budget.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[in] budget Memory budget of the batch buffers, in bytes. Each
+      column of the batch takes `m*(sizeof(SCALAR) + sizeof(INDEX))` bytes,
+      and there is always at least one column per batch. It must be the same
+      on every rank.
+      @param[in] comm MPI communicator.
+      
+      @return An spmat object.
+      
+      @comm If the input matrix has `m` rows and `n` columns, there is one
+      allreduce of an `n`-bit column occupancy bitmap. Then, if `b` columns
+      fit in the budget, the columns which are non-empty on some rank are
+      (all)reduced `b` at a time, as one vector of length `b*m`.
+      
+      @allocs Several temporary objects are constructed. Throughout, let `m`
+      denote the number of rows, `n` the number of columns, and `b` the
+      number of columns per batch.
+        1. (all processes) The column occupancy bitmap, the list of non-empty
+        columns, and a dense buffer of `b*m` scalars.
+        2. (root process) A buffer of `b*m` indices, and the return
+        `spmat<INDEX, SCALAR>` (or the writer's container).
+      
+      @except If a memory allocation fails, a `bad_alloc` exception will be
+      thrown. If something goes wrong with any of the MPI operations, a
+      `runtime_error` exception will be thrown.
+      
+      @tparam SPMAT should be of type `spmat<INDEX, SCALAR, ...>`,
+      `spmat_view<INDEX, SCALAR, ...>`, `Eigen::SparseMatrix` (or an `Eigen::Map`
+      of one), or R's `dgCMatrix`.
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the returned `spmat`,
+      `INDEX` by default. It is independent of the input type.
+      @tparam OP is the reduction operator (see `spar::op`), `spar::op::sum`
+      by default.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET=INDEX, class OP=op::sum>
+    static inline spmat<INDEX, SCALAR, OFFSET> dense_batched(const int root,
+      const SPMAT &x, const uint64_t budget, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      spmat<INDEX, SCALAR, OFFSET> s(m, n, 0);
+      writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+      dense_batched<SPMAT, INDEX, SCALAR, OP>(root, x, w, budget, comm);
+      
+      return s;
+    }
+    
+    
+    
+    /**
+      @brief Gather (all)reduce whose result is handed to a writer instead of
+      being returned as an `spmat`. See the other overload for details.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[out] w A writer (see `spar::writers`) which receives the reduced
+      columns on the receiving processes. Use this to build the result
+      directly in its final container, e.g. an `Eigen::SparseMatrix`, a
+      `dgCMatrix`, or caller-owned CSC buffers. For a sum, the result has
+      exactly the structure computed by `symbolic()`.
+      @param[in] comm MPI communicator.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class WRITER>
+    static inline void gather(const int root, const SPMAT &x, WRITER &w, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      const int size = mpi::get_size(comm);
+      if (size == 1)
+        internal::copy_to_writer<SPMAT, INDEX, SCALAR, OP>(root, x, w);
+      else if (size <= internal::TINY_COMM_SIZE)
+        internal::gather_whole<SPMAT, INDEX, SCALAR, OP>(root, x, w, comm);
+      else
+        internal::gather_cols<SPMAT, INDEX, SCALAR, OP>(root, x, w, comm);
+    }
+    
+    
+    
+    /**
+      @brief Computes a sparse matrix (all)reduce column-by-column, where each
+      sum is computed locally after an index (all)gather and a scalar
+      (all)gather.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[in] comm MPI communicator.
+      
+      @return An spmat object. You can convert it to an Eigen or R sparse matrix
+      using the library's included converters, or avoid the conversion by
+      passing a writer instead.
+      
+      @comm If the input matrix has `n` columns, there is one allreduce of an
+      `n`-bit column occupancy bitmap, and then for each column which is
+      non-empty on some rank
+        1. allgather the number of non-zero elements
+        2. (all)gatherv the indices and values
+      Counts and displacements are 64-bit, so a column whose gathered length
+      exceeds `INT_MAX` is fine (see `spar::mpi::gatherv()`).
+      On communicators of at most 4 ranks the whole matrix is exchanged at
+      once instead: an allgather of the number of non-zero elements, a gather
+      of the column counts, and a gatherv each of the indices and values. The
+      receiving processes then hold every rank's non-zeros at the same time.
+      With a single rank there is no communication, and the result is a copy
+      of the input.
+      
+      @allocs Several temporary objects are constructed. Throughout, let `len`
+      denote the largest number of non-zero elements across all the columns.
+      Columns of the input are sent straight from its storage through a
+      non-owning view and are never copied.
+        1. (all processes) Two `dvec` vectors of 64-bit counts and
+        displacements, each with as many elements as the number of MPI ranks
+        (denot this value as `size`), and the column occupancy bitmap of
+        `n/64` words.
+        2. (root process) A `std::vector<INDEX>` and a `std::vector<SCALAR>`,
+        and a `std::vector<std::pair<INDEX, SCALAR>>`. All three have initial
+        length `len`.
+        3. (root process) The return `spmat<INDEX, SCALAR>` (or the writer's
+        container), with initial length `len`.
+      The three `std::vector`'s and the return
+      sparse matrix will resize themselves as needed during the reduce process.
+      
+      @except If a memory allocation fails, a `bad_alloc` exception will be
+      thrown. If something goes wrong with any of the MPI
+      operations, a `runtime_error` exception will be thrown.
+      
+      @tparam SPMAT should be of type `spmat<INDEX, SCALAR, ...>`,
+      `spmat_view<INDEX, SCALAR, ...>`, `Eigen::SparseMatrix` (or an `Eigen::Map`
+      of one), or R's `dgCMatrix`.
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the returned `spmat`,
+      `INDEX` by default. It is independent of the input type.
+      @tparam OP is the reduction operator (see `spar::op`), `spar::op::sum`
+      by default.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET=INDEX, class OP=op::sum>
+    static inline spmat<INDEX, SCALAR, OFFSET> gather(const int root, const SPMAT &x, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      spmat<INDEX, SCALAR, OFFSET> s(m, n, 0);
+      writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+      gather<SPMAT, INDEX, SCALAR, OP>(root, x, w, comm);
+      
+      return s;
+    }
+    
+    
+    
+    /**
+      @brief Computes the sparsity pattern of the result of `gather()` without
+      communicating any values. Use this to size output storage (for example
+      the slots of a `dgCMatrix`) before calling `gather()` with a writer.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[in] comm MPI communicator.
+      
+      @return The column pointer array (length `n+1`) of the reduced matrix on
+      the receiving processes. Its last element is the number of non-zero
+      elements. Non-receiving processes get an empty vector.
+      
+      @comm If the input matrix has `n` columns, there is one allreduce of an
+      `n`-bit column occupancy bitmap, and then for each column which is
+      non-empty on some rank
+        1. allgather the number of non-zero elements
+        2. (all)gatherv the indices
+      
+      Small communicators exchange the whole matrix at once and single ranks
+      do not communicate, as in `gather()`.
+      
+      @except If a memory allocation fails, a `bad_alloc` exception will be
+      thrown. If something goes wrong with any of the MPI
+      operations, a `runtime_error` exception will be thrown.
+      
+      @tparam SPMAT should be of type `spmat<INDEX, SCALAR, ...>`,
+      `spmat_view<INDEX, SCALAR, ...>`, `Eigen::SparseMatrix` (or an `Eigen::Map`
+      of one), or R's `dgCMatrix`.
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the type of the returned column pointers, `INDEX` by
+      default.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+    static inline std::vector<OFFSET> symbolic(const int root, const SPMAT &x, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      const int size = mpi::get_size(comm);
+      if (size == 1)
+        return internal::symbolic_local<SPMAT, INDEX, SCALAR, OFFSET>(root, x);
+      else if (size <= internal::TINY_COMM_SIZE)
+        return internal::symbolic_whole<SPMAT, INDEX, SCALAR, OFFSET>(root, x, comm);
+      else
+        return internal::symbolic_cols<SPMAT, INDEX, SCALAR, OFFSET>(root, x, comm);
+    }
+    
+    
+    
+    /**
+      @brief Hybrid MPI+OpenMP (all)reduce whose result is handed to a writer
+      instead of being returned as an `spmat`. See the other overload for
+      details.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x The thread-local matrices of this rank.
+      @param[out] w A writer (see `spar::writers`) which receives the reduced
+      columns on the receiving processes.
+      @param[in] comm MPI communicator.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET, class WRITER>
+    static inline void hybrid(const int root, const std::vector<spmat<INDEX, SCALAR, OFFSET>> &x,
+      WRITER &w, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      // bad input is only reported once every rank knows about it, so that
+      // no rank is left waiting in a collective
+      std::exception_ptr error;
+      spmat<INDEX, SCALAR, OFFSET> local;
+      const spmat<INDEX, SCALAR, OFFSET> *s = NULL;
+      try
+      {
+        if (x.empty())
+          throw std::runtime_error("every rank needs at least one matrix to reduce");
+        
+        s = &x[0];
+        if (x.size() > 1)
+        {
+          local = spar::add(x);
+          s = &local;
+        }
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+      
+      const int size = mpi::get_size(comm);
+      if (size == 1)
+      {
+        if (error)
+          std::rethrow_exception(error);
+        
+        internal::copy_to_writer<spmat<INDEX, SCALAR, OFFSET>, INDEX, SCALAR>(root, *s, w);
+        return;
+      }
+      
+      // every rank has to split the columns the same way, and every rank's
+      // local sum has to have succeeded
+      int agreed[3] = {internal::par::num_threads(), mpi::query_thread() >= MPI_THREAD_MULTIPLE, !error};
+      mpi::reduce(mpi::REDUCE_TO_ALL, MPI_IN_PLACE, agreed, 3, MPI_MIN, comm);
+      
+      if (error)
+        std::rethrow_exception(error);
+      if (!agreed[2])
+        throw std::runtime_error("invalid input to the hybrid reduce on another rank");
+      
+      const int nranges = (int) std::min((uint64_t) agreed[0], (uint64_t) s->ncols());
+      if (nranges > 1 && agreed[1])
+        internal::gather_ranges(root, *s, w, nranges, true, comm);
+      else
+        gather<spmat<INDEX, SCALAR, OFFSET>, INDEX, SCALAR>(root, *s, w, comm);
+    }
+    
+    
+    
+    /**
+      @brief Computes a sparse matrix (all)reduce of thread-local
+      contributions: every rank passes one matrix per thread (or minibatch),
+      and the result is the sum over all of them on all ranks.
+      
+      @details The matrices of a rank are first summed locally with
+      `spar::add()`, in parallel over columns. If MPI was initialized with
+      `MPI_THREAD_MULTIPLE` and there is more than one OpenMP thread, the
+      columns are then split into one block per thread and each thread
+      gathers its block like `gather()`, over its own duplicate of the
+      communicator, so the blocks are exchanged concurrently. Otherwise the
+      local sum is passed to `gather()`.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x The thread-local matrices of this rank. All must have the
+      same dimensions, on all ranks, and every rank must pass at least one.
+      @param[in] comm MPI communicator.
+      
+      @return An spmat object. You can convert it to an Eigen or R sparse matrix
+      using the library's included converters, or avoid the conversion by
+      passing a writer instead.
+      
+      @comm An allreduce of three integers to agree on the number of threads,
+      the thread support, and whether the input was valid on every rank; a
+      communicator duplication per thread; the communication of `gather()`
+      for each block of columns; and an allreduce of one integer to agree on
+      whether any block failed.
+      
+      @allocs The local sum (unless there is only one matrix), and per block
+      the allocations of `gather()` and a temporary `spmat` holding the
+      block's result on the receiving processes.
+      
+      @except If the dimensions differ within a rank or `x` is empty, a
+      `runtime_error` exception will be thrown on every rank, after the ranks
+      have agreed on it. The dimensions must also be the same on every rank;
+      that is not checked. If a memory allocation fails, a `bad_alloc`
+      exception will be thrown. If something goes wrong with any of the MPI
+      operations, a `runtime_error` exception will be thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the inputs and of the
+      returned `spmat`.
+     */
+    template <typename INDEX, typename SCALAR, typename OFFSET>
+    static inline spmat<INDEX, SCALAR, OFFSET> hybrid(const int root,
+      const std::vector<spmat<INDEX, SCALAR, OFFSET>> &x, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      spmat<INDEX, SCALAR, OFFSET> s;
+      if (!x.empty())
+        s = spmat<INDEX, SCALAR, OFFSET>(x[0].nrows(), x[0].ncols(), 0);
+      
+      writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+      hybrid(root, x, w, comm);
+      
+      return s;
+    }
+    
+    
+    
+    /**
+      @brief Computes a sparse vector (all)reduce by recursive doubling,
+      switching from sparse to dense messages once the partial sums are dense
+      enough.
+      
+      @details In every round each rank exchanges its partial sum with the
+      rank whose number differs in one bit, and adds the two. Partial sums
+      start out sparse, as sorted indices and values, and grow as the rounds
+      merge more ranks' supports. Once one has so many non-zeros that the
+      indices and values take at least as many bytes as the `n` values of the
+      dense vector, it is converted, and it and everything added to it stay
+      dense. A round only sends the index array of sparse sums. Entries which
+      cancel to zero are dropped.
+      
+      If the number of ranks is not a power of two, the ranks past the
+      largest power of two first fold their vector into a partner below it
+      and receive the result from it at the end.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x The local vector, with sorted indices less than `n`.
+      @param[in] n The length of the vector, the same on every rank.
+      @param[out] ret The sum over all ranks on the receiving processes. It
+      is zeroed on the others.
+      @param[in] comm MPI communicator.
+      
+      @comm An allreduce of one integer to agree that every rank's indices
+      are in range. Then, with `p` ranks, `log2(p)` rounds of three
+      `MPI_Sendrecv` with a single partner: a 64-bit header, then the indices (if sparse) and the
+      values. The data sent in a round is at most the smaller of the sparse
+      and the dense size of the partial sum. Ranks past the largest power of
+      two send their vector once and receive the result once. A reduce to a
+      root runs the same rounds as an allreduce.
+      
+      @allocs A copy of the local vector, the received partial sum and a merge
+      buffer, each of up to `n` elements. `ret` grows to the number of
+      non-zeros of the result.
+      
+      @except If an index of `x` is not less than `n` on any rank, a
+      `runtime_error` exception will be thrown on every rank. If a memory allocation fails, a `bad_alloc`
+      exception will be thrown. If something goes wrong with any of the MPI
+      operations, a `runtime_error` exception will be thrown.
+      
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+     */
+    template <typename INDEX, typename SCALAR>
+    static inline void vector(const int root, const spvec<INDEX, SCALAR> &x,
+      const INDEX n, spvec<INDEX, SCALAR> &ret, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      const INDEX nnz = x.get_nnz();
+      const INDEX *I = x.index_ptr();
+      const SCALAR *X = x.data_ptr();
+      
+      // negative indices wrap around to large unsigned ones; every rank has
+      // to learn of a bad index before the first exchange, or its partners
+      // would wait for it forever
+      int bad = (nnz > 0 && ((uint64_t) I[0] >= (uint64_t) n || (uint64_t) I[nnz-1] >= (uint64_t) n));
+      mpi::reduce(mpi::REDUCE_TO_ALL, MPI_IN_PLACE, &bad, 1, MPI_LOR, comm);
+      if (bad)
+        throw std::runtime_error("sparse vector index out of range on some rank");
+      
+      const int rank = mpi::get_rank(comm);
+      const int size = mpi::get_size(comm);
+      
+      internal::vector_part<INDEX, SCALAR> s, r, tmp;
+      s.dense = false;
+      s.I.assign(I, I + nnz);
+      s.X.assign(X, X + nnz);
+      if (internal::past_break_even<INDEX, SCALAR>(nnz, n))
+        internal::densify_part(s, n);
+      
+      int p2 = 1;
+      while (2*p2 <= size)
+        p2 *= 2;
+      
+      const bool folded = (rank >= p2);
+      const bool folding = (rank + p2 < size);
+      
+      if (folded)
+        internal::sendrecv_part(s, rank - p2, r, MPI_PROC_NULL, n, comm);
+      else if (folding)
+      {
+        internal::sendrecv_part(s, MPI_PROC_NULL, r, rank + p2, n, comm);
+        internal::add_part(s, r, tmp, n);
+      }
+      
+      if (!folded)
+      {
+        for (int mask=1; mask<p2; mask*=2)
+        {
+          const int partner = rank ^ mask;
+          internal::sendrecv_part(s, partner, r, partner, n, comm);
+          internal::add_part(s, r, tmp, n);
+        }
+      }
+      
+      if (folded && (root == mpi::REDUCE_TO_ALL || root == rank))
+      {
+        internal::sendrecv_part(tmp, MPI_PROC_NULL, r, rank - p2, n, comm);
+        std::swap(s, r);
+      }
+      else if (folding && (root == mpi::REDUCE_TO_ALL || root == rank + p2))
+        internal::sendrecv_part(s, rank + p2, r, MPI_PROC_NULL, n, comm);
+      
+      ret.zero();
+      if (root != mpi::REDUCE_TO_ALL && root != rank)
+        return;
+      
+      if (s.dense)
+      {
+        const INDEX out = (INDEX) internal::simd::count_nonzero((uint64_t) n, s.X.data());
+        s.I.resize(out);
+        internal::simd::sparsify(n, s.X.data(), s.I.data(), s.X.data());
+      }
+      
+      ret.set((INDEX) s.I.size(), s.I.data(), s.X.data());
+    }
+    
+    
+    
+    /**
+      @brief Masked (all)reduce whose result is handed to a writer instead of
+      being returned as an `spmat`. See the other overload for details.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[in] mask The sparsity pattern of the result.
+      @param[out] w A writer (see `spar::writers`) which receives every
+      non-empty column of the mask, with the mask's row indices.
+      @param[in] comm MPI communicator.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, class OP=op::sum, class MASK, class WRITER>
+    static inline void masked(const int root, const SPMAT &x, const MASK &mask,
+      WRITER &w, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      const bool receiving = (root == mpi::REDUCE_TO_ALL || root == mpi::get_rank(comm));
+      
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      if (mask.nrows() != m || mask.ncols() != n)
+        throw std::runtime_error("the mask must have the dimensions of the matrix");
+      
+      // the values of x at the mask's positions, column after column, with
+      // zeros where x has no entry; everything else in x is dropped here
+      const auto *MP = mask.col_ptr();
+      const INDEX *MI = mask.index_ptr();
+      const uint64_t total = (uint64_t) (MP[n] - MP[0]);
+      std::vector<SCALAR> d(total, (SCALAR) 0);
+      
+      #pragma omp parallel for schedule(dynamic, 64)
+      for (INDEX j=0; j<n; j++)
+      {
+        spvec_view<INDEX, SCALAR> v;
+        internal::get::col<INDEX, SCALAR>(j, x, v);
+        const INDEX *I = v.index_ptr();
+        const SCALAR *X = v.data_ptr();
+        
+        const uint64_t first = (uint64_t) (MP[j] - MP[0]);
+        const uint64_t last = (uint64_t) (MP[j + 1] - MP[0]);
+        INDEX k = 0;
+        for (uint64_t t=first; t<last && k<v.get_nnz(); t++)
+        {
+          while (k < v.get_nnz() && I[k] < MI[t])
+            k++;
+          
+          if (k < v.get_nnz() && I[k] == MI[t])
+            d[t] = OP::map(X[k]);
+        }
+      }
+      
+      const MPI_Op mpi_op = OP::template mpi_op<SCALAR>();
+      if (receiving)
+        mpi::reduce(root, MPI_IN_PLACE, d.data(), total, mpi_op, comm);
+      else
+        mpi::reduce(root, d.data(), d.data(), total, mpi_op, comm);
+      
+      if (!receiving)
+        return;
+      
+      w.init(m, n, (INDEX) std::min(total, (uint64_t) std::numeric_limits<INDEX>::max()));
+      
+      for (INDEX j=0; j<n; j++)
+      {
+        const uint64_t first = (uint64_t) (MP[j] - MP[0]);
+        const INDEX col_nnz = (INDEX) (MP[j + 1] - MP[j]);
+        if (col_nnz > 0)
+          w.insert(j, col_nnz, MI + first, d.data() + first);
+      }
+      
+      w.finalize();
+    }
+    
+    
+    
+    /**
+      @brief Computes a sparse matrix (all)reduce restricted to a given
+      sparsity pattern, for example the support of an existing model. Entries
+      of the input outside the mask are ignored, and the result has exactly
+      the structure of the mask.
+      
+      @details Each rank picks the values of its matrix at the mask's
+      positions, with zeros where it has no entry, before anything is
+      communicated. These are reduced as a single vector with one entry per
+      entry of the mask, so no indices are exchanged and the traffic does
+      not depend on the inputs' patterns. The mask has to be the same on
+      every rank.
+      
+      @param[in] root The number of the receiving process in the case of a
+      reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+      @param[in] x A supported sparse matrix in CSC format.
+      @param[in] mask The sparsity pattern of the result: an `spmat` or
+      `spmat_view` with the dimensions of `x` and `INDEX` row indices. Its
+      values are not used, so the scalar type does not matter.
+      @param[in] comm MPI communicator.
+      
+      @return An spmat object with the column pointers and row indices of
+      the mask. Entries which reduce to zero are stored as explicit zeros.
+      
+      @comm One (all)reduce of as many scalars as the mask has non-zero
+      elements (see `spar::mpi::reduce()`).
+      
+      @allocs A dense buffer of one scalar per entry of the mask, and on the
+      receiving processes the return `spmat` (or the writer's container).
+      
+      @except If the dimensions of the mask differ from those of `x`, a
+      `runtime_error` exception will be thrown. If a memory allocation fails,
+      a `bad_alloc` exception will be thrown. If something goes wrong with
+      any of the MPI operations, a `runtime_error` exception will be thrown.
+      
+      @tparam SPMAT should be of type `spmat<INDEX, SCALAR, ...>`,
+      `spmat_view<INDEX, SCALAR, ...>`, `Eigen::SparseMatrix` (or an `Eigen::Map`
+      of one), or R's `dgCMatrix`.
+      @tparam INDEX should be some kind of fundamental indexing type, like `int`
+      or `uint16_t`.
+      @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+      @tparam OFFSET is the column pointer type of the returned `spmat`,
+      `INDEX` by default. It is independent of the input type.
+      @tparam OP is the reduction operator (see `spar::op`), `spar::op::sum`
+      by default.
+     */
+    template <class SPMAT, typename INDEX, typename SCALAR, typename OFFSET=INDEX, class OP=op::sum, class MASK>
+    static inline spmat<INDEX, SCALAR, OFFSET> masked(const int root, const SPMAT &x,
+      const MASK &mask, MPI_Comm comm=MPI_COMM_WORLD)
+    {
+      INDEX m, n;
+      internal::get::dim<INDEX, SCALAR>(x, &m, &n);
+      
+      spmat<INDEX, SCALAR, OFFSET> s(m, n, 0);
+      writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+      masked<SPMAT, INDEX, SCALAR, OP>(root, x, mask, w, comm);
+      
       return s;
     }
   }
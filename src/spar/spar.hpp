@@ -7,11 +7,16 @@
 #pragma once
 
 
+#include "core/add.hpp"
 #include "core/defs.hpp"
 #include "core/dvec.hpp"
 #include "core/get.hpp"
+#include "core/spa.hpp"
 #include "core/spmat.hpp"
+#include "core/spmat_view.hpp"
 #include "core/spvec.hpp"
+#include "core/spvec_view.hpp"
+#include "core/writers.hpp"
 
 
 #endif
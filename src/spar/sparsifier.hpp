@@ -0,0 +1,351 @@
+// This file is part of spar which is released under the Boost Software
+// License, Version 1.0. See accompanying file LICENSE or copy at
+// https://www.boost.org/LICENSE_1_0.txt
+
+#ifndef SPAR_SPARSIFIER_H
+#define SPAR_SPARSIFIER_H
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "spar.hpp"
+#include "reduce.hpp"
+
+
+namespace spar
+{
+  namespace internal
+  {
+    // Which entries of a column are sent: those of magnitude at least
+    // `threshold` and, if `k > 0`, among them the `k` largest. Entries tied
+    // at the k-th magnitude are taken in row order. An entry is kept if its
+    // magnitude exceeds `cut`, or equals it and fewer than `ties` equal ones
+    // came before.
+    template <typename SCALAR>
+    struct col_selection
+    {
+      SCALAR cut;
+      uint64_t ties;
+      uint64_t kept;
+    };
+    
+    template <typename SCALAR>
+    static inline bool keep_entry(const SCALAR v, col_selection<SCALAR> &sel)
+    {
+      const SCALAR a = magnitude(v);
+      if (a > sel.cut)
+        return true;
+      else if (a == sel.cut && sel.ties > 0)
+      {
+        sel.ties--;
+        return true;
+      }
+      else
+        return false;
+    }
+    
+    template <typename SCALAR>
+    static inline col_selection<SCALAR> select_col(const uint64_t len,
+      const SCALAR *X, const uint64_t k, const SCALAR threshold,
+      std::vector<SCALAR> &work)
+    {
+      work.clear();
+      for (uint64_t t=0; t<len; t++)
+      {
+        const SCALAR a = magnitude(X[t]);
+        if (a != (SCALAR) 0 && a >= threshold)
+          work.push_back(a);
+      }
+      
+      col_selection<SCALAR> sel;
+      if (k == 0 || work.size() <= k)
+      {
+        // everything non-zero at or above the threshold
+        sel.cut = threshold;
+        sel.ties = 0;
+        for (uint64_t t=0; t<work.size(); t++)
+        {
+          if (work[t] == threshold)
+            sel.ties++;
+        }
+        
+        sel.kept = work.size();
+        return sel;
+      }
+      
+      std::nth_element(work.begin(), work.begin() + (k - 1), work.end(), std::greater<SCALAR>());
+      sel.cut = work[k - 1];
+      
+      uint64_t above = 0;
+      for (uint64_t t=0; t<k; t++)
+      {
+        if (work[t] > sel.cut)
+          above++;
+      }
+      
+      sel.ties = k - above;
+      sel.kept = k;
+      return sel;
+    }
+  }
+  
+  
+  
+  /**
+    @brief Sparsified (all)reduce with error feedback, for gradient-like
+    matrices where only the largest contributions matter. Before each
+    reduction, every column keeps only its entries of magnitude at least a
+    threshold and, optionally, only the `k` largest of them. What is dropped
+    is remembered in a per-rank residual matrix and added to the input of
+    the next call, so nothing is lost, only delayed.
+    
+    @details Each rank sends at most `k` entries per column, so the volume of
+    `spar::reduce::gather()` is bounded by `k` times the number of columns
+    times the number of ranks. The approximation error of a call is the
+    residual, which `get_residual()` returns.
+    
+    @tparam INDEX should be some kind of fundamental indexing type, like `int`
+    or `uint16_t`.
+    @tparam SCALAR should be a fundamental numeric type like `int` or `float`.
+    @tparam OFFSET is the column pointer type of the inputs, the residual and
+    the result, as in `spmat`.
+   */
+  template <typename INDEX, typename SCALAR, typename OFFSET=INDEX>
+  class sparsifier
+  {
+    public:
+      sparsifier(const INDEX nrows_, const INDEX ncols_, const INDEX k_=0,
+        const SCALAR threshold_=0);
+      
+      spmat<INDEX, SCALAR, OFFSET> reduce(const int root,
+        const spmat<INDEX, SCALAR, OFFSET> &x, MPI_Comm comm=MPI_COMM_WORLD);
+      template <class WRITER>
+      void reduce(const int root, const spmat<INDEX, SCALAR, OFFSET> &x,
+        WRITER &w, MPI_Comm comm=MPI_COMM_WORLD);
+      void reset();
+      
+      /// Set the number of entries kept per column; 0 keeps all.
+      void set_k(const INDEX k_) {k = k_;};
+      /// Set the smallest magnitude which is sent.
+      void set_threshold(const SCALAR threshold_) {threshold = threshold_;};
+      /// The entries held back so far, to be added to the next input.
+      const spmat<INDEX, SCALAR, OFFSET>& get_residual() const {return residual;};
+      /// Number of entries this rank sent in the last reduction.
+      OFFSET get_sent() const {return sent;};
+    
+    protected:
+      /// Number of rows.
+      INDEX m;
+      /// Number of columns.
+      INDEX n;
+      /// Entries kept per column, or 0 for all.
+      INDEX k;
+      /// Smallest magnitude sent.
+      SCALAR threshold;
+      /// Entries sent in the last reduction.
+      OFFSET sent;
+      /// Dropped entries, carried to the next call.
+      spmat<INDEX, SCALAR, OFFSET> residual;
+    
+    private:
+      void split(const spmat<INDEX, SCALAR, OFFSET> &x,
+        spmat<INDEX, SCALAR, OFFSET> &kept, spmat<INDEX, SCALAR, OFFSET> &dropped) const;
+  };
+}
+
+
+
+// ----------------------------------------------------------------------------
+// constructor
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Constructor.
+  
+  @param[in] nrows_,ncols_ The dimension of the matrices to reduce.
+  @param[in] k_ Entries kept per column, or 0 to keep all that pass the
+  threshold.
+  @param[in] threshold_ The smallest magnitude which is sent.
+  
+  @allocs An empty residual matrix.
+  
+  @except If a memory allocation fails, a `bad_alloc` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::sparsifier<INDEX, SCALAR, OFFSET>::sparsifier(const INDEX nrows_,
+  const INDEX ncols_, const INDEX k_, const SCALAR threshold_)
+: residual(nrows_, ncols_, 0)
+{
+  m = nrows_;
+  n = ncols_;
+  k = k_;
+  threshold = threshold_;
+  sent = 0;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// reduction
+// ----------------------------------------------------------------------------
+
+/**
+  @brief Add the residual to the input, send its largest entries through
+  `spar::reduce::gather()`, and keep the rest as the new residual. Every rank
+  of `comm` has to call this.
+  
+  @param[in] root The number of the receiving process in the case of a
+  reduce, or `spar::mpi::REDUCE_TO_ALL` for an allreduce.
+  @param[in] x This rank's contribution.
+  @param[in] comm MPI communicator.
+  
+  @return The sum over all ranks of the kept entries on the receiving
+  processes, and an empty matrix of the same dimensions on the others.
+  
+  @comm See `spar::reduce::gather()`.
+  
+  @allocs The corrected input, the kept entries and the new residual, each
+  sized exactly, plus the allocations of `spar::reduce::gather()`.
+  
+  @except If `x` has the wrong dimensions, a `runtime_error` exception will be
+  thrown. If a memory allocation fails, a `bad_alloc` exception will be
+  thrown. If something goes wrong with any of the MPI operations, a
+  `runtime_error` exception will be thrown.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+spar::spmat<INDEX, SCALAR, OFFSET> spar::sparsifier<INDEX, SCALAR, OFFSET>::reduce(
+  const int root, const spmat<INDEX, SCALAR, OFFSET> &x, MPI_Comm comm)
+{
+  spmat<INDEX, SCALAR, OFFSET> s(m, n, 0);
+  writers::spmat_writer<INDEX, SCALAR, OFFSET> w(s);
+  reduce(root, x, w, comm);
+  
+  return s;
+}
+
+
+
+/**
+  @brief \overload
+  
+  @param[out] w A writer (see `spar::writers`) which receives the reduced
+  columns on the receiving processes.
+ */
+template <typename INDEX, typename SCALAR, typename OFFSET>
+template <class WRITER>
+void spar::sparsifier<INDEX, SCALAR, OFFSET>::reduce(const int root,
+  const spmat<INDEX, SCALAR, OFFSET> &x, WRITER &w, MPI_Comm comm)
+{
+  if (x.nrows() != m || x.ncols() != n)
+    throw std::runtime_error("input dimensions do not match the sparsifier");
+  
+  spmat<INDEX, SCALAR, OFFSET> kept;
+  spmat<INDEX, SCALAR, OFFSET> dropped;
+  if (residual.get_nnz() == 0)
+    split(x, kept, dropped);
+  else
+    split(x + residual, kept, dropped);
+  
+  residual = dropped;
+  sent = kept.get_nnz();
+  
+  spar::reduce::gather<spmat<INDEX, SCALAR, OFFSET>, INDEX, SCALAR>(root, kept, w, comm);
+}
+
+
+
+/// Forget the residual.
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::sparsifier<INDEX, SCALAR, OFFSET>::reset()
+{
+  residual = spmat<INDEX, SCALAR, OFFSET>(m, n, 0);
+  sent = 0;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// internals
+// ----------------------------------------------------------------------------
+
+// split x into the entries to send and the rest; both are sized exactly
+template <typename INDEX, typename SCALAR, typename OFFSET>
+void spar::sparsifier<INDEX, SCALAR, OFFSET>::split(const spmat<INDEX, SCALAR, OFFSET> &x,
+  spmat<INDEX, SCALAR, OFFSET> &kept, spmat<INDEX, SCALAR, OFFSET> &dropped) const
+{
+  const uint64_t plen = (uint64_t) n + 1;
+  const OFFSET *P = x.col_ptr();
+  const INDEX *I = x.index_ptr();
+  const SCALAR *X = x.data_ptr();
+  
+  std::vector<internal::col_selection<SCALAR>> sel(n);
+  std::vector<OFFSET> kP(plen, 0);
+  std::vector<OFFSET> dP(plen, 0);
+  
+  #pragma omp parallel
+  {
+    std::vector<SCALAR> work;
+    
+    #pragma omp for schedule(dynamic, 64)
+    for (INDEX j=0; j<n; j++)
+    {
+      const uint64_t len = (uint64_t) (P[j+1] - P[j]);
+      sel[j] = internal::select_col(len, X + P[j], (uint64_t) k, threshold, work);
+      
+      uint64_t nonzero = 0;
+      for (OFFSET t=P[j]; t<P[j+1]; t++)
+        nonzero += (X[t] != (SCALAR) 0);
+      
+      kP[j] = (OFFSET) sel[j].kept;
+      dP[j] = (OFFSET) (nonzero - sel[j].kept);
+    }
+  }
+  
+  internal::par::exclusive_scan(plen, kP.data());
+  internal::par::exclusive_scan(plen, dP.data());
+  
+  kept = spmat<INDEX, SCALAR, OFFSET>(m, n, kP[n]);
+  dropped = spmat<INDEX, SCALAR, OFFSET>(m, n, dP[n]);
+  
+  INDEX *kI = kept.index_ptr();
+  SCALAR *kX = kept.data_ptr();
+  INDEX *dI = dropped.index_ptr();
+  SCALAR *dX = dropped.data_ptr();
+  
+  #pragma omp parallel for schedule(dynamic, 64)
+  for (INDEX j=0; j<n; j++)
+  {
+    OFFSET kt = kP[j];
+    OFFSET dt = dP[j];
+    for (OFFSET t=P[j]; t<P[j+1]; t++)
+    {
+      if (X[t] == (SCALAR) 0)
+        continue;
+      else if (internal::keep_entry(X[t], sel[j]))
+      {
+        kI[kt] = I[t];
+        kX[kt] = X[t];
+        kt++;
+      }
+      else
+      {
+        dI[dt] = I[t];
+        dX[dt] = X[t];
+        dt++;
+      }
+    }
+  }
+  
+  arraytools::copy(plen, kP.data(), kept.col_ptr());
+  arraytools::copy(plen, dP.data(), dropped.col_ptr());
+  kept.update_nnz();
+  dropped.update_nnz();
+}
+
+
+#endif
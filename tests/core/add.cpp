@@ -28,6 +28,52 @@ TEMPLATE_PRODUCT_TEST_CASE("add sparse-sparse", "[spvec]", spar::spvec, (
   
   REQUIRE( x.get_len() == len );
   REQUIRE( x.get_nnz() == 7 );
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  const INDEX I_true[7] = {0, 1, 3, 4, 6, 7, 12};
+  const SCALAR X_true[7] = {1, 2, 2, 3, 2, 2, 2};
+  for (int k=0; k<7; k++)
+  {
+    REQUIRE( x.index_ptr()[k] == I_true[k] );
+    REQUIRE( x.data_ptr()[k] == X_true[k] );
+  }
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("add sparse-sparse with growth", "[spvec]", spar::spvec, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  TestType x(2);
+  x.insert(5, 1);
+  
+  // interleaved, so every other entry of y is new
+  const int ylen = 40;
+  TestType y(ylen);
+  for (int i=0; i<ylen; i++)
+    y.insert(i, 1);
+  
+  x.add(y);
+  
+  using INDEX = decltype(x.get_nnz());
+  REQUIRE( x.get_nnz() == (INDEX) ylen );
+  REQUIRE( x.get_len() >= (INDEX) ylen );
+  for (int i=0; i<ylen; i++)
+  {
+    REQUIRE( x.index_ptr()[i] == (INDEX) i );
+    REQUIRE( x.get(i) == (i == 5 ? 2 : 1) );
+  }
+  
+  // adding to itself doubles every entry in place
+  x.add(x);
+  REQUIRE( x.get_nnz() == (INDEX) ylen );
+  REQUIRE( x.get(5) == 4 );
+  REQUIRE( x.get(ylen - 1) == 2 );
 }
 
 
@@ -53,4 +99,103 @@ TEMPLATE_PRODUCT_TEST_CASE("add sparse-dense", "[spvec]", spar::spvec, (
   
   REQUIRE( x.get_len() == len );
   REQUIRE( x.get_nnz() == 7 );
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  const INDEX I_true[7] = {0, 1, 2, 4, 6, 7, 12};
+  const SCALAR X_true[7] = {1, 2, 2, 3, 2, 3, 2};
+  for (int k=0; k<7; k++)
+  {
+    REQUIRE( x.index_ptr()[k] == I_true[k] );
+    REQUIRE( x.data_ptr()[k] == X_true[k] );
+  }
+  
+  // no new indices, so everything lands on existing ones
+  x.add(y, ylen);
+  REQUIRE( x.get_nnz() == 7 );
+  REQUIRE( x.get(0) == 1 );
+  REQUIRE( x.get(7) == 5 );
+  REQUIRE( x.get(12) == 4 );
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("add sparse matrices", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  TestType s;
+  
+  using INDEX = decltype(s.get_nnz());
+  using SCALAR = decltype(+*s.data_ptr());
+  
+  // (2,1) cancels between the last two
+  const INDEX rows_a[4] = {0, 3, 1, 2};
+  const INDEX cols_a[4] = {0, 0, 2, 3};
+  const SCALAR vals_a[4] = {1, 2, 3, 4};
+  const INDEX rows_b[3] = {3, 2, 2};
+  const INDEX cols_b[3] = {0, 1, 3};
+  const SCALAR vals_b[3] = {5, 1, 6};
+  const INDEX rows_c[2] = {2, 0};
+  const INDEX cols_c[2] = {1, 3};
+  const SCALAR vals_c[2] = {(SCALAR) -1, 7};
+  
+  std::vector<TestType> x;
+  x.push_back(TestType::from_triplets(4, 4, 4, rows_a, cols_a, vals_a));
+  x.push_back(TestType::from_triplets(4, 4, 3, rows_b, cols_b, vals_b));
+  x.push_back(TestType::from_triplets(4, 4, 2, rows_c, cols_c, vals_c));
+  
+  s = spar::add(x);
+  REQUIRE( s.nrows() == 4 );
+  REQUIRE( s.ncols() == 4 );
+  REQUIRE( s.get_nnz() == 5 );
+  
+  const INDEX P[5] = {0, 2, 2, 3, 5};
+  const INDEX I[5] = {0, 3, 1, 0, 2};
+  const SCALAR X[5] = {1, 7, 3, 7, 10};
+  for (int j=0; j<5; j++)
+    REQUIRE( s.col_ptr()[j] == P[j] );
+  for (int i=0; i<5; i++)
+  {
+    REQUIRE( s.index_ptr()[i] == I[i] );
+    REQUIRE( s.data_ptr()[i] == X[i] );
+  }
+  
+  TestType t = x[0] + x[1];
+  REQUIRE( t.get_nnz() == 5 );
+  REQUIRE( t.col_ptr()[1] == 2 );
+  REQUIRE( t.data_ptr()[0] == 1 );
+  REQUIRE( t.data_ptr()[1] == 7 );
+  
+  x.resize(1);
+  TestType u = spar::add(x);
+  REQUIRE( u.get_nnz() == 4 );
+  REQUIRE( u.data_ptr()[3] == 4 );
+  
+  // a single input goes through the same merge, so explicit zeros go too
+  TestType z(4, 2, 3);
+  z.col_ptr()[1] = 2;
+  z.col_ptr()[2] = 3;
+  z.index_ptr()[0] = 1; z.data_ptr()[0] = 0;
+  z.index_ptr()[1] = 3; z.data_ptr()[1] = 2;
+  z.index_ptr()[2] = 0; z.data_ptr()[2] = 5;
+  z.update_nnz(3);
+  
+  x.assign(1, z);
+  TestType v = spar::add(x);
+  REQUIRE( v.get_nnz() == 2 );
+  REQUIRE( v.col_ptr()[1] == 1 );
+  REQUIRE( v.col_ptr()[2] == 2 );
+  REQUIRE( v.index_ptr()[0] == 3 );
+  REQUIRE( v.data_ptr()[1] == 5 );
+  
+  x.clear();
+  REQUIRE( spar::add(x).ncols() == 0 );
+  
+  x.push_back(TestType(4, 4, 1));
+  x.push_back(TestType(4, 5, 1));
+  REQUIRE_THROWS_AS( spar::add(x), std::runtime_error );
 }
@@ -0,0 +1,164 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <io/binary.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+
+TEMPLATE_PRODUCT_TEST_CASE("save/load binary", "[io]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  TestType x(m, n, 20);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  spar::spvec<INDEX, SCALAR> s(8);
+  s.insert(1, 1);
+  s.insert(4, 2);
+  x.insert(0, s);
+  
+  s.zero();
+  s.insert(3, 1);
+  s.insert(5, 2);
+  s.insert(6, 3);
+  x.insert(6, s);
+  
+  const char *filename = "spar_test_io.bin";
+  spar::io::save(filename, x);
+  
+  auto y = spar::io::load<INDEX, SCALAR>(filename);
+  REQUIRE( y.nrows() == m );
+  REQUIRE( y.ncols() == n );
+  REQUIRE( y.get_nnz() == x.get_nnz() );
+  
+  auto v = y.view();
+  for (int j=0; j<=n; j++)
+    REQUIRE( v.col_ptr()[j] == x.col_ptr()[j] );
+  for (INDEX i=0; i<x.get_nnz(); i++)
+  {
+    REQUIRE( v.index_ptr()[i] == x.index_ptr()[i] );
+    REQUIRE( v.data_ptr()[i] == x.data_ptr()[i] );
+  }
+  
+  REQUIRE( ((uintptr_t) v.data_ptr()) % 64 == 0 );
+  
+  REQUIRE_THROWS_AS( (spar::io::load<INDEX, float>(filename)), std::runtime_error );
+  REQUIRE_THROWS_AS( (spar::io::load<int64_t, SCALAR>(filename)), std::runtime_error );
+  
+  std::remove(filename);
+}
+
+
+
+TEST_CASE("save/load binary wide offsets", "[io]")
+{
+  spar::spmat<uint16_t, double, int64_t> x(10, 4, 4);
+  
+  spar::spvec<uint16_t, double> s(10);
+  s.insert(2, 1.5);
+  s.insert(7, 2.5);
+  x.insert(1, s);
+  x.insert(3, s);
+  
+  const char *filename = "spar_test_io_offset.bin";
+  spar::io::save(filename, x);
+  
+  auto y = spar::io::load<uint16_t, double, int64_t>(filename);
+  REQUIRE( y.get_nnz() == 4 );
+  
+  auto v = y.view();
+  for (int j=0; j<=4; j++)
+    REQUIRE( v.col_ptr()[j] == x.col_ptr()[j] );
+  REQUIRE( v.data_ptr()[3] == 2.5 );
+  
+  REQUIRE_THROWS_AS( (spar::io::load<uint16_t, double>(filename)), std::runtime_error );
+  
+  std::remove(filename);
+}
+
+
+
+// overwrite len bytes of a file at pos
+static void patch(const char *filename, const long pos, const void *bytes, const size_t len)
+{
+  FILE *fp = fopen(filename, "r+b");
+  fseek(fp, pos, SEEK_SET);
+  fwrite(bytes, 1, len, fp);
+  fclose(fp);
+}
+
+// copy the first len bytes of a file
+static void copy_prefix(const char *in, const char *out, const size_t len)
+{
+  std::vector<char> buf(len);
+  FILE *fp = fopen(in, "rb");
+  const size_t nread = fread(buf.data(), 1, len, fp);
+  fclose(fp);
+  
+  fp = fopen(out, "wb");
+  fwrite(buf.data(), 1, nread, fp);
+  fclose(fp);
+}
+
+TEST_CASE("load corrupt binary", "[io]")
+{
+  using header = spar::io::internal::binary::header;
+  
+  spar::spmat<int, double> x(10, 4, 4);
+  spar::spvec<int, double> s(10);
+  s.insert(2, 1.5);
+  s.insert(7, 2.5);
+  x.insert(1, s);
+  x.insert(3, s);
+  
+  const char *good = "spar_test_io_good.bin";
+  const char *bad = "spar_test_io_bad.bin";
+  spar::io::save(good, x);
+  
+  header h;
+  FILE *fp = fopen(good, "rb");
+  REQUIRE( fread(&h, sizeof(h), 1, fp) == 1 );
+  fclose(fp);
+  
+  REQUIRE_NOTHROW( (spar::io::load<int, double>(good)) );
+  
+  // a section offset pointing past the end of the file
+  copy_prefix(good, bad, h.file_size);
+  const uint64_t far = h.file_size + 4096;
+  patch(bad, offsetof(header, X_offset), &far, sizeof(far));
+  REQUIRE_THROWS_AS( (spar::io::load<int, double>(bad)), std::runtime_error );
+  
+  // more non-zeros than the sections hold
+  copy_prefix(good, bad, h.file_size);
+  const uint64_t nnz = h.nnz + 100;
+  patch(bad, offsetof(header, nnz), &nnz, sizeof(nnz));
+  REQUIRE_THROWS_AS( (spar::io::load<int, double>(bad)), std::runtime_error );
+  
+  // absurd dimensions
+  copy_prefix(good, bad, h.file_size);
+  const uint64_t n = ~(uint64_t) 0;
+  patch(bad, offsetof(header, n), &n, sizeof(n));
+  REQUIRE_THROWS_AS( (spar::io::load<int, double>(bad)), std::runtime_error );
+  
+  // last column pointer disagreeing with the header
+  copy_prefix(good, bad, h.file_size);
+  const int P_last = 3;
+  patch(bad, h.P_offset + 4*sizeof(int), &P_last, sizeof(P_last));
+  REQUIRE_THROWS_AS( (spar::io::load<int, double>(bad)), std::runtime_error );
+  
+  // cut off inside the data
+  copy_prefix(good, bad, h.X_offset + 8);
+  REQUIRE_THROWS_AS( (spar::io::load<int, double>(bad)), std::runtime_error );
+  
+  std::remove(good);
+  std::remove(bad);
+}
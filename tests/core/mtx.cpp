@@ -0,0 +1,115 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <io/mtx.hpp>
+
+#include <cstdio>
+
+
+static void write_file(const char *filename, const char *contents)
+{
+  FILE *fp = fopen(filename, "w");
+  fputs(contents, fp);
+  fclose(fp);
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("read_mtx/write_mtx", "[io]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  TestType x;
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  const char *filename = "spar_test_io.mtx";
+  spar::spvec<INDEX, SCALAR> s(5);
+  
+  write_file(filename,
+    "%%MatrixMarket matrix coordinate integer general\n"
+    "% a comment\n"
+    "5 4 5\n"
+    "4 3 7\n"
+    "1 1 1\n"
+    "2 3 5\n"
+    "5 4 2\n"
+    "3 1 3"
+  );
+  
+  x = spar::io::read_mtx<INDEX, SCALAR>(filename);
+  REQUIRE( x.nrows() == 5 );
+  REQUIRE( x.ncols() == 4 );
+  REQUIRE( x.get_nnz() == 5 );
+  
+  x.get_col(0, s);
+  REQUIRE( s.get_nnz() == 2 );
+  REQUIRE( s.get(0) == (SCALAR) 1 );
+  REQUIRE( s.get(2) == (SCALAR) 3 );
+  x.get_col(1, s);
+  REQUIRE( s.get_nnz() == 0 );
+  x.get_col(2, s);
+  REQUIRE( s.index_ptr()[0] == 1 );
+  REQUIRE( s.index_ptr()[1] == 3 );
+  REQUIRE( s.get(3) == (SCALAR) 7 );
+  
+  spar::io::write_mtx(filename, x);
+  TestType y = spar::io::read_mtx<INDEX, SCALAR>(filename);
+  REQUIRE( y.nrows() == x.nrows() );
+  REQUIRE( y.ncols() == x.ncols() );
+  REQUIRE( y.get_nnz() == x.get_nnz() );
+  for (int j=0; j<=4; j++)
+    REQUIRE( y.col_ptr()[j] == x.col_ptr()[j] );
+  for (INDEX i=0; i<x.get_nnz(); i++)
+  {
+    REQUIRE( y.index_ptr()[i] == x.index_ptr()[i] );
+    REQUIRE( y.data_ptr()[i] == x.data_ptr()[i] );
+  }
+  
+  write_file(filename,
+    "%%MatrixMarket matrix coordinate pattern symmetric\n"
+    "4 4 3\n"
+    "1 1\n"
+    "3 1\n"
+    "4 2\n"
+  );
+  
+  x = spar::io::read_mtx<INDEX, SCALAR>(filename);
+  REQUIRE( x.get_nnz() == 5 );
+  x.get_col(0, s);
+  REQUIRE( s.get(0) == (SCALAR) 1 );
+  REQUIRE( s.get(2) == (SCALAR) 1 );
+  x.get_col(1, s);
+  REQUIRE( s.get(3) == (SCALAR) 1 );
+  x.get_col(2, s);
+  REQUIRE( s.get(0) == (SCALAR) 1 );
+  x.get_col(3, s);
+  REQUIRE( s.get(1) == (SCALAR) 1 );
+  
+  write_file(filename,
+    "%%MatrixMarket matrix coordinate real general\n"
+    "4 4 2\n"
+    "1 1 1\n"
+  );
+  REQUIRE_THROWS_AS( (spar::io::read_mtx<INDEX, SCALAR>(filename)), std::runtime_error );
+  
+  write_file(filename,
+    "%%MatrixMarket matrix coordinate real general\n"
+    "4 4 1\n"
+    "5 1 1\n"
+  );
+  REQUIRE_THROWS_AS( (spar::io::read_mtx<INDEX, SCALAR>(filename)), std::runtime_error );
+  
+  write_file(filename,
+    "%%MatrixMarket matrix array real general\n"
+    "2 1\n"
+    "1\n"
+    "2\n"
+  );
+  REQUIRE_THROWS_AS( (spar::io::read_mtx<INDEX, SCALAR>(filename)), std::runtime_error );
+  
+  std::remove(filename);
+}
@@ -0,0 +1,109 @@
+#include <catch.hpp>
+#include <spar.hpp>
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace spar::internal;
+
+
+// lengths around the vector widths, with zeros, negative zeros and NaNs
+template <typename SCALAR>
+static std::vector<SCALAR> test_data(const int len)
+{
+  std::vector<SCALAR> x(len);
+  for (int i=0; i<len; i++)
+  {
+    if (i % 3 == 0)
+      x[i] = 0;
+    else if (i % 7 == 1)
+      x[i] = -(SCALAR) 0;
+    else
+      x[i] = (SCALAR) (i % 5) - 2;
+  }
+  
+  // 0 for the integer types
+  if (len > 4)
+    x[len - 4] = std::numeric_limits<SCALAR>::quiet_NaN();
+  
+  return x;
+}
+
+
+
+TEMPLATE_TEST_CASE("simd kernels", "[simd]", int, uint32_t, float, double)
+{
+  for (int len=0; len<=67; len++)
+  {
+    std::vector<TestType> x = test_data<TestType>(len);
+    
+    const uint64_t nnz = simd::count_nonzero_scalar(len, x.data());
+    REQUIRE( simd::count_nonzero(len, x.data()) == nnz );
+    
+    std::vector<int> I(len);
+    std::vector<int> I_ref(len);
+    std::vector<TestType> X(len);
+    REQUIRE( simd::find_nonzero(len, x.data(), I.data()) == (int) nnz );
+    REQUIRE( simd::sparsify_scalar(len, x.data(), I_ref.data(), X.data()) == (int) nnz );
+    REQUIRE( I == I_ref );
+    
+    // in place
+    std::vector<TestType> y = x;
+    REQUIRE( simd::sparsify(len, y.data(), I.data(), y.data()) == (int) nnz );
+    REQUIRE( I == I_ref );
+    REQUIRE( std::memcmp(y.data(), X.data(), nnz*sizeof(TestType)) == 0 );
+    
+    // zeros are skipped, so scattering back gives the input up to their signs
+    std::vector<TestType> d(len, 0);
+    simd::scatter(nnz, I.data(), y.data(), d.data());
+    bool same = true;
+    for (int i=0; i<len; i++)
+      same = same && (d[i] == x[i] || (x[i] != x[i] && d[i] != d[i]));
+    
+    REQUIRE( same );
+  }
+}
+
+
+
+#ifdef SPAR_SIMD_X86
+TEMPLATE_TEST_CASE("simd kernels by level", "[simd]", float, double)
+{
+  const int level = simd::level();
+  
+  for (int len=0; len<=67; len++)
+  {
+    std::vector<TestType> x = test_data<TestType>(len);
+    
+    std::vector<uint16_t> I_ref(len);
+    std::vector<TestType> X_ref(len);
+    const uint16_t nnz = simd::sparsify_scalar((uint16_t) len, x.data(), I_ref.data(), X_ref.data());
+    
+    std::vector<uint16_t> I(len);
+    std::vector<TestType> X(len);
+    
+    if (level >= simd::LEVEL_AVX2)
+    {
+      REQUIRE( simd::count_nonzero_avx2(len, x.data()) == nnz );
+      REQUIRE( simd::find_nonzero_avx2((uint16_t) len, x.data(), I.data()) == nnz );
+      REQUIRE( I == I_ref );
+      
+      REQUIRE( simd::sparsify_avx2((uint16_t) len, x.data(), I.data(), X.data()) == nnz );
+      REQUIRE( I == I_ref );
+      REQUIRE( std::memcmp(X.data(), X_ref.data(), nnz*sizeof(TestType)) == 0 );
+    }
+    
+    if (level >= simd::LEVEL_AVX512)
+    {
+      REQUIRE( simd::count_nonzero_avx512(len, x.data()) == nnz );
+      REQUIRE( simd::find_nonzero_avx512((uint16_t) len, x.data(), I.data()) == nnz );
+      REQUIRE( I == I_ref );
+      
+      REQUIRE( simd::sparsify_avx512((uint16_t) len, x.data(), I.data(), X.data()) == nnz );
+      REQUIRE( I == I_ref );
+      REQUIRE( std::memcmp(X.data(), X_ref.data(), nnz*sizeof(TestType)) == 0 );
+    }
+  }
+}
+#endif
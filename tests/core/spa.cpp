@@ -0,0 +1,107 @@
+#include <catch.hpp>
+#include <spar.hpp>
+
+
+TEMPLATE_PRODUCT_TEST_CASE("spa add/extract", "[spa]", spar::spa, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int len = 10;
+  TestType x(len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  REQUIRE( x.get_len() == (INDEX)len );
+  REQUIRE( x.get_nnz() == 0 );
+  
+  x.add(7, 1);
+  x.add(2, 3);
+  x.add(7, 2);
+  x.add(5, 1);
+  REQUIRE( x.get_nnz() == 3 );
+  REQUIRE( x.get(7) == 3 );
+  
+  INDEX I[3];
+  SCALAR X[3];
+  INDEX nnz = x.extract(I, X);
+  REQUIRE( nnz == 3 );
+  REQUIRE( I[0] == 2 );
+  REQUIRE( I[1] == 5 );
+  REQUIRE( I[2] == 7 );
+  REQUIRE( X[0] == 3 );
+  REQUIRE( X[1] == 1 );
+  REQUIRE( X[2] == 3 );
+  
+  x.zero();
+  REQUIRE( x.get_nnz() == 0 );
+  for (int i=0; i<len; i++)
+    REQUIRE( x.get(i) == 0 );
+  
+  const INDEX vI[2] = {1, 9};
+  const SCALAR vX[2] = {4, 5};
+  x.add(spar::spvec_view<INDEX, SCALAR>(2, vI, vX));
+  nnz = x.extract(I, X);
+  REQUIRE( nnz == 2 );
+  REQUIRE( I[0] == 1 );
+  REQUIRE( I[1] == 9 );
+  REQUIRE( X[1] == 5 );
+  
+  // mostly full and out of order, so extracted with a scan of the flags
+  x.zero();
+  for (int i=len-1; i>0; i--)
+    x.add(i, 1);
+  
+  INDEX I_full[len];
+  SCALAR X_full[len];
+  REQUIRE( x.extract(I_full, X_full) == (INDEX) (len - 1) );
+  for (int i=0; i<len-1; i++)
+    REQUIRE( I_full[i] == (INDEX) (i + 1) );
+  
+  const INDEX bad[1] = {10};
+  REQUIRE_THROWS_AS( x.add(spar::spvec_view<INDEX, SCALAR>(1, bad, vX)), std::logic_error );
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("spa rescan", "[spa]", spar::spa, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int len = 8;
+  TestType x(len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  x.add(3, 1);
+  
+  // as if a reduction wrote into the buffer
+  SCALAR *d = x.data_ptr();
+  d[3] = 0;
+  d[6] = 2;
+  d[0] = 1;
+  x.rescan();
+  REQUIRE( x.get_nnz() == 2 );
+  
+  INDEX I[2];
+  SCALAR X[2];
+  REQUIRE( x.extract(I, X) == 2 );
+  REQUIRE( I[0] == 0 );
+  REQUIRE( I[1] == 6 );
+  
+  x.zero();
+  for (int i=0; i<len; i++)
+    REQUIRE( x.get(i) == 0 );
+  
+  x.resize(20);
+  REQUIRE( x.get_len() == 20 );
+  x.add(19, 1);
+  REQUIRE( x.get(19) == 1 );
+}
@@ -1,6 +1,13 @@
 #include <catch.hpp>
 #include <spar.hpp>
 
+#include <cstdint>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 
 TEMPLATE_PRODUCT_TEST_CASE("construct", "[spmat]", spar::spmat, (
   (int, int),      (int, uint32_t),      (int, double),
@@ -170,3 +177,149 @@ TEMPLATE_PRODUCT_TEST_CASE("get_col", "[spmat]", spar::spmat, (
   x.get_col(7, s);
   REQUIRE( s.get_nnz() == 1 );
 }
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("from_triplets", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  TestType x;
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  const INDEX rows[8] = {4, 0, 2, 4, 1, 3, 0, 2};
+  const INDEX cols[8] = {2, 0, 2, 2, 3, 2, 0, 1};
+  const SCALAR vals[8] = {1, 2, 3, 4, 0, 5, 6, 7};
+  
+  x = TestType::from_triplets(5, 4, 8, rows, cols, vals);
+  REQUIRE( x.nrows() == 5 );
+  REQUIRE( x.ncols() == 4 );
+  REQUIRE( x.get_nnz() == 5 );
+  REQUIRE( x.get_len() == 5 );
+  
+  const INDEX P[5] = {0, 1, 2, 5, 5};
+  const INDEX I[5] = {0, 2, 2, 3, 4};
+  const SCALAR X[5] = {8, 7, 3, 5, 5};
+  for (int j=0; j<5; j++)
+    REQUIRE( x.col_ptr()[j] == P[j] );
+  for (int i=0; i<5; i++)
+  {
+    REQUIRE( x.index_ptr()[i] == I[i] );
+    REQUIRE( x.data_ptr()[i] == X[i] );
+  }
+  
+  const INDEX bad_rows[1] = {5};
+  REQUIRE_THROWS_AS( TestType::from_triplets(5, 4, 1, bad_rows, cols, vals), std::runtime_error );
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("from_triplets many chunks", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  using INDEX = decltype(TestType().get_nnz());
+  using SCALAR = decltype(+*TestType().data_ptr());
+  
+  // far more triplets than columns, so that every thread gets a chunk with
+  // its own histogram
+#ifdef _OPENMP
+  const int nthreads = omp_get_max_threads();
+  omp_set_num_threads(4);
+#endif
+  
+  const int m = 40;
+  const int n = 12;
+  const int count = 3000;
+  
+  // unsorted, with plenty of duplicates and some zeros; the second half
+  // of each pair in the last quarter cancels one in the first quarter
+  std::vector<INDEX> rows(count), cols(count);
+  std::vector<SCALAR> vals(count);
+  uint32_t state = 12345;
+  for (int k=0; k<count; k++)
+  {
+    state = state*1103515245u + 12345u;
+    rows[k] = (INDEX) ((state >> 8) % m);
+    cols[k] = (INDEX) ((state >> 20) % n);
+    vals[k] = (SCALAR) ((state >> 4) % 5);
+  }
+  
+  for (int k=0; k<count/4; k+=3)
+  {
+    const int l = count - 1 - k;
+    rows[l] = rows[k];
+    cols[l] = cols[k];
+    vals[l] = (SCALAR) 0 - vals[k];
+  }
+  
+  std::vector<SCALAR> dense(m*n, 0);
+  for (int k=0; k<count; k++)
+    dense[rows[k] + m*cols[k]] += vals[k];
+  
+  TestType x = TestType::from_triplets(m, n, count, rows.data(), cols.data(), vals.data());
+  
+#ifdef _OPENMP
+  omp_set_num_threads(nthreads);
+#endif
+  
+  REQUIRE( x.nrows() == (INDEX) m );
+  REQUIRE( x.ncols() == (INDEX) n );
+  
+  INDEX ind = 0;
+  for (int j=0; j<n; j++)
+  {
+    REQUIRE( x.col_ptr()[j] == ind );
+    for (int i=0; i<m; i++)
+    {
+      if (dense[i + m*j] == (SCALAR) 0)
+        continue;
+      
+      REQUIRE( x.index_ptr()[ind] == (INDEX) i );
+      REQUIRE( x.data_ptr()[ind] == dense[i + m*j] );
+      ind++;
+    }
+  }
+  
+  REQUIRE( x.col_ptr()[n] == ind );
+  REQUIRE( x.get_nnz() == ind );
+}
+
+
+
+TEST_CASE("wide offsets", "[spmat]")
+{
+  using INDEX = uint16_t;
+  using OFFSET = int64_t;
+  
+  const INDEX m = 50000;
+  const INDEX n = 3;
+  spar::spmat<INDEX, float, OFFSET> x(m, n, 1);
+  
+  spar::spvec<INDEX, float> s(m);
+  for (INDEX i=0; i<m; i++)
+    s.insert(i, 1.f);
+  
+  for (INDEX j=0; j<n; j++)
+    x.insert(j, s);
+  
+  REQUIRE( x.get_nnz() == (OFFSET) n*m );
+  REQUIRE( x.col_ptr()[n] == (OFFSET) n*m );
+  
+  spar::spvec_view<INDEX, float> v;
+  x.get_col(2, v);
+  REQUIRE( v.get_nnz() == m );
+  REQUIRE( v.index_ptr() == x.index_ptr() + 2*(OFFSET)m );
+  
+  spar::spmat_view<INDEX, float, OFFSET> xv(x);
+  REQUIRE( xv.get_nnz() == x.get_nnz() );
+  REQUIRE( spar::internal::get::max_col_nnz(xv) == m );
+}
@@ -0,0 +1,54 @@
+#include <catch.hpp>
+#include <spar.hpp>
+
+
+TEMPLATE_PRODUCT_TEST_CASE("view", "[spmat_view]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  TestType x(m, n, 20);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  spar::spvec<INDEX, SCALAR> s(8);
+  s.insert(1, 1);
+  s.insert(4, 2);
+  x.insert(0, s);
+  
+  s.zero();
+  s.insert(3, 1);
+  s.insert(5, 2);
+  s.insert(6, 3);
+  x.insert(6, s);
+  
+  spar::spmat_view<INDEX, SCALAR> v(x);
+  REQUIRE( v.nrows() == m );
+  REQUIRE( v.ncols() == n );
+  REQUIRE( v.get_nnz() == 5 );
+  REQUIRE( v.index_ptr() == x.index_ptr() );
+  REQUIRE( v.col_ptr() == x.col_ptr() );
+  REQUIRE( v.data_ptr() == x.data_ptr() );
+  
+  spar::spvec_view<INDEX, SCALAR> c;
+  v.get_col(0, c);
+  REQUIRE( c.get_nnz() == 2 );
+  REQUIRE( c.get(4) == (SCALAR) 2 );
+  
+  v.get_col(3, c);
+  REQUIRE( c.get_nnz() == 0 );
+  
+  v.get_col(6, c);
+  REQUIRE( c.get_nnz() == 3 );
+  REQUIRE( c.get(6) == (SCALAR) 3 );
+  
+  INDEX vm, vn;
+  spar::internal::get::dim(v, &vm, &vn);
+  REQUIRE( vm == m );
+  REQUIRE( spar::internal::get::max_col_nnz(v) == 3 );
+}
@@ -48,6 +48,38 @@ TEMPLATE_PRODUCT_TEST_CASE("insert", "[spvec]", spar::spvec, (
 
 
 
+TEMPLATE_PRODUCT_TEST_CASE("insert with growth", "[spvec]", spar::spvec, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  TestType x;
+  
+  using INDEX = decltype(x.get_nnz());
+  
+  // reverse order, so every insert goes to the front
+  const int n = 100;
+  for (int i=n-1; i>=0; i--)
+    x.insert(2*i, i + 1);
+  
+  REQUIRE( x.get_nnz() == (INDEX) n );
+  REQUIRE( x.get_len() == (INDEX) 128 );
+  
+  bool sorted = true;
+  for (int k=0; k<n; k++)
+    sorted = sorted && x.index_ptr()[k] == (INDEX) (2*k);
+  
+  REQUIRE( sorted );
+  REQUIRE( x.get(0) == 1 );
+  REQUIRE( x.get(1) == 0 );
+  REQUIRE( x.get(198) == 100 );
+  REQUIRE( x.get(199) == 0 );
+}
+
+
+
 TEMPLATE_PRODUCT_TEST_CASE("get", "[spvec]", spar::spvec, (
   (int, int),      (int, uint32_t),      (int, double),
   (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
@@ -0,0 +1,74 @@
+#include <catch.hpp>
+#include <spar.hpp>
+
+
+TEMPLATE_PRODUCT_TEST_CASE("construct", "[spvec_view]", spar::spvec_view, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  TestType x;
+  
+  using INDEX = std::remove_const_t<std::remove_pointer_t<decltype(x.index_ptr())>>;
+  using SCALAR = std::remove_const_t<std::remove_pointer_t<decltype(x.data_ptr())>>;
+  
+  REQUIRE( x.get_nnz() == 0 );
+  
+  const INDEX I[3] = {1, 4, 7};
+  const SCALAR X[3] = {3, 2, 1};
+  TestType y(3, I, X);
+  
+  REQUIRE( y.get_nnz() == 3 );
+  REQUIRE( y.index_ptr() == I );
+  REQUIRE( y.data_ptr() == X );
+  REQUIRE( y.get(0) == (SCALAR) 0 );
+  REQUIRE( y.get(4) == (SCALAR) 2 );
+  REQUIRE( y.get(7) == (SCALAR) 1 );
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("get_col view", "[spvec_view]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  TestType x(m, n, 20);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  spar::spvec<INDEX, SCALAR> s(8);
+  s.insert(3, 1);
+  s.insert(5, 2);
+  s.insert(6, 3);
+  x.insert(2, s);
+  
+  spar::spvec_view<INDEX, SCALAR> v;
+  x.get_col(1, v);
+  REQUIRE( v.get_nnz() == 0 );
+  
+  x.get_col(2, v);
+  REQUIRE( v.get_nnz() == 3 );
+  REQUIRE( v.index_ptr() == x.index_ptr() );
+  REQUIRE( v.get(5) == (SCALAR) 2 );
+  
+  spar::dvec<INDEX, SCALAR> d(m);
+  v.densify(d);
+  REQUIRE( d.get_nnz() == 3 );
+  REQUIRE( d[6] == (SCALAR) 3 );
+  
+  spar::spmat<INDEX, SCALAR> y(m, n, 1);
+  y.insert(4, v);
+  REQUIRE( y.get_nnz() == 3 );
+  REQUIRE( y.get_len() >= 3 );
+  
+  y.get_col(4, s);
+  REQUIRE( s.get(3) == (SCALAR) 1 );
+}
@@ -0,0 +1,127 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <accumulator.hpp>
+
+extern int rank;
+extern int size;
+
+
+TEMPLATE_TEST_CASE("accumulator", "[accumulator]", int, uint16_t)
+{
+  using INDEX = TestType;
+  using SCALAR = double;
+  
+  const INDEX m = 7;
+  const INDEX n = 5;
+  
+  // a tiny table, so the stream spills many times
+  spar::accumulator<INDEX, SCALAR> a(m, n, 4);
+  REQUIRE( a.get_capacity() == 4 );
+  
+  // entry (i, j) receives 1 for every k with k % 35 == j*m + i
+  const int len = 1000;
+  for (int k=0; k<len; k++)
+  {
+    const int key = k % 35;
+    a.add(key % m, key / m, 1);
+  }
+  
+  REQUIRE( a.get_pending() <= 4 );
+  
+  const auto &l = a.local();
+  REQUIRE( a.get_pending() == 0 );
+  REQUIRE( l.get_nnz() == (INDEX) (m*n) );
+  for (INDEX j=0; j<n; j++)
+  {
+    for (INDEX i=0; i<m; i++)
+    {
+      const int key = j*m + i;
+      const SCALAR expected = len/35 + (key < len%35);
+      REQUIRE( l.data_ptr()[l.col_ptr()[j] + i] == expected );
+    }
+  }
+  
+  // rank r adds (r, 0) and, on top of that, the same 2 everywhere at (1, 3)
+  a.clear();
+  a.add(rank % m, 0, 1);
+  a.add(1, 3, 2);
+  a.add(1, 3, -1);
+  
+  auto y = a.flush(spar::mpi::REDUCE_TO_ALL);
+  REQUIRE( a.local().get_nnz() == 0 );
+  
+  spar::spvec<INDEX, SCALAR> s(m);
+  y.get_col(3, s);
+  REQUIRE( s.get_nnz() == 1 );
+  REQUIRE( s.get(1) == (SCALAR) size );
+  
+  y.get_col(0, s);
+  SCALAR total = 0;
+  for (INDEX i=0; i<m; i++)
+    total += s.get(i);
+  
+  REQUIRE( total == (SCALAR) size );
+  
+  REQUIRE_THROWS_AS( a.add(m, 0, 1), std::runtime_error );
+}
+
+
+
+TEST_CASE("accumulator tiered spills", "[accumulator]")
+{
+  const int m = 100;
+  const int n = 50;
+  const int cap = 16;
+  spar::accumulator<int, double> a(m, n, cap);
+  
+  // distinct entries only, so every spill is a full block of cap entries;
+  // the blocks stay logarithmic in number, rather than one per spill or a
+  // single one merged on every spill
+  const int nspills = 64;
+  int spills = 0;
+  for (int k=0; k<cap*nspills; k++)
+  {
+    const int key = (k * 37) % (m*n);
+    a.add(key % m, key / m, (double) (key + 1));
+    if (a.get_pending() == 1 && k > 0)
+    {
+      spills++;
+      int log2_spills = 0;
+      while ((2 << log2_spills) <= spills)
+        log2_spills++;
+      
+      REQUIRE( a.get_blocks() >= 1 );
+      REQUIRE( a.get_blocks() <= (uint64_t) log2_spills + 1 );
+    }
+  }
+  
+  REQUIRE( spills == nspills - 1 );
+  
+  a.spill();
+  REQUIRE( a.get_blocks() <= 7 );
+  
+  // half of the entries again, cancelled
+  for (int k=0; k<cap*nspills/2; k++)
+  {
+    const int key = (k * 37) % (m*n);
+    a.add(key % m, key / m, (double) -(key + 1));
+  }
+  
+  a.spill();
+  REQUIRE( a.get_blocks() <= 7 );
+  
+  const auto &l = a.local();
+  REQUIRE( a.get_blocks() == 1 );
+  REQUIRE( l.get_nnz() == cap*nspills/2 );
+  
+  spar::spvec<int, double> s(1);
+  for (int k=cap*nspills/2; k<cap*nspills; k++)
+  {
+    const int key = (k * 37) % (m*n);
+    l.get_col(key / m, s);
+    REQUIRE( s.get(key % m) == (double) (key + 1) );
+  }
+  
+  a.clear();
+  REQUIRE( a.get_blocks() == 0 );
+}
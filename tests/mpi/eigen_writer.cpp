@@ -0,0 +1,72 @@
+#include <catch.hpp>
+
+// built only where the Eigen headers are found (EIGEN_CPPFLAGS in the Makefile)
+#if __has_include(<Eigen/SparseCore>)
+
+#include <converters/eigen.hpp>
+#include <spar.hpp>
+#include <reduce.hpp>
+
+extern int rank;
+extern int size;
+
+#include "gen.hpp"
+
+
+template <typename SCALAR>
+static bool same(const spar::conv::eigen_t<int, SCALAR> &s, const spar::spmat<int, SCALAR> &y)
+{
+  if (s.rows() != y.nrows() || s.cols() != y.ncols() || s.nonZeros() != y.get_nnz())
+    return false;
+  
+  spar::spvec<int, SCALAR> c(1);
+  for (int j=0; j<y.ncols(); j++)
+  {
+    y.get_col(j, c);
+    for (int i=0; i<y.nrows(); i++)
+    {
+      if (s.coeff(i, j) != c.get(i))
+        return false;
+    }
+  }
+  
+  return true;
+}
+
+
+
+TEMPLATE_TEST_CASE("reduce into eigen_writer", "[spmat]", int, float, double)
+{
+  const int m = 10;
+  const int n = 8;
+  const int len = 10;
+  spar::spmat<int, TestType> x(m, n, len);
+  fill_sparse_mat(x);
+  
+  for (int root : {spar::mpi::REDUCE_TO_ALL, 0})
+  {
+    const bool receiving = (root == spar::mpi::REDUCE_TO_ALL || root == rank);
+    
+    auto y = spar::reduce::gather<spar::spmat<int, TestType>, int, TestType>(root, x);
+    
+    spar::conv::eigen_t<int, TestType> s;
+    spar::writers::eigen_writer<int, TestType> w(s);
+    spar::reduce::gather<spar::spmat<int, TestType>, int, TestType>(root, x, w);
+    if (receiving)
+    {
+      REQUIRE( s.isCompressed() );
+      REQUIRE( same(s, y) );
+      REQUIRE( s.coeff(0, 0) == (TestType) size );
+      REQUIRE( s.coeff(3, 2) == (TestType) size );
+      REQUIRE( s.coeff(7, 0) == 0 );
+    }
+    
+    // the same matrix from the dense reducer, into a previously used matrix
+    y = spar::reduce::dense<spar::spmat<int, TestType>, int, TestType>(root, x);
+    spar::reduce::dense<spar::spmat<int, TestType>, int, TestType>(root, x, w);
+    if (receiving)
+      REQUIRE( same(s, y) );
+  }
+}
+
+#endif
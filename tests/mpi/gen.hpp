@@ -3,8 +3,8 @@
 #pragma once
 
 
-template <typename INDEX, typename SCALAR>
-static inline void fill_sparse_mat(spar::spmat<INDEX, SCALAR> &x)
+template <typename INDEX, typename SCALAR, typename OFFSET>
+static inline void fill_sparse_mat(spar::spmat<INDEX, SCALAR, OFFSET> &x)
 {
   spar::spvec<INDEX, SCALAR> s(3);
   
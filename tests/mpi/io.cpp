@@ -0,0 +1,126 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <io/mpi.hpp>
+
+extern int rank;
+extern int size;
+
+#include <cstdio>
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("write_cols/read_cols", "[io]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 3*size + 1;
+  
+  // same block partition as read_cols()
+  const int start = n * rank / size;
+  const int ncols = n * (rank + 1) / size - start;
+  
+  TestType x(m, ncols, 2*ncols);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  spar::spvec<INDEX, SCALAR> s(m);
+  for (int j=0; j<ncols; j++)
+  {
+    const int col = start + j;
+    if (col % 3 == 2)
+      continue;
+    
+    s.zero();
+    s.insert(col % m, (SCALAR) (col + 1));
+    if (col % 2)
+      s.insert((col + 5) % m, (SCALAR) 1);
+    
+    x.insert(j, s);
+  }
+  
+  const char *filename = "spar_test_mpiio.bin";
+  spar::io::write_cols(filename, x);
+  
+  auto y = spar::io::read_cols<INDEX, SCALAR>(filename);
+  REQUIRE( y.nrows() == (INDEX) m );
+  REQUIRE( y.ncols() == (INDEX) ncols );
+  REQUIRE( y.get_nnz() == x.get_nnz() );
+  for (int j=0; j<=ncols; j++)
+    REQUIRE( y.col_ptr()[j] == x.col_ptr()[j] );
+  for (INDEX i=0; i<x.get_nnz(); i++)
+  {
+    REQUIRE( y.index_ptr()[i] == x.index_ptr()[i] );
+    REQUIRE( y.data_ptr()[i] == x.data_ptr()[i] );
+  }
+  
+  INDEX nnz = x.get_nnz();
+  spar::mpi::reduce(spar::mpi::REDUCE_TO_ALL, MPI_IN_PLACE, &nnz, 1, MPI_SUM);
+  
+  if (rank == 0)
+  {
+    auto z = spar::io::load<INDEX, SCALAR>(filename);
+    REQUIRE( z.nrows() == (INDEX) m );
+    REQUIRE( z.ncols() == (INDEX) n );
+    REQUIRE( z.get_nnz() == nnz );
+    
+    auto v = z.view();
+    spar::spvec_view<INDEX, SCALAR> c;
+    v.get_col(0, c);
+    REQUIRE( c.get(0) == (SCALAR) 1 );
+    v.get_col(n - 1, c);
+    REQUIRE( c.get((n - 1) % m) == (SCALAR) n );
+  }
+  
+  auto w = spar::io::read_cols<INDEX, SCALAR>(filename, 1, 2);
+  REQUIRE( w.ncols() == 2 );
+  
+  REQUIRE_THROWS_AS( (spar::io::read_cols<INDEX, float>(filename)), std::runtime_error );
+  
+  spar::mpi::barrier();
+  if (rank == 0)
+    std::remove(filename);
+}
+
+
+
+TEST_CASE("write_cols/read_cols explicit zeros", "[io]")
+{
+  // column 0 stores an explicit zero ahead of a non-zero, as a gathered sum
+  // that cancelled would
+  spar::spmat<int, double> x(10, 2, 3);
+  int *I = x.index_ptr();
+  int *P = x.col_ptr();
+  double *X = x.data_ptr();
+  P[0] = 0; P[1] = 2; P[2] = 3;
+  I[0] = 1; I[1] = 4; I[2] = 0;
+  X[0] = 0; X[1] = 2; X[2] = rank + 1;
+  x.update_nnz(3);
+  
+  const char *filename = "spar_test_mpiio_zeros.bin";
+  spar::io::write_cols(filename, x);
+  
+  auto y = spar::io::read_cols<int, double>(filename);
+  REQUIRE( y.ncols() == 2 );
+  REQUIRE( y.get_nnz() == 3 );
+  for (int j=0; j<=2; j++)
+    REQUIRE( y.col_ptr()[j] == P[j] );
+  for (int i=0; i<3; i++)
+  {
+    REQUIRE( y.index_ptr()[i] == I[i] );
+    REQUIRE( y.data_ptr()[i] == X[i] );
+  }
+  
+  // the last rank asks for columns past the end; every rank throws, and
+  // none is left waiting in a collective read
+  const int col_start = (rank == size - 1) ? 2*size : 0;
+  REQUIRE_THROWS_AS( (spar::io::read_cols<int, double>(filename, col_start, 1)), std::runtime_error );
+  
+  spar::mpi::barrier();
+  if (rank == 0)
+    std::remove(filename);
+}
@@ -0,0 +1,110 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <mpi/mpi.hpp>
+
+extern int rank;
+extern int size;
+
+#include <vector>
+
+
+// the chunked fallbacks are exercised with a tiny chunk size, since the real
+// one (INT_MAX) would need 2^31 elements per message
+
+TEST_CASE("chunked reduce", "[mpi]")
+{
+  const MPI_Count count = 10;
+  const MPI_Count chunk = 3;
+  
+  std::vector<int> x(count);
+  std::vector<int> y(count, -1);
+  for (int i=0; i<count; i++)
+    x[i] = i + rank;
+  
+  const int base = size*(size-1)/2;
+  
+  spar::mpi::utils::reduce_chunked(spar::mpi::REDUCE_TO_ALL, x.data(), y.data(), count, MPI_SUM, MPI_COMM_WORLD, chunk);
+  for (int i=0; i<count; i++)
+    REQUIRE( y[i] == size*i + base );
+  
+  spar::mpi::utils::reduce_chunked(spar::mpi::REDUCE_TO_ALL, MPI_IN_PLACE, x.data(), count, MPI_MAX, MPI_COMM_WORLD, chunk);
+  for (int i=0; i<count; i++)
+    REQUIRE( x[i] == i + size - 1 );
+  
+  for (int i=0; i<count; i++)
+    x[i] = 1;
+  
+  if (rank == 0)
+    spar::mpi::utils::reduce_chunked(0, MPI_IN_PLACE, x.data(), count, MPI_SUM, MPI_COMM_WORLD, chunk);
+  else
+    spar::mpi::utils::reduce_chunked(0, x.data(), (int*) NULL, count, MPI_SUM, MPI_COMM_WORLD, chunk);
+  
+  if (rank == 0)
+  {
+    for (int i=0; i<count; i++)
+      REQUIRE( x[i] == size );
+  }
+}
+
+
+
+TEST_CASE("chunked gatherv", "[mpi]")
+{
+  const MPI_Count chunk = 2;
+  
+  std::vector<MPI_Count> counts(size);
+  std::vector<MPI_Aint> displs(size);
+  MPI_Aint total = 0;
+  for (int i=0; i<size; i++)
+  {
+    counts[i] = i + 3;
+    displs[i] = total;
+    total += counts[i];
+  }
+  
+  std::vector<double> x(counts[rank]);
+  for (MPI_Count k=0; k<counts[rank]; k++)
+    x[k] = 100*rank + k;
+  
+  for (int root=spar::mpi::REDUCE_TO_ALL; root<size; root++)
+  {
+    std::vector<double> y(total, -1);
+    spar::mpi::utils::gatherv_chunked(root, x.data(), counts[rank], y.data(), counts.data(), displs.data(), MPI_COMM_WORLD, chunk);
+    
+    if (root == spar::mpi::REDUCE_TO_ALL || root == rank)
+    {
+      for (int i=0; i<size; i++)
+      {
+        for (MPI_Count k=0; k<counts[i]; k++)
+          REQUIRE( y[displs[i] + k] == 100*i + k );
+      }
+    }
+  }
+  
+  // the regular path should agree
+  std::vector<double> y(total, -1);
+  spar::mpi::gatherv(spar::mpi::REDUCE_TO_ALL, x.data(), counts[rank], y.data(), counts.data(), displs.data());
+  for (int i=0; i<size; i++)
+  {
+    for (MPI_Count k=0; k<counts[i]; k++)
+      REQUIRE( y[displs[i] + k] == 100*i + k );
+  }
+}
+
+
+
+TEST_CASE("chunked bcast", "[mpi]")
+{
+  const MPI_Count count = 7;
+  
+  std::vector<uint16_t> x(count, 0);
+  if (rank == size - 1)
+  {
+    for (int i=0; i<count; i++)
+      x[i] = i + 1;
+  }
+  
+  spar::mpi::utils::bcast_chunked(size - 1, x.data(), count, MPI_COMM_WORLD, 4);
+  for (int i=0; i<count; i++)
+    REQUIRE( x[i] == i + 1 );
+}
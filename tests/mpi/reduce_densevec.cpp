@@ -54,3 +54,111 @@ TEMPLATE_PRODUCT_TEST_CASE("reduce_densevec", "[spmat]", spar::spmat, (
     REQUIRE( s.get(5) == (SCALAR) 1*(size-1) );
   }
 }
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_dense_compact", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 300;
+  const int n = 8;
+  const int len = 10;
+  TestType x(m, n, len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  
+  spar::spvec<INDEX, SCALAR> s(1);
+  s.insert(250, 3);
+  if (rank == size - 1)
+    x.insert(7, s);
+  
+  for (int root=spar::mpi::REDUCE_TO_ALL; root<size; root++)
+  {
+    auto y = spar::reduce::dense<TestType, INDEX, SCALAR>(root, x);
+    auto z = spar::reduce::dense_compact<TestType, INDEX, SCALAR>(root, x);
+    REQUIRE( z.nrows() == m );
+    REQUIRE( z.ncols() == n );
+    
+    if (root == spar::mpi::REDUCE_TO_ALL || root == rank)
+    {
+      REQUIRE( z.get_nnz() == y.get_nnz() );
+      
+      spar::spvec<INDEX, SCALAR> sy(m);
+      spar::spvec<INDEX, SCALAR> sz(m);
+      for (int j=0; j<n; j++)
+      {
+        y.get_col(j, sy);
+        z.get_col(j, sz);
+        REQUIRE( sy.get_nnz() == sz.get_nnz() );
+        for (INDEX t=0; t<sy.get_nnz(); t++)
+        {
+          REQUIRE( sy.index_ptr()[t] == sz.index_ptr()[t] );
+          REQUIRE( sy.data_ptr()[t] == sz.data_ptr()[t] );
+        }
+      }
+      
+      z.get_col(7, sz);
+      REQUIRE( sz.get(250) == (SCALAR) 3 );
+    }
+  }
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_dense_batched", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  const int len = 10;
+  TestType x(m, n, len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  
+  const uint64_t col_bytes = m * (sizeof(INDEX) + sizeof(SCALAR));
+  auto y = spar::reduce::dense<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x);
+  
+  // one column per batch, a partial last batch, and everything in one batch
+  for (uint64_t budget : {(uint64_t) 0, 3*col_bytes, 100*col_bytes})
+  {
+    for (int root=spar::mpi::REDUCE_TO_ALL; root<size; root++)
+    {
+      auto z = spar::reduce::dense_batched<TestType, INDEX, SCALAR>(root, x, budget);
+      REQUIRE( z.nrows() == m );
+      REQUIRE( z.ncols() == n );
+      
+      if (root == spar::mpi::REDUCE_TO_ALL || root == rank)
+      {
+        REQUIRE( z.get_nnz() == y.get_nnz() );
+        
+        spar::spvec<INDEX, SCALAR> sy(m);
+        spar::spvec<INDEX, SCALAR> sz(m);
+        for (int j=0; j<n; j++)
+        {
+          y.get_col(j, sy);
+          z.get_col(j, sz);
+          REQUIRE( sy.get_nnz() == sz.get_nnz() );
+          for (INDEX t=0; t<sy.get_nnz(); t++)
+          {
+            REQUIRE( sy.index_ptr()[t] == sz.index_ptr()[t] );
+            REQUIRE( sy.data_ptr()[t] == sz.data_ptr()[t] );
+          }
+        }
+      }
+    }
+  }
+}
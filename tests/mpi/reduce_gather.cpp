@@ -2,6 +2,12 @@
 #include <spar.hpp>
 #include <reduce.hpp>
 
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 extern int rank;
 extern int size;
 
@@ -53,3 +59,233 @@ TEMPLATE_PRODUCT_TEST_CASE("reduce_gather", "[spmat]", spar::spmat, (
     REQUIRE( s.get(5) == (SCALAR) 1*(size-1) );
   }
 }
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_gather view", "[spmat_view]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  const int len = 10;
+  TestType x(m, n, len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  spar::spmat_view<INDEX, SCALAR> v(x);
+  
+  auto y = spar::reduce::gather<spar::spmat_view<INDEX, SCALAR>, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, v);
+  REQUIRE( y.nrows() == m );
+  REQUIRE( y.ncols() == n );
+  
+  spar::spvec<INDEX, SCALAR> s(3);
+  y.get_col(2, s);
+  REQUIRE( s.get(1) == (SCALAR)2*size );
+  REQUIRE( s.get(3) == (SCALAR)1*size );
+  
+  y.get_col(5, s);
+  REQUIRE( s.get(5) == (SCALAR) 1*(size-1) );
+}
+
+
+
+TEST_CASE("reduce_gather wide offsets", "[spmat]")
+{
+  using INDEX = uint16_t;
+  using SCALAR = double;
+  using OFFSET = int64_t;
+  
+  spar::spmat<INDEX, SCALAR, OFFSET> x(10, 8, 10);
+  fill_sparse_mat(x);
+  
+  auto y = spar::reduce::gather<spar::spmat<INDEX, SCALAR, OFFSET>, INDEX, SCALAR, OFFSET>(spar::mpi::REDUCE_TO_ALL, x);
+  auto z = spar::reduce::dense<spar::spmat<INDEX, SCALAR, OFFSET>, INDEX, SCALAR, OFFSET>(spar::mpi::REDUCE_TO_ALL, x);
+  auto P = spar::reduce::symbolic<spar::spmat<INDEX, SCALAR, OFFSET>, INDEX, SCALAR, OFFSET>(spar::mpi::REDUCE_TO_ALL, x);
+  REQUIRE( P[8] == y.get_nnz() );
+  
+  spar::spvec<INDEX, SCALAR> s(3);
+  y.get_col(2, s);
+  REQUIRE( s.get(1) == (SCALAR)2*size );
+  z.get_col(5, s);
+  REQUIRE( s.get(5) == (SCALAR) 1*(size-1) );
+}
+
+
+
+template <typename INDEX, typename SCALAR>
+static inline void require_same_cols(const spar::spmat<INDEX, SCALAR> &a, const spar::spmat<INDEX, SCALAR> &b)
+{
+  REQUIRE( a.nrows() == b.nrows() );
+  REQUIRE( a.ncols() == b.ncols() );
+  
+  spar::spvec<INDEX, SCALAR> sa(a.nrows());
+  spar::spvec<INDEX, SCALAR> sb(b.nrows());
+  for (INDEX j=0; j<a.ncols(); j++)
+  {
+    a.get_col(j, sa);
+    b.get_col(j, sb);
+    for (INDEX i=0; i<a.nrows(); i++)
+      REQUIRE( sa.get(i) == sb.get(i) );
+  }
+}
+
+TEST_CASE("reduce on one rank", "[spmat]")
+{
+  using INDEX = int;
+  using SCALAR = double;
+  using SPMAT = spar::spmat<INDEX, SCALAR>;
+  
+  SPMAT x(10, 8, 10);
+  fill_sparse_mat(x);
+  
+  auto y = spar::reduce::gather<SPMAT, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x, MPI_COMM_SELF);
+  require_same_cols(x, y);
+  
+  auto z = spar::reduce::dense<SPMAT, INDEX, SCALAR>(0, x, MPI_COMM_SELF);
+  require_same_cols(x, z);
+  
+  auto P = spar::reduce::symbolic<SPMAT, INDEX, SCALAR>(0, x, MPI_COMM_SELF);
+  REQUIRE( P.size() == 9 );
+  REQUIRE( P[8] == y.get_nnz() );
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_gather whole-matrix exchange", "[spmat]", spar::spmat, (
+  (int, int), (uint16_t, double)
+))
+{
+  TestType x(10, 8, 10);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  
+  for (int root=spar::mpi::REDUCE_TO_ALL; root<size; root++)
+  {
+    TestType a(10, 8, 0);
+    TestType b(10, 8, 0);
+    spar::writers::spmat_writer<INDEX, SCALAR> wa(a);
+    spar::writers::spmat_writer<INDEX, SCALAR> wb(b);
+    spar::internal::gather_cols<TestType, INDEX, SCALAR>(root, x, wa, MPI_COMM_WORLD);
+    spar::internal::gather_whole<TestType, INDEX, SCALAR>(root, x, wb, MPI_COMM_WORLD);
+    
+    auto Pa = spar::internal::symbolic_cols<TestType, INDEX, SCALAR, INDEX>(root, x, MPI_COMM_WORLD);
+    auto Pb = spar::internal::symbolic_whole<TestType, INDEX, SCALAR, INDEX>(root, x, MPI_COMM_WORLD);
+    
+    if (root == spar::mpi::REDUCE_TO_ALL || root == rank)
+    {
+      require_same_cols(a, b);
+      REQUIRE( Pa == Pb );
+    }
+    else
+      REQUIRE( Pb.empty() );
+  }
+}
+
+
+
+TEST_CASE("column occupancy", "[spmat]")
+{
+  using INDEX = int16_t;
+  using SCALAR = float;
+  
+  const INDEX n = 130;
+  spar::spmat<INDEX, SCALAR> x(10, n, 10);
+  fill_sparse_mat(x);
+  
+  spar::spvec<INDEX, SCALAR> s(1);
+  s.insert(4, 1);
+  if (rank == size - 1)
+    x.insert(129, s);
+  
+  auto bits = spar::internal::occupied_cols<spar::spmat<INDEX, SCALAR>, INDEX, SCALAR>(x, MPI_COMM_WORLD);
+  REQUIRE( bits.size() == 3 );
+  
+  for (INDEX j=0; j<n; j++)
+  {
+    const bool expected = (j == 0 || j == 2 || j == 6 || j == 129 || (j == 5 && size > 1));
+    REQUIRE( spar::internal::is_occupied(bits, j) == expected );
+  }
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_hybrid", "[spmat]", spar::spmat, (
+  (int, int), (uint16_t, double)
+))
+{
+  TestType x(10, 8, 10);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  
+  // two "threads" with the same contribution
+  std::vector<TestType> parts(2, x);
+  const TestType twice = x + x;
+  
+  // several threads, each driving a block over its own communicator
+  const bool multiple = (spar::mpi::query_thread() >= MPI_THREAD_MULTIPLE);
+  if (!multiple)
+    WARN( "MPI_THREAD_MULTIPLE is not available; the threaded blocks are not tested" );
+  
+#ifdef _OPENMP
+  const int nthreads = omp_get_max_threads();
+  omp_set_num_threads(3);
+#endif
+  
+  for (int root=spar::mpi::REDUCE_TO_ALL; root<size; root++)
+  {
+    auto expected = spar::reduce::gather<TestType, INDEX, SCALAR>(root, twice);
+    auto y = spar::reduce::hybrid(root, parts);
+    
+    // the column blocks, one after the other on this thread
+    TestType z(10, 8, 0);
+    spar::writers::spmat_writer<INDEX, SCALAR> wz(z);
+    spar::internal::gather_ranges(root, twice, wz, 3, false, MPI_COMM_WORLD);
+    
+    // the column blocks, concurrently on three threads
+    TestType zt(10, 8, 0);
+    spar::writers::spmat_writer<INDEX, SCALAR> wzt(zt);
+    if (multiple)
+      spar::internal::gather_ranges(root, twice, wzt, 3, true, MPI_COMM_WORLD);
+    
+    if (root == spar::mpi::REDUCE_TO_ALL || root == rank)
+    {
+      require_same_cols(expected, y);
+      require_same_cols(expected, z);
+      if (multiple)
+        require_same_cols(expected, zt);
+      
+      spar::spvec<INDEX, SCALAR> s(3);
+      y.get_col(2, s);
+      REQUIRE( s.get(1) == (SCALAR) 4*size );
+    }
+  }
+  
+#ifdef _OPENMP
+  omp_set_num_threads(nthreads);
+#endif
+  
+  std::vector<TestType> none;
+  REQUIRE_THROWS_AS( spar::reduce::hybrid(0, none), std::runtime_error );
+  
+  // bad input on the last rank only; every rank throws instead of waiting
+  std::vector<TestType> some = parts;
+  if (rank == size - 1)
+    some.clear();
+  REQUIRE_THROWS_AS( spar::reduce::hybrid(0, some), std::runtime_error );
+  
+  if (rank == size - 1)
+    some = {x, TestType(10, 7, 1)};
+  REQUIRE_THROWS_AS( spar::reduce::hybrid(spar::mpi::REDUCE_TO_ALL, some), std::runtime_error );
+}
@@ -0,0 +1,78 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <reduce.hpp>
+
+#include <vector>
+
+extern int rank;
+extern int size;
+
+#include "gen.hpp"
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_masked", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  const int len = 10;
+  TestType x(m, n, len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  
+  // rows 0 and 5 of column 0 are in x, row 7 is not; row 3 of column 2 is,
+  // row 1 is left out; row 5 of column 5 is only on ranks other than 0
+  spar::spmat<INDEX, uint8_t> mask(m, n, 5);
+  spar::spvec<INDEX, uint8_t> s(3);
+  s.insert(0, 1);
+  s.insert(5, 1);
+  s.insert(7, 1);
+  mask.insert(0, s);
+  s.zero();
+  s.insert(3, 1);
+  mask.insert(2, s);
+  s.zero();
+  s.insert(5, 1);
+  mask.insert(5, s);
+  
+  const std::vector<SCALAR> expected = {(SCALAR) size, (SCALAR) size, 0, (SCALAR) size, (SCALAR) (size-1)};
+  
+  for (int root : {spar::mpi::REDUCE_TO_ALL, 0, size - 1})
+  {
+    auto y = spar::reduce::masked<TestType, INDEX, SCALAR>(root, x, mask);
+    if (root != spar::mpi::REDUCE_TO_ALL && root != rank)
+      continue;
+    
+    REQUIRE( y.nrows() == m );
+    REQUIRE( y.ncols() == n );
+    REQUIRE( std::vector<INDEX>(y.col_ptr(), y.col_ptr() + n+1) == std::vector<INDEX>(mask.col_ptr(), mask.col_ptr() + n+1) );
+    REQUIRE( std::vector<INDEX>(y.index_ptr(), y.index_ptr() + 5) == std::vector<INDEX>(mask.index_ptr(), mask.index_ptr() + 5) );
+    REQUIRE( std::vector<SCALAR>(y.data_ptr(), y.data_ptr() + 5) == expected );
+  }
+  
+  // with an operator, into caller-owned buffers; the largest value of row 5
+  // of column 5 is 1 when some rank has it
+  std::vector<INDEX> P(n+1), I(5);
+  std::vector<SCALAR> X(5);
+  spar::writers::csc_writer<INDEX, SCALAR> w(P.data(), I.data(), X.data(), 5);
+  spar::reduce::masked<TestType, INDEX, SCALAR, spar::op::max>(spar::mpi::REDUCE_TO_ALL, x, mask, w);
+  
+  REQUIRE( w.get_nnz() == 5 );
+  REQUIRE( X[0] == 1 );
+  REQUIRE( X[2] == 0 );
+  REQUIRE( X[4] == (SCALAR) (size > 1) );
+  
+  spar::spmat<INDEX, uint8_t> wrong(m, n-1, 1);
+  REQUIRE_THROWS_AS(
+    (spar::reduce::masked<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x, wrong)),
+    std::runtime_error
+  );
+}
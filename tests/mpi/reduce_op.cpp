@@ -0,0 +1,134 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <reduce.hpp>
+
+#include <vector>
+
+extern int rank;
+extern int size;
+
+
+// (1+a)(1+b) - 1: associative, commutative, and 0 is neutral
+struct compound
+{
+  template <typename T>
+  T operator()(const T a, const T b) const {return a + b + a*b;}
+};
+
+// rank r's entry (i, j): a third are zero, some are negative
+static int entry(const int r, const int i, const int j)
+{
+  if ((i + j + r) % 3 == 0)
+    return 0;
+  
+  const int v = (i*7 + j*3 + r) % 4 + 1;
+  return ((i + r) % 2) ? -v : v;
+}
+
+template <class SPMAT>
+static void fill_mat(const int r, SPMAT &x)
+{
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  spar::spvec<INDEX, SCALAR> s(x.nrows());
+  for (int j=0; j<(int) x.ncols(); j++)
+  {
+    s.zero();
+    for (int i=0; i<(int) x.nrows(); i++)
+    {
+      if (entry(r, i, j) != 0)
+        s.insert(i, (SCALAR) entry(r, i, j));
+    }
+    
+    x.insert(j, s);
+  }
+}
+
+// the operator applied to every rank's dense matrix, zeros included
+template <class OP, class SPMAT>
+static bool matches(const SPMAT &y, const int m, const int n)
+{
+  using INDEX = decltype(y.get_nnz());
+  using SCALAR = decltype(+*y.data_ptr());
+  
+  spar::spvec<INDEX, SCALAR> s(1);
+  for (int j=0; j<n; j++)
+  {
+    y.get_col(j, s);
+    INDEX nnz = 0;
+    for (int i=0; i<m; i++)
+    {
+      SCALAR e = OP::map((SCALAR) entry(0, i, j));
+      for (int r=1; r<size; r++)
+        e = OP::apply(e, OP::map((SCALAR) entry(r, i, j)));
+      
+      if (e != (SCALAR) 0)
+        nnz++;
+      if (s.get(i) != e)
+        return false;
+    }
+    
+    // a gathered sum keeps the entries that cancelled
+    if (s.get_nnz() != nnz && !OP::keeps_zeros)
+      return false;
+  }
+  
+  return true;
+}
+
+template <class OP, class SPMAT>
+static void check_op(const SPMAT &x)
+{
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  const int m = x.nrows();
+  const int n = x.ncols();
+  const uint64_t budget = 2 * m * (sizeof(INDEX) + sizeof(SCALAR));
+  
+  for (int root : {spar::mpi::REDUCE_TO_ALL, 0})
+  {
+    const bool receiving = (root == spar::mpi::REDUCE_TO_ALL || root == rank);
+    
+    auto y = spar::reduce::dense<SPMAT, INDEX, SCALAR, INDEX, OP>(root, x);
+    if (receiving)
+      REQUIRE( matches<OP>(y, m, n) );
+    
+    y = spar::reduce::dense_compact<SPMAT, INDEX, SCALAR, INDEX, OP>(root, x);
+    if (receiving)
+      REQUIRE( matches<OP>(y, m, n) );
+    
+    y = spar::reduce::dense_batched<SPMAT, INDEX, SCALAR, INDEX, OP>(root, x, budget);
+    if (receiving)
+      REQUIRE( matches<OP>(y, m, n) );
+    
+    y = spar::reduce::gather<SPMAT, INDEX, SCALAR, INDEX, OP>(root, x);
+    if (receiving)
+      REQUIRE( matches<OP>(y, m, n) );
+  }
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce with operators", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 6;
+  TestType x(m, n, 1);
+  fill_mat(rank, x);
+  
+  check_op<spar::op::sum>(x);
+  check_op<spar::op::prod>(x);
+  check_op<spar::op::max>(x);
+  check_op<spar::op::min>(x);
+  check_op<spar::op::lor>(x);
+  check_op<spar::op::land>(x);
+  check_op<spar::op::count>(x);
+  check_op<spar::op::user<compound>>(x);
+}
@@ -0,0 +1,133 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <reduce.hpp>
+
+#include <vector>
+
+extern int rank;
+extern int size;
+
+
+// Rank r's contribution. Sparse: 1 at index 0, r+1 at index 3r+1 and 2 at
+// index 5. Dense: r+1 wherever (i+r) % 3 != 0, so any two ranks together
+// cover almost all of the vector.
+static std::vector<int> contrib(const int r, const int n, const bool dense)
+{
+  std::vector<int> d(n, 0);
+  if (dense)
+  {
+    for (int i=0; i<n; i++)
+      d[i] = ((i + r) % 3 != 0) ? r + 1 : 0;
+  }
+  else
+  {
+    d[0] += 1;
+    d[3*r + 1] += r + 1;
+    d[5] += 2;
+  }
+  
+  return d;
+}
+
+template <class SPVEC>
+static void fill_vec(const int r, const int n, const bool dense, SPVEC &x)
+{
+  x.zero();
+  std::vector<int> d = contrib(r, n, dense);
+  for (int i=0; i<n; i++)
+  {
+    if (d[i] != 0)
+      x.insert(i, d[i]);
+  }
+}
+
+template <typename SCALAR>
+static std::vector<SCALAR> expected(const int n, const bool dense)
+{
+  std::vector<SCALAR> d(n, 0);
+  for (int r=0; r<size; r++)
+  {
+    std::vector<int> c = contrib(r, n, dense);
+    for (int i=0; i<n; i++)
+      d[i] += (SCALAR) c[i];
+  }
+  
+  return d;
+}
+
+template <typename INDEX, typename SCALAR>
+static bool same(const spar::spvec<INDEX, SCALAR> &s, const std::vector<SCALAR> &d)
+{
+  INDEX nnz = 0;
+  for (INDEX i=0; i<(INDEX) d.size(); i++)
+  {
+    if (d[i] != 0)
+      nnz++;
+    if (s.get(i) != d[i])
+      return false;
+  }
+  
+  return (s.get_nnz() == nnz);
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_vector", "[spvec]", spar::spvec, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  using INDEX = decltype(TestType().get_nnz());
+  using SCALAR = decltype(+*TestType().data_ptr());
+  
+  // long and sparse: stays sparse throughout; short and dense: dense from
+  // the start or after the first merge, depending on the types
+  const int n_sparse = 3*size + 100;
+  const int n_dense = 8;
+  
+  TestType x(3);
+  TestType y;
+  for (int n : {n_sparse, n_dense})
+  {
+    const bool dense = (n == n_dense);
+    fill_vec(rank, n, dense, x);
+    
+    spar::reduce::vector(spar::mpi::REDUCE_TO_ALL, x, (INDEX) n, y);
+    REQUIRE( same(y, expected<SCALAR>(n, dense)) );
+    
+    // reduce to the first and to the last rank, which is folded in when the
+    // number of ranks is not a power of two
+    for (int root : {0, size - 1})
+    {
+      spar::reduce::vector(root, x, (INDEX) n, y);
+      if (rank == root)
+        REQUIRE( same(y, expected<SCALAR>(n, dense)) );
+      else
+        REQUIRE( y.get_nnz() == 0 );
+    }
+  }
+  
+  // entries that cancel are dropped
+  if (size > 1)
+  {
+    TestType c(1);
+    if (rank == 0)
+      c.insert(4, 1);
+    else if (rank == size - 1)
+      c.insert(4, (SCALAR) -1);
+    
+    spar::reduce::vector(spar::mpi::REDUCE_TO_ALL, c, (INDEX) n_sparse, y);
+    REQUIRE( y.get_nnz() == 0 );
+  }
+  
+  // out of range, on every rank
+  REQUIRE_THROWS_AS(spar::reduce::vector(spar::mpi::REDUCE_TO_ALL, x, (INDEX) 4, y), std::runtime_error);
+  
+  // out of range on rank 0 only; the others throw too instead of waiting
+  TestType b(1);
+  b.insert((rank == 0) ? n_sparse : 1, 1);
+  REQUIRE_THROWS_AS(spar::reduce::vector(spar::mpi::REDUCE_TO_ALL, b, (INDEX) n_sparse, y), std::runtime_error);
+  REQUIRE_THROWS_AS(spar::reduce::vector(size - 1, b, (INDEX) n_sparse, y), std::runtime_error);
+}
@@ -0,0 +1,128 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <reduce.hpp>
+
+extern int rank;
+extern int size;
+
+#include "gen.hpp"
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_writer", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  const int len = 10;
+  TestType x(m, n, len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  
+  auto P_sym = spar::reduce::symbolic<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x);
+  REQUIRE( P_sym.size() == n+1 );
+  
+  const INDEX nnz = P_sym[n];
+  auto y = spar::reduce::gather<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x);
+  REQUIRE( nnz == y.get_nnz() );
+  
+  std::vector<INDEX> P(n+1), I(nnz);
+  std::vector<SCALAR> X(nnz);
+  spar::writers::csc_writer<INDEX, SCALAR> w(P.data(), I.data(), X.data(), nnz);
+  spar::reduce::gather<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x, w);
+  
+  REQUIRE( w.get_nnz() == nnz );
+  REQUIRE( P == P_sym );
+  
+  // column 2 holds rows 1 and 3
+  REQUIRE( I[P[2]] == 1 );
+  REQUIRE( X[P[2]] == (SCALAR)2*size );
+  REQUIRE( I[P[2]+1] == 3 );
+  REQUIRE( X[P[2]+1] == (SCALAR)1*size );
+  
+  spar::writers::csc_writer<INDEX, SCALAR> w_small(P.data(), I.data(), X.data(), nnz-1);
+  REQUIRE_THROWS_AS(
+    (spar::reduce::gather<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x, w_small)),
+    std::runtime_error
+  );
+}
+
+
+
+TEMPLATE_PRODUCT_TEST_CASE("reduce_writer transform", "[spmat]", spar::spmat, (
+  (int, int),      (int, uint32_t),      (int, double),
+  (uint32_t, int), (uint32_t, uint32_t), (uint32_t, double),
+  (int16_t, int),  (int16_t, uint32_t),  (int16_t, double),
+  (uint16_t, int), (uint16_t, uint32_t), (uint16_t, double)
+))
+{
+  const int m = 10;
+  const int n = 8;
+  const int len = 10;
+  TestType x(m, n, len);
+  
+  using INDEX = decltype(x.get_nnz());
+  using SCALAR = decltype(+*x.data_ptr());
+  
+  fill_sparse_mat(x);
+  
+  // doubled, and only what exceeds 2*size is kept: in column 2, row 1 at
+  // 4*size but not row 3 at 2*size; column 5 at 2*(size-1) is dropped
+  TestType y(m, n, 0);
+  spar::writers::spmat_writer<INDEX, SCALAR> w(y);
+  auto t = spar::writers::transform<INDEX, SCALAR>(w, spar::writers::prune<SCALAR>(2, (SCALAR) 2*size));
+  spar::reduce::gather<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x, t);
+  
+  spar::spvec<INDEX, SCALAR> s(1);
+  y.get_col(2, s);
+  REQUIRE( s.get_nnz() == 1 );
+  REQUIRE( s.get(1) == (SCALAR) 4*size );
+  
+  y.get_col(5, s);
+  REQUIRE( s.get_nnz() == 0 );
+  
+  // an arbitrary functor: keep the diagonal of the dense reduce into CSC
+  std::vector<INDEX> P(n+1), I(m);
+  std::vector<SCALAR> X(m);
+  spar::writers::csc_writer<INDEX, SCALAR> c(P.data(), I.data(), X.data(), m);
+  auto diag = [](const INDEX i, const INDEX j, SCALAR &v) {(void) v; return i == j;};
+  auto td = spar::writers::transform<INDEX, SCALAR>(c, diag);
+  spar::reduce::dense<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, x, td);
+  
+  REQUIRE( c.get_nnz() == 2 - (size == 1) );
+  REQUIRE( I[0] == 0 );
+  REQUIRE( X[0] == (SCALAR) size );
+  if (size > 1)
+  {
+    REQUIRE( I[1] == 5 );
+    REQUIRE( X[1] == (SCALAR) (size-1) );
+  }
+  
+  // entries which cancelled are kept by gather() and dropped by the default
+  // prune
+  if (size > 1)
+  {
+    TestType z(m, n, 1);
+    s.zero();
+    if (rank == 0)
+      s.insert(3, 1);
+    else if (rank == 1)
+      s.insert(3, (SCALAR) -1);
+    z.insert(4, s);
+    
+    auto kept = spar::reduce::gather<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, z);
+    REQUIRE( kept.col_ptr()[n] == 1 );
+    
+    spar::writers::spmat_writer<INDEX, SCALAR> wz(y);
+    auto tz = spar::writers::transform<INDEX, SCALAR>(wz, spar::writers::prune<SCALAR>());
+    spar::reduce::gather<TestType, INDEX, SCALAR>(spar::mpi::REDUCE_TO_ALL, z, tz);
+    REQUIRE( y.col_ptr()[n] == 0 );
+  }
+}
@@ -0,0 +1,69 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <sparsifier.hpp>
+
+extern int rank;
+extern int size;
+
+
+TEMPLATE_TEST_CASE("sparsifier", "[sparsifier]", int, double)
+{
+  using INDEX = int;
+  using SCALAR = TestType;
+  using SPMAT = spar::spmat<INDEX, SCALAR>;
+  
+  // column 0 holds 5, -4, 3, -2, 1 in rows 0..4, column 1 holds 2, 2, 2
+  const INDEX rows[8] = {0, 1, 2, 3, 4, 0, 1, 2};
+  const INDEX cols[8] = {0, 0, 0, 0, 0, 1, 1, 1};
+  const SCALAR vals[8] = {5, -4, 3, -2, 1, 2, 2, 2};
+  const SPMAT x = SPMAT::from_triplets(5, 2, 8, rows, cols, vals);
+  
+  spar::sparsifier<INDEX, SCALAR> sp(5, 2, 2);
+  auto y = sp.reduce(spar::mpi::REDUCE_TO_ALL, x);
+  
+  // the two largest per column; ties are taken in row order
+  REQUIRE( sp.get_sent() == 4 );
+  spar::spvec<INDEX, SCALAR> s(5);
+  y.get_col(0, s);
+  REQUIRE( s.get_nnz() == 2 );
+  REQUIRE( s.get(0) == (SCALAR) 5*size );
+  REQUIRE( s.get(1) == (SCALAR) -4*size );
+  y.get_col(1, s);
+  REQUIRE( s.get_nnz() == 2 );
+  REQUIRE( s.get(0) == (SCALAR) 2*size );
+  REQUIRE( s.get(1) == (SCALAR) 2*size );
+  
+  const SPMAT &r = sp.get_residual();
+  REQUIRE( r.get_nnz() == 4 );
+  r.get_col(0, s);
+  REQUIRE( s.get(2) == 3 );
+  REQUIRE( s.get(4) == 1 );
+  
+  // error feedback: with no new input, the residual goes out next
+  const SPMAT zero(5, 2, 0);
+  auto z = sp.reduce(spar::mpi::REDUCE_TO_ALL, zero);
+  REQUIRE( sp.get_sent() == 3 );
+  z.get_col(0, s);
+  REQUIRE( s.get(2) == (SCALAR) 3*size );
+  REQUIRE( s.get(3) == (SCALAR) -2*size );
+  z.get_col(1, s);
+  REQUIRE( s.get(2) == (SCALAR) 2*size );
+  REQUIRE( sp.get_residual().get_nnz() == 1 );
+  
+  // a threshold instead of a count
+  sp.reset();
+  sp.set_k(0);
+  sp.set_threshold(3);
+  auto t = sp.reduce(0, x);
+  REQUIRE( sp.get_sent() == 3 );
+  REQUIRE( sp.get_residual().get_nnz() == 5 );
+  if (rank == 0)
+  {
+    REQUIRE( t.get_nnz() == 3 );
+    t.get_col(0, s);
+    REQUIRE( s.get(2) == (SCALAR) 3*size );
+  }
+  
+  const SPMAT wrong(4, 2, 0);
+  REQUIRE_THROWS_AS( sp.reduce(0, wrong), std::runtime_error );
+}
@@ -13,7 +13,9 @@ int rank;
 int main(int argc, char *argv[])
 {
   int num_failed_tests;
-  MPI_Init(NULL, NULL);
+  int provided;
+  // the hybrid reducer's threaded path needs MPI_THREAD_MULTIPLE
+  MPI_Init_thread(NULL, NULL, MPI_THREAD_MULTIPLE, &provided);
   
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
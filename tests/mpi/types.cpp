@@ -0,0 +1,86 @@
+#include <catch.hpp>
+#include <spar.hpp>
+#include <mpi/mpi.hpp>
+
+extern int rank;
+extern int size;
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+
+struct pair_t
+{
+  double x;
+  int32_t n;
+};
+
+static inline pair_t operator+(const pair_t &a, const pair_t &b)
+{
+  return {a.x + b.x, a.n + b.n};
+}
+
+struct unregistered_t
+{
+  char c[3];
+};
+
+
+
+TEST_CASE("builtin type mapping", "[mpi]")
+{
+  STATIC_REQUIRE( spar::mpi::utils::type_traits<int32_t>::builtin );
+  STATIC_REQUIRE( spar::mpi::utils::type_traits<uint64_t>::builtin );
+  STATIC_REQUIRE( spar::mpi::utils::type_traits<std::complex<double>>::builtin );
+  STATIC_REQUIRE( !spar::mpi::utils::type_traits<pair_t>::builtin );
+  
+  REQUIRE( spar::mpi::utils::mpi_type_lookup<double>() == MPI_DOUBLE );
+  REQUIRE( spar::mpi::utils::mpi_type_lookup<const int>() == MPI_INT );
+  REQUIRE( spar::mpi::utils::mpi_sum_op<float>() == MPI_SUM );
+  
+  std::vector<std::complex<double>> z(3, std::complex<double>(rank, 1));
+  spar::mpi::reduce(spar::mpi::REDUCE_TO_ALL, MPI_IN_PLACE, z.data(), 3, MPI_SUM);
+  for (int i=0; i<3; i++)
+    REQUIRE( z[i] == std::complex<double>(size*(size-1)/2, size) );
+}
+
+
+
+TEST_CASE("registered types", "[mpi]")
+{
+  REQUIRE_THROWS_AS( spar::mpi::utils::mpi_type_lookup<unregistered_t>(), std::runtime_error );
+  
+  spar::mpi::register_type<pair_t>();
+  spar::mpi::register_type<pair_t>();
+  
+  const MPI_Op sum = spar::mpi::utils::mpi_sum_op<pair_t>();
+  
+  std::vector<pair_t> v(5);
+  for (int i=0; i<5; i++)
+    v[i] = {0.5*rank, rank + i};
+  
+  std::vector<pair_t> r(5);
+  spar::mpi::reduce(spar::mpi::REDUCE_TO_ALL, v.data(), r.data(), 5, sum);
+  for (int i=0; i<5; i++)
+  {
+    REQUIRE( r[i].x == Approx(0.25*size*(size-1)) );
+    REQUIRE( r[i].n == size*(size-1)/2 + size*i );
+  }
+  
+  std::vector<MPI_Count> counts(size, 2);
+  std::vector<MPI_Aint> displs(size);
+  for (int i=0; i<size; i++)
+    displs[i] = 2*i;
+  
+  std::vector<pair_t> g(2*size);
+  spar::mpi::gatherv(spar::mpi::REDUCE_TO_ALL, v.data(), 2, g.data(), counts.data(), displs.data());
+  for (int i=0; i<size; i++)
+  {
+    REQUIRE( g[2*i].n == i );
+    REQUIRE( g[2*i + 1].n == i + 1 );
+  }
+  
+  spar::mpi::unregister_type<pair_t>();
+  REQUIRE_THROWS_AS( spar::mpi::utils::mpi_type_lookup<pair_t>(), std::runtime_error );
+}
@@ -0,0 +1,41 @@
+// Compile-only check of the dgCMatrix converters and s4_writer; it needs the
+// R headers, but is never linked or run.
+#include <converters/s4.hpp>
+#include <spar.hpp>
+#include <reduce.hpp>
+
+
+template spar::spmat<int, double> spar::reduce::gather<SEXP, int, double>(const int, const SEXP&, MPI_Comm);
+template spar::spmat<int, double> spar::reduce::dense<SEXP, int, double>(const int, const SEXP&, MPI_Comm);
+template SEXP spar::conv::spmat_to_s4<int, double>(const spar::spmat<int, double>&);
+template spar::spvec<int, double> spar::conv::s4col_to_spvec<int, double>(const int, SEXP);
+
+// s4_writer has exactly the capacity symbolic() counts, which is what
+// gather() writes; dense() drops cancelled entries and would fall short
+SEXP reduce_to_s4(SEXP x)
+{
+  int m, n;
+  spar::internal::sexp::get_dim_from_s4(x, &m, &n);
+  
+  auto P = spar::reduce::symbolic<SEXP, int, double>(spar::mpi::REDUCE_TO_ALL, x);
+  SEXP s4 = PROTECT(spar::conv::alloc_s4(m, n, P[n]));
+  spar::writers::s4_writer w(s4);
+  spar::reduce::gather<SEXP, int, double>(spar::mpi::REDUCE_TO_ALL, x, w);
+  
+  UNPROTECT(1);
+  return s4;
+}
+
+// the same through a zero-copy view of the input
+SEXP reduce_view_to_s4(SEXP x)
+{
+  auto v = spar::conv::s4_to_spmat_view(x);
+  
+  auto P = spar::reduce::symbolic<spar::spmat_view<int, double>, int, double>(spar::mpi::REDUCE_TO_ALL, v);
+  SEXP s4 = PROTECT(spar::conv::alloc_s4(v.nrows(), v.ncols(), P[v.ncols()]));
+  spar::writers::s4_writer w(s4);
+  spar::reduce::gather<spar::spmat_view<int, double>, int, double>(spar::mpi::REDUCE_TO_ALL, v, w);
+  
+  UNPROTECT(1);
+  return s4;
+}